@@ -0,0 +1,1159 @@
+/*
+  An ordered map from string keys to items using an adaptive radix tree (ART).
+
+  Instead of comparing whole keys at every level like a binary search tree,
+  a radix tree consumes the key one byte at a time, so a lookup costs
+  O(key length) byte steps no matter how many keys are stored, and keys
+  sharing a long prefix only store and compare that prefix once.
+
+  - Inner nodes adapt their size to their number of children: Node4 and
+    Node16 keep sorted arrays of key bytes (Node16 is searched with SSE2
+    when available), Node48 maps all 256 bytes to 48 child slots, and
+    Node256 is a plain array of 256 children.
+  - Path compression: a chain of single-child nodes is collapsed into the
+    prefix stored in the next inner node.
+  - Lazy expansion: a key that does not share its path with any other key
+    sits in a leaf right below the point where it diverges.
+
+  A key may be a prefix of another key (e.g. "Zac" and "Zachary"), the
+  shorter one is then kept as the "terminal" leaf of the inner node where
+  it ends. Keys are ordered like std::string, so iteration visits them in
+  the same order as AVLMap<string, T> would.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <vector>
+#include <charconv>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+template <typename T> class ARTMap;
+template <typename T> class ARTIterator;
+
+enum ARTNodeType { ART_LEAF, ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256 };
+
+// common header of every node, the type says which struct it really is
+struct ARTNode {
+  ARTNode(ARTNodeType type) : type(type) {}
+  ARTNodeType type;
+};
+
+template <typename T>
+struct ARTLeaf : public ARTNode {
+  ARTLeaf(const string& key, const T& item) : ARTNode(ART_LEAF), key(key), item(item) {}
+
+  string key; // the whole key, checked once the search reaches the leaf
+  T item;
+};
+
+// common part of the inner nodes
+template <typename T>
+struct ARTInner : public ARTNode {
+  ARTInner(ARTNodeType type) : ARTNode(type), numChildren(0), terminal(NULL) {}
+
+  string prefix;             // bytes every key below here shares at this point
+  unsigned int numChildren;
+  ARTLeaf<T> *terminal;      // the key that ends right after the prefix, if any
+};
+
+template <typename T>
+struct ARTNode4 : public ARTInner<T> {
+  ARTNode4() : ARTInner<T>(ART_NODE4) {}
+
+  unsigned char keys[4];     // sorted
+  ARTNode *children[4];
+};
+
+template <typename T>
+struct ARTNode16 : public ARTInner<T> {
+  ARTNode16() : ARTInner<T>(ART_NODE16) {}
+
+  unsigned char keys[16];    // sorted
+  ARTNode *children[16];
+};
+
+template <typename T>
+struct ARTNode48 : public ARTInner<T> {
+  ARTNode48() : ARTInner<T>(ART_NODE48) {
+    memset(childIndex, 0, sizeof(childIndex));
+  }
+
+  unsigned char childIndex[256]; // 0 if no child, otherwise 1 + its slot
+  ARTNode *children[48];
+};
+
+template <typename T>
+struct ARTNode256 : public ARTInner<T> {
+  ARTNode256() : ARTInner<T>(ART_NODE256) {
+    memset(children, 0, sizeof(children));
+  }
+
+  ARTNode *children[256];
+};
+
+/*
+  Iterator class for the ARTMap class, visits the keys in increasing order.
+
+  Supports:
+  - key()
+  - item(), as an l-value as well
+  - prefix and postfix increment
+  - == and !=
+*/
+template <typename T>
+class ARTIterator {
+public:
+  const string& key() const {
+    return leaf->key;
+  }
+
+  const T& item() const {
+    return leaf->item;
+  }
+
+  T& item() {
+    return leaf->item;
+  }
+
+  // prefix operator: ++iter
+  ARTIterator<T> operator++() {
+    advance();
+    return *this;
+  }
+
+  // postfix operator: iter++
+  ARTIterator<T> operator++(int) {
+    ARTIterator<T> tmp(*this);
+    advance();
+    return tmp;
+  }
+
+  bool operator==(const ARTIterator<T>& rhs) const {
+    return leaf == rhs.leaf;
+  }
+
+  bool operator!=(const ARTIterator<T>& rhs) const {
+    return leaf != rhs.leaf;
+  }
+
+private:
+  // the path from the root to the current leaf: each inner node with the
+  // next byte to look at, where -1 means its terminal is still to come
+  struct Frame {
+    ARTInner<T> *node;
+    int next;
+  };
+
+  vector<Frame> path;
+  ARTLeaf<T> *leaf; // NULL for the end iterator
+
+  // starts at the first key under root, or is the end iterator if
+  // root is NULL
+  ARTIterator(ARTNode *root) {
+    leaf = NULL;
+    if (root == NULL) {
+      return;
+    }
+    if (root->type == ART_LEAF) {
+      leaf = static_cast<ARTLeaf<T>*>(root);
+      return;
+    }
+
+    Frame start = {static_cast<ARTInner<T>*>(root), -1};
+    path.push_back(start);
+    advance();
+  }
+
+  // move to the next leaf in key order, or the end if there is none
+  void advance() {
+    leaf = NULL;
+    while (!path.empty()) {
+      Frame& top = path.back();
+
+      // a terminal key is a prefix of all other keys below the node,
+      // so it comes first
+      if (top.next == -1) {
+        top.next = 0;
+        if (top.node->terminal) {
+          leaf = top.node->terminal;
+          return;
+        }
+      }
+
+      int byte;
+      ARTNode *child = ARTMap<T>::nextChild(top.node, top.next, byte);
+      if (child == NULL) {
+        path.pop_back();
+        continue;
+      }
+      top.next = byte+1;
+
+      if (child->type == ART_LEAF) {
+        leaf = static_cast<ARTLeaf<T>*>(child);
+        return;
+      }
+      Frame down = {static_cast<ARTInner<T>*>(child), -1};
+      path.push_back(down);
+    }
+  }
+
+  friend class ARTMap<T>;
+};
+
+/*
+  An associative container (map/dict) with string keys using an adaptive
+  radix tree. The update, remove, [], at, and hasKey operations take
+  O(k) time where k is the length of the key, independent of the number
+  of entries.
+
+  Assumes:
+    - T has a default constructor (i.e. T())
+*/
+template <typename T>
+class ARTMap {
+public:
+  // creates an empty ARTMap with 0 items
+  ARTMap();
+
+  // deletes all nodes in the ARTMap
+  ~ARTMap();
+
+  // the tree owns raw nodes, so copying is not supported
+  ARTMap(const ARTMap<T>& copy) = delete;
+  ARTMap<T>& operator=(const ARTMap<T>& rhs) = delete;
+
+  // add the item with the given key, replacing
+  // the old item at that key if the key already exists
+  void update(const string& key, const T& item);
+
+  // remove the key and its associated item
+  void remove(const string& key);
+
+  // returns true iff the key exists
+  bool hasKey(const string& key) const;
+
+  // access the item at the given key, allows assignment
+  // as an l-value, eg. tree["Zac"] = 20;
+  T& operator[](const string& key);
+
+  // does not create the entry if it does not exist
+  const T& at(const string& key) const;
+
+  // returns the number of keys
+  unsigned int size() const;
+
+  // returns an iterator to the first item (ordered by key)
+  ARTIterator<T> begin() const;
+
+  // returns an iterator signalling the end iterator
+  ARTIterator<T> end() const;
+
+private:
+  ARTNode *root;
+  unsigned int artSize;
+
+  // returns the leaf holding the key, or NULL if there is none
+  ARTLeaf<T>* findLeaf(const string& key) const;
+
+  // inserts the key below *ref, where depth bytes of the key have
+  // already been matched; returns the leaf holding the key
+  ARTLeaf<T>* insert(ARTNode** ref, const string& key, unsigned int depth, const T& item);
+
+  // removes the key from below *ref, returns false if it was not there
+  bool erase(ARTNode** ref, const string& key, unsigned int depth);
+
+  // returns the slot holding the child for the byte, or NULL if the
+  // node has no such child
+  static ARTNode** findChild(ARTInner<T>* node, unsigned char byte);
+
+  // the child with the smallest byte >= from, stored in "byte",
+  // or NULL if there is none
+  static ARTNode* nextChild(ARTInner<T>* node, int from, int& byte);
+
+  // adds a child for a byte the node does not have yet, growing the node
+  // into the next larger type if it is full (*ref is updated then)
+  static void addChild(ARTNode** ref, unsigned char byte, ARTNode* child);
+
+  // removes the child for the byte, shrinking the node into the next
+  // smaller type if it got sparse (*ref is updated then)
+  static void removeChild(ARTNode** ref, unsigned char byte);
+
+  // copies the prefix and terminal of one inner node to another
+  static void copyHeader(ARTInner<T>* to, const ARTInner<T>* from);
+
+  // deletes the node and everything below it
+  static void freeNode(ARTNode* node);
+
+  // # of bytes at the start of the node's prefix matching the key from depth on
+  static unsigned int prefixMatch(const ARTInner<T>* node, const string& key, unsigned int depth);
+
+  friend class ARTIterator<T>;
+};
+
+template <typename T>
+ARTMap<T>::ARTMap() {
+  root = NULL;
+  artSize = 0;
+}
+
+template <typename T>
+ARTMap<T>::~ARTMap() {
+  freeNode(root);
+}
+
+template <typename T>
+void ARTMap<T>::freeNode(ARTNode* node) {
+  if (node == NULL) {
+    return;
+  }
+  if (node->type == ART_LEAF) {
+    delete static_cast<ARTLeaf<T>*>(node);
+    return;
+  }
+
+  // every child is visited through nextChild, whatever the node type
+  ARTInner<T> *inner = static_cast<ARTInner<T>*>(node);
+  int byte = -1;
+  for (ARTNode *child = nextChild(inner, 0, byte); child != NULL;
+       child = nextChild(inner, byte+1, byte)) {
+    freeNode(child);
+  }
+  delete inner->terminal;
+
+  switch (node->type) {
+    case ART_NODE4: delete static_cast<ARTNode4<T>*>(node); break;
+    case ART_NODE16: delete static_cast<ARTNode16<T>*>(node); break;
+    case ART_NODE48: delete static_cast<ARTNode48<T>*>(node); break;
+    default: delete static_cast<ARTNode256<T>*>(node); break;
+  }
+}
+
+template <typename T>
+ARTNode** ARTMap<T>::findChild(ARTInner<T>* node, unsigned char byte) {
+  switch (node->type) {
+    case ART_NODE4: {
+      ARTNode4<T> *n = static_cast<ARTNode4<T>*>(node);
+      for (unsigned int i = 0; i < n->numChildren; i++) {
+        if (n->keys[i] == byte) {
+          return &n->children[i];
+        }
+      }
+      return NULL;
+    }
+    case ART_NODE16: {
+      ARTNode16<T> *n = static_cast<ARTNode16<T>*>(node);
+#ifdef __SSE2__
+      // compare the byte against all 16 keys at once, the mask keeps only
+      // the slots that are in use
+      __m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8((char) byte),
+        _mm_loadu_si128((const __m128i*) n->keys));
+      int bits = _mm_movemask_epi8(matches) & ((1 << n->numChildren) - 1);
+      return bits ? &n->children[__builtin_ctz(bits)] : NULL;
+#else
+      for (unsigned int i = 0; i < n->numChildren; i++) {
+        if (n->keys[i] == byte) {
+          return &n->children[i];
+        }
+      }
+      return NULL;
+#endif
+    }
+    case ART_NODE48: {
+      ARTNode48<T> *n = static_cast<ARTNode48<T>*>(node);
+      return n->childIndex[byte] ? &n->children[n->childIndex[byte]-1] : NULL;
+    }
+    default: {
+      ARTNode256<T> *n = static_cast<ARTNode256<T>*>(node);
+      return n->children[byte] ? &n->children[byte] : NULL;
+    }
+  }
+}
+
+template <typename T>
+ARTNode* ARTMap<T>::nextChild(ARTInner<T>* node, int from, int& byte) {
+  switch (node->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+      // both keep their keys sorted, only the array sizes differ
+      unsigned char *keys;
+      ARTNode **children;
+      if (node->type == ART_NODE4) {
+        keys = static_cast<ARTNode4<T>*>(node)->keys;
+        children = static_cast<ARTNode4<T>*>(node)->children;
+      }
+      else {
+        keys = static_cast<ARTNode16<T>*>(node)->keys;
+        children = static_cast<ARTNode16<T>*>(node)->children;
+      }
+      for (unsigned int i = 0; i < node->numChildren; i++) {
+        if (keys[i] >= from) {
+          byte = keys[i];
+          return children[i];
+        }
+      }
+      return NULL;
+    }
+    case ART_NODE48: {
+      ARTNode48<T> *n = static_cast<ARTNode48<T>*>(node);
+      for (int b = from; b < 256; b++) {
+        if (n->childIndex[b]) {
+          byte = b;
+          return n->children[n->childIndex[b]-1];
+        }
+      }
+      return NULL;
+    }
+    default: {
+      ARTNode256<T> *n = static_cast<ARTNode256<T>*>(node);
+      for (int b = from; b < 256; b++) {
+        if (n->children[b]) {
+          byte = b;
+          return n->children[b];
+        }
+      }
+      return NULL;
+    }
+  }
+}
+
+template <typename T>
+void ARTMap<T>::copyHeader(ARTInner<T>* to, const ARTInner<T>* from) {
+  to->prefix = from->prefix;
+  to->terminal = from->terminal;
+}
+
+template <typename T>
+void ARTMap<T>::addChild(ARTNode** ref, unsigned char byte, ARTNode* child) {
+  ARTInner<T> *node = static_cast<ARTInner<T>*>(*ref);
+
+  if (node->type == ART_NODE4 || node->type == ART_NODE16) {
+    unsigned int capacity = node->type == ART_NODE4 ? 4 : 16;
+
+    if (node->numChildren < capacity) {
+      // shift the larger keys over to keep the keys sorted
+      unsigned char *keys;
+      ARTNode **children;
+      if (node->type == ART_NODE4) {
+        keys = static_cast<ARTNode4<T>*>(node)->keys;
+        children = static_cast<ARTNode4<T>*>(node)->children;
+      }
+      else {
+        keys = static_cast<ARTNode16<T>*>(node)->keys;
+        children = static_cast<ARTNode16<T>*>(node)->children;
+      }
+      unsigned int i = node->numChildren;
+      while (i > 0 && keys[i-1] > byte) {
+        keys[i] = keys[i-1];
+        children[i] = children[i-1];
+        i--;
+      }
+      keys[i] = byte;
+      children[i] = child;
+      node->numChildren++;
+      return;
+    }
+
+    // full, move everything into the next size up
+    ARTInner<T> *bigger;
+    if (node->type == ART_NODE4) {
+      ARTNode4<T> *old = static_cast<ARTNode4<T>*>(node);
+      ARTNode16<T> *n = new ARTNode16<T>();
+      memcpy(n->keys, old->keys, 4);
+      memcpy(n->children, old->children, 4*sizeof(ARTNode*));
+      n->numChildren = 4;
+      bigger = n;
+      copyHeader(bigger, old);
+      delete old;
+    }
+    else {
+      ARTNode16<T> *old = static_cast<ARTNode16<T>*>(node);
+      ARTNode48<T> *n = new ARTNode48<T>();
+      for (unsigned int i = 0; i < 16; i++) {
+        n->childIndex[old->keys[i]] = i+1;
+        n->children[i] = old->children[i];
+      }
+      n->numChildren = 16;
+      bigger = n;
+      copyHeader(bigger, old);
+      delete old;
+    }
+    *ref = bigger;
+    addChild(ref, byte, child);
+  }
+  else if (node->type == ART_NODE48) {
+    ARTNode48<T> *n = static_cast<ARTNode48<T>*>(node);
+    if (n->numChildren < 48) {
+      // children are packed in slots 0 .. numChildren-1
+      n->children[n->numChildren] = child;
+      n->childIndex[byte] = ++n->numChildren;
+      return;
+    }
+
+    ARTNode256<T> *bigger = new ARTNode256<T>();
+    for (int b = 0; b < 256; b++) {
+      if (n->childIndex[b]) {
+        bigger->children[b] = n->children[n->childIndex[b]-1];
+      }
+    }
+    bigger->numChildren = 48;
+    copyHeader(bigger, n);
+    delete n;
+    *ref = bigger;
+    addChild(ref, byte, child);
+  }
+  else {
+    ARTNode256<T> *n = static_cast<ARTNode256<T>*>(node);
+    n->children[byte] = child;
+    n->numChildren++;
+  }
+}
+
+template <typename T>
+void ARTMap<T>::removeChild(ARTNode** ref, unsigned char byte) {
+  ARTInner<T> *node = static_cast<ARTInner<T>*>(*ref);
+
+  if (node->type == ART_NODE4 || node->type == ART_NODE16) {
+    unsigned char *keys;
+    ARTNode **children;
+    if (node->type == ART_NODE4) {
+      keys = static_cast<ARTNode4<T>*>(node)->keys;
+      children = static_cast<ARTNode4<T>*>(node)->children;
+    }
+    else {
+      keys = static_cast<ARTNode16<T>*>(node)->keys;
+      children = static_cast<ARTNode16<T>*>(node)->children;
+    }
+
+    // close the gap, keeping the keys sorted
+    unsigned int i = 0;
+    while (keys[i] != byte) {
+      i++;
+    }
+    for (; i+1 < node->numChildren; i++) {
+      keys[i] = keys[i+1];
+      children[i] = children[i+1];
+    }
+    node->numChildren--;
+
+    // shrink a Node16 that would fit in a Node4
+    if (node->type == ART_NODE16 && node->numChildren <= 3) {
+      ARTNode4<T> *smaller = new ARTNode4<T>();
+      memcpy(smaller->keys, keys, node->numChildren);
+      memcpy(smaller->children, children, node->numChildren*sizeof(ARTNode*));
+      smaller->numChildren = node->numChildren;
+      copyHeader(smaller, node);
+      delete static_cast<ARTNode16<T>*>(node);
+      *ref = smaller;
+    }
+  }
+  else if (node->type == ART_NODE48) {
+    ARTNode48<T> *n = static_cast<ARTNode48<T>*>(node);
+
+    // move the last slot into the freed one so the slots stay packed
+    unsigned int slot = n->childIndex[byte]-1;
+    unsigned int last = n->numChildren-1;
+    n->childIndex[byte] = 0;
+    if (slot != last) {
+      for (int b = 0; b < 256; b++) {
+        if (n->childIndex[b] == last+1) {
+          n->childIndex[b] = slot+1;
+          break;
+        }
+      }
+      n->children[slot] = n->children[last];
+    }
+    n->numChildren--;
+
+    if (n->numChildren <= 12) {
+      ARTNode16<T> *smaller = new ARTNode16<T>();
+      for (int b = 0; b < 256; b++) {
+        if (n->childIndex[b]) {
+          smaller->keys[smaller->numChildren] = b;
+          smaller->children[smaller->numChildren++] = n->children[n->childIndex[b]-1];
+        }
+      }
+      copyHeader(smaller, n);
+      delete n;
+      *ref = smaller;
+    }
+  }
+  else {
+    ARTNode256<T> *n = static_cast<ARTNode256<T>*>(node);
+    n->children[byte] = NULL;
+    n->numChildren--;
+
+    if (n->numChildren <= 36) {
+      ARTNode48<T> *smaller = new ARTNode48<T>();
+      for (int b = 0; b < 256; b++) {
+        if (n->children[b]) {
+          smaller->children[smaller->numChildren] = n->children[b];
+          smaller->childIndex[b] = ++smaller->numChildren;
+        }
+      }
+      copyHeader(smaller, n);
+      delete n;
+      *ref = smaller;
+    }
+  }
+}
+
+template <typename T>
+unsigned int ARTMap<T>::prefixMatch(const ARTInner<T>* node, const string& key, unsigned int depth) {
+  unsigned int i = 0;
+  while (i < node->prefix.size() && depth+i < key.size() && node->prefix[i] == key[depth+i]) {
+    i++;
+  }
+  return i;
+}
+
+template <typename T>
+ARTLeaf<T>* ARTMap<T>::findLeaf(const string& key) const {
+  ARTNode *node = root;
+  unsigned int depth = 0;
+
+  while (node != NULL) {
+    if (node->type == ART_LEAF) {
+      // lazy expansion means the bytes below the divergence point were
+      // never checked on the way down, so compare the whole key
+      ARTLeaf<T> *leaf = static_cast<ARTLeaf<T>*>(node);
+      return leaf->key == key ? leaf : NULL;
+    }
+
+    ARTInner<T> *inner = static_cast<ARTInner<T>*>(node);
+    if (prefixMatch(inner, key, depth) != inner->prefix.size()) {
+      return NULL;
+    }
+    depth += inner->prefix.size();
+
+    if (depth == key.size()) {
+      return inner->terminal;
+    }
+
+    ARTNode **child = findChild(inner, key[depth]);
+    node = child ? *child : NULL;
+    depth++;
+  }
+  return NULL;
+}
+
+template <typename T>
+ARTLeaf<T>* ARTMap<T>::insert(ARTNode** ref, const string& key, unsigned int depth, const T& item) {
+  if (*ref == NULL) {
+    ARTLeaf<T> *leaf = new ARTLeaf<T>(key, item);
+    *ref = leaf;
+    ++artSize;
+    return leaf;
+  }
+
+  if ((*ref)->type == ART_LEAF) {
+    ARTLeaf<T> *old = static_cast<ARTLeaf<T>*>(*ref);
+    if (old->key == key) {
+      old->item = item;
+      return old;
+    }
+
+    // two keys now share this spot: put a Node4 where they diverge
+    ARTNode4<T> *split = new ARTNode4<T>();
+    unsigned int common = 0;
+    while (depth+common < key.size() && depth+common < old->key.size()
+           && key[depth+common] == old->key[depth+common]) {
+      common++;
+    }
+    split->prefix = key.substr(depth, common);
+    unsigned int splitDepth = depth + common;
+
+    ARTLeaf<T> *leaf = new ARTLeaf<T>(key, item);
+    ++artSize;
+    *ref = split;
+
+    // a key ending exactly here becomes the terminal
+    if (old->key.size() == splitDepth) {
+      split->terminal = old;
+    }
+    else {
+      addChild(ref, old->key[splitDepth], old);
+    }
+    if (key.size() == splitDepth) {
+      static_cast<ARTInner<T>*>(*ref)->terminal = leaf;
+    }
+    else {
+      addChild(ref, key[splitDepth], leaf);
+    }
+    return leaf;
+  }
+
+  ARTInner<T> *node = static_cast<ARTInner<T>*>(*ref);
+  unsigned int match = prefixMatch(node, key, depth);
+
+  if (match < node->prefix.size()) {
+    // the key leaves the compressed path part way: split the prefix
+    ARTNode4<T> *split = new ARTNode4<T>();
+    split->prefix = node->prefix.substr(0, match);
+    unsigned char oldByte = node->prefix[match];
+    node->prefix = node->prefix.substr(match+1);
+    *ref = split;
+    addChild(ref, oldByte, node);
+
+    ARTLeaf<T> *leaf = new ARTLeaf<T>(key, item);
+    ++artSize;
+    if (depth+match == key.size()) {
+      split->terminal = leaf;
+    }
+    else {
+      addChild(ref, key[depth+match], leaf);
+    }
+    return leaf;
+  }
+
+  depth += node->prefix.size();
+  if (depth == key.size()) {
+    if (node->terminal) {
+      node->terminal->item = item;
+    }
+    else {
+      node->terminal = new ARTLeaf<T>(key, item);
+      ++artSize;
+    }
+    return node->terminal;
+  }
+
+  ARTNode **child = findChild(node, key[depth]);
+  if (child != NULL) {
+    return insert(child, key, depth+1, item);
+  }
+
+  ARTLeaf<T> *leaf = new ARTLeaf<T>(key, item);
+  ++artSize;
+  addChild(ref, key[depth], leaf);
+  return leaf;
+}
+
+template <typename T>
+bool ARTMap<T>::erase(ARTNode** ref, const string& key, unsigned int depth) {
+  if (*ref == NULL) {
+    return false;
+  }
+
+  if ((*ref)->type == ART_LEAF) {
+    ARTLeaf<T> *leaf = static_cast<ARTLeaf<T>*>(*ref);
+    if (leaf->key != key) {
+      return false;
+    }
+    delete leaf;
+    *ref = NULL;
+    --artSize;
+    return true;
+  }
+
+  ARTInner<T> *node = static_cast<ARTInner<T>*>(*ref);
+  if (prefixMatch(node, key, depth) != node->prefix.size()) {
+    return false;
+  }
+  depth += node->prefix.size();
+
+  if (depth == key.size()) {
+    if (node->terminal == NULL) {
+      return false;
+    }
+    delete node->terminal;
+    node->terminal = NULL;
+    --artSize;
+  }
+  else {
+    unsigned char byte = key[depth];
+    ARTNode **child = findChild(node, byte);
+    if (child == NULL || !erase(child, key, depth+1)) {
+      return false;
+    }
+    if (*child == NULL) {
+      removeChild(ref, byte);
+      node = static_cast<ARTInner<T>*>(*ref);
+    }
+  }
+
+  // undo path compression and lazy expansion where the node is no longer
+  // needed: a node left with only a terminal becomes that leaf, and a node
+  // with a single child and no terminal is merged into the child
+  // (shrinking guarantees such a node is a Node4)
+  if (node->numChildren == 0 && node->terminal) {
+    assert(node->type == ART_NODE4);
+    *ref = node->terminal;
+    delete static_cast<ARTNode4<T>*>(node);
+  }
+  else if (node->numChildren == 1 && node->terminal == NULL) {
+    assert(node->type == ART_NODE4);
+    ARTNode4<T> *n = static_cast<ARTNode4<T>*>(node);
+    ARTNode *only = n->children[0];
+    if (only->type != ART_LEAF) {
+      ARTInner<T> *below = static_cast<ARTInner<T>*>(only);
+      below->prefix = n->prefix + (char) n->keys[0] + below->prefix;
+    }
+    *ref = only;
+    delete n;
+  }
+  return true;
+}
+
+template <typename T>
+void ARTMap<T>::update(const string& key, const T& item) {
+  insert(&root, key, 0, item);
+}
+
+template <typename T>
+void ARTMap<T>::remove(const string& key) {
+  bool removed = erase(&root, key, 0);
+
+  // make sure the key was in the tree
+  assert(removed);
+  (void) removed;
+}
+
+template <typename T>
+bool ARTMap<T>::hasKey(const string& key) const {
+  return findLeaf(key) != NULL;
+}
+
+template <typename T>
+T& ARTMap<T>::operator[](const string& key) {
+  ARTLeaf<T> *leaf = findLeaf(key);
+  if (leaf == NULL) {
+    leaf = insert(&root, key, 0, T());
+  }
+  return leaf->item;
+}
+
+template <typename T>
+const T& ARTMap<T>::at(const string& key) const {
+  const ARTLeaf<T> *leaf = findLeaf(key);
+  assert(leaf != NULL);
+  return leaf->item;
+}
+
+template <typename T>
+unsigned int ARTMap<T>::size() const {
+  return artSize;
+}
+
+template <typename T>
+ARTIterator<T> ARTMap<T>::begin() const {
+  return ARTIterator<T>(root);
+}
+
+template <typename T>
+ARTIterator<T> ARTMap<T>::end() const {
+  return ARTIterator<T>(NULL);
+}
+
+/*
+  Buffered output straight to a file descriptor, for dumping large
+  containers.
+
+  Text and numbers are collected in one large buffer and handed to the
+  kernel with a single write() whenever it fills up, instead of going
+  through the formatting and per-line flushing of iostream. Integers are
+  formatted with to_chars.
+
+  When writing to standard output, whatever cout still holds is flushed
+  first, so output from the two comes out in the order it was produced.
+
+  A failed open() or write() does not stop the program: the writer keeps
+  the first error, drops everything after it, and reports it from
+  flush(), close() and error(). Writes cut short by a signal are retried.
+*/
+
+// the formats containers can be exported in: one tab-separated line per
+// entry, or the raw bytes of the entries
+enum ExportFormat {
+  EXPORT_TSV,
+  EXPORT_BINARY
+};
+
+class BufferedWriter {
+public:
+  // writes to the open file descriptor fd, which stays open
+  BufferedWriter(int fd = STDOUT_FILENO, unsigned int capacity = 1 << 20);
+
+  // creates (or truncates) the file at path and writes to it
+  BufferedWriter(const string& path, unsigned int capacity = 1 << 20);
+
+  // closes the writer, ignoring errors; call close() to see them
+  ~BufferedWriter();
+
+  BufferedWriter(const BufferedWriter& copy) = delete;
+  BufferedWriter& operator=(const BufferedWriter& rhs) = delete;
+
+  BufferedWriter& operator<<(char c);
+  BufferedWriter& operator<<(const char* text);
+  BufferedWriter& operator<<(const string& text);
+
+  // any integer type, formatted in decimal
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type operator<<(Int value);
+
+  // the text or number left-aligned in a field of width characters,
+  // like cout << setw(width) << left
+  BufferedWriter& padded(const char* text, unsigned int width);
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+  padded(Int value, unsigned int width);
+
+  // raw bytes, for binary formats
+  void write(const void* bytes, size_t length);
+
+  // hands everything buffered so far to the kernel, returns false if
+  // the file could not be opened or any write so far failed
+  bool flush();
+
+  // flushes, and closes the file if it was opened by path; returns false
+  // like flush, or if closing the file failed
+  bool close();
+
+  // the errno of the first failure, or 0 if there was none
+  int error() const;
+
+private:
+  int fd;
+  bool ownsFd;
+  char *buffer;
+  size_t capacity, used;
+  int firstError;
+
+  // makes room for length more bytes, unless length exceeds the capacity
+  void reserve(size_t length);
+
+  // write() until all the bytes are out
+  void writeAll(const char* bytes, size_t length);
+};
+
+BufferedWriter::BufferedWriter(int fd, unsigned int capacity) {
+  if (fd == STDOUT_FILENO) {
+    cout.flush();
+  }
+  assert(capacity >= 64);
+  this->fd = fd;
+  ownsFd = false;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = 0;
+}
+
+BufferedWriter::BufferedWriter(const string& path, unsigned int capacity) {
+  assert(capacity >= 64);
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ownsFd = fd >= 0;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = (fd >= 0) ? 0 : errno;
+}
+
+BufferedWriter::~BufferedWriter() {
+  close();
+  delete[] buffer;
+}
+
+void BufferedWriter::writeAll(const char* bytes, size_t length) {
+  // once something is missing the rest is no use, so it is dropped
+  while (length > 0 && firstError == 0) {
+    ssize_t n = ::write(fd, bytes, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      firstError = (n < 0) ? errno : EIO;
+      return;
+    }
+    bytes += n;
+    length -= n;
+  }
+}
+
+bool BufferedWriter::flush() {
+  writeAll(buffer, used);
+  used = 0;
+  return firstError == 0;
+}
+
+bool BufferedWriter::close() {
+  flush();
+  if (ownsFd) {
+    if (::close(fd) != 0 && firstError == 0) {
+      firstError = errno;
+    }
+    ownsFd = false;
+    fd = -1;
+  }
+  return firstError == 0;
+}
+
+int BufferedWriter::error() const {
+  return firstError;
+}
+
+void BufferedWriter::reserve(size_t length) {
+  if (used + length > capacity) {
+    flush();
+  }
+}
+
+void BufferedWriter::write(const void* bytes, size_t length) {
+  reserve(length);
+  if (length > capacity) {
+    // too big to buffer, so it goes out directly
+    writeAll((const char*) bytes, length);
+    return;
+  }
+  memcpy(buffer + used, bytes, length);
+  used += length;
+}
+
+BufferedWriter& BufferedWriter::operator<<(char c) {
+  reserve(1);
+  buffer[used++] = c;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const char* text) {
+  write(text, strlen(text));
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const string& text) {
+  write(text.data(), text.size());
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::operator<<(Int value) {
+  // 20 digits and a sign cover any 64-bit integer
+  reserve(21);
+  used = to_chars(buffer + used, buffer + used + 21, value).ptr - buffer;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::padded(const char* text, unsigned int width) {
+  size_t length = strlen(text);
+  write(text, length);
+  for (; length < width; length++) {
+    *this << ' ';
+  }
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::padded(Int value, unsigned int width) {
+  char digits[21];
+  *to_chars(digits, digits + 20, value).ptr = '\0';
+  return padded(digits, width);
+}
+
+void printTree(const ARTMap<int>& tree) {
+  BufferedWriter out;
+  for (ARTIterator<int> iter = tree.begin(); iter != tree.end(); ++iter) {
+    out << " - " << iter.key() << ' ' << iter.item() << '\n';
+  }
+  out << '\n';
+}
+
+// writes every entry of the tree to the file at path, in key order, either
+// as a line of key and item separated by a tab or as the key's length (4
+// bytes), the key and the item (4 bytes); returns false if the file could
+// not be written
+bool exportTree(const ARTMap<int>& tree, const string& path, ExportFormat format) {
+  BufferedWriter out(path);
+  for (ARTIterator<int> iter = tree.begin(); iter != tree.end(); ++iter) {
+    if (format == EXPORT_BINARY) {
+      unsigned int length = iter.key().size();
+      int item = iter.item();
+      out.write(&length, sizeof(length));
+      out.write(iter.key().data(), length);
+      out.write(&item, sizeof(item));
+    }
+    else {
+      out << iter.key() << '\t' << iter.item() << '\n';
+    }
+  }
+  return out.close();
+}
+
+// same commands as the AVLMap demo, so the two can be run side by side
+int main() {
+  ARTMap<int> tree;
+
+  while (true) {
+    char cmd;
+    string name;
+    int grade;
+
+    cin >> cmd;
+    if (cmd == 'S') {
+        cout << tree.size() << endl;
+    }
+    else if (cmd == 'U') {
+      cin >> name >> grade;
+      tree[name] = grade;
+    }
+    else if (cmd == 'F') {
+      cin >> name;
+      if (tree.hasKey(name)) {
+        cout << name << " found with grade " << tree[name] << endl;
+      }
+      else {
+        cout << name << " not found" << endl;
+      }
+    }
+    else if (cmd == 'R') {
+      cin >> name;
+      if (!tree.hasKey(name)) {
+        cout << name << " not found" << endl;
+      }
+      else {
+        tree.remove(name);
+      }
+    }
+    else if (cmd == 'P') {
+      cout << "Printing" << endl;
+      printTree(tree);
+    }
+    else if (cmd == 'E') {
+      cin >> name;
+      if (exportTree(tree, name, EXPORT_TSV)) {
+        cout << "Exported to " << name << endl;
+      }
+      else {
+        cout << "Could not export to " << name << endl;
+      }
+    }
+    else if (cmd == 'Q') {
+      cout << "stopping" << endl;
+      return 0;
+    }
+    else {
+      cout << "invalid command" << endl;
+      cout << "Possible Commands:" << endl
+      << "S - print the size of the map" << endl
+      << "U <name> <grade> - update the grade for the name" << endl
+      << "F <name> - check if the name is in the tree" << endl
+      << "R <name> - remove the entry with the given name" << endl
+      << "P - print all entries in the tree, ordered by key" << endl
+      << "E <file> - write all entries to the file, one tab-separated line each" << endl
+      << "Q - stop" << endl;
+
+      // eat up the rest of the line
+      getline(cin, name);
+    }
+  }
+}
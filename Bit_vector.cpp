@@ -0,0 +1,914 @@
+/*
+  Compact sets of integers: a packed bitvector with constant-time rank
+  and select, and a roaring bitmap for sparse sets of 32-bit ids.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+inline unsigned int popcount(unsigned long long word) {
+  // a single popcnt instruction when built with -mpopcnt (or -march=native)
+  return __builtin_popcountll(word);
+}
+
+// the position of the k-th (from 0) set bit of word, which has more than k
+inline unsigned int selectInWord(unsigned long long word, unsigned int k) {
+  for (unsigned int i = 0; i < k; i++) {
+    word &= word - 1;
+  }
+  return __builtin_ctzll(word);
+}
+
+/*
+  A vector of bits packed 64 to a word.
+
+  After buildIndex(), rank(i) (the number of 1s before position i) takes
+  O(1) time: a superblock of 4096 bits stores the number of 1s before it,
+  each of its eight 512-bit blocks stores the number of 1s before it
+  within the superblock, and at most 8 words are popcounted. This costs
+  192 bits per 4096, i.e. about 4.7% on top of the bits themselves.
+
+  select(k) (the position of the k-th 1) binary searches the superblocks
+  between two samples taken every 8192 ones, then scans at most 8 blocks
+  and 8 words.
+
+  Changing bits after buildIndex() makes rank and select stale until
+  buildIndex() is called again.
+*/
+class BitVector {
+public:
+  // a bitvector of size bits, all 0
+  BitVector(unsigned int size = 0);
+
+  void pushBack(bool bit);
+
+  bool get(unsigned int i) const;
+  void set(unsigned int i);
+  void reset(unsigned int i);
+
+  unsigned int size() const;
+
+  // bytes used by the bits and the rank/select index
+  unsigned int bytesUsed() const;
+
+  // builds the rank and select index for the current bits
+  void buildIndex();
+
+  // the number of 1s in positions 0, ..., i-1
+  unsigned int rank(unsigned int i) const;
+
+  // the position of the k-th 1 (counting from 0), needs k < count()
+  unsigned int select(unsigned int k) const;
+
+  // the number of 1s
+  unsigned int count() const;
+
+  // bulk operations with another bitvector of the same size, 128 bits
+  // at a time
+  void andWith(const BitVector& other);
+  void orWith(const BitVector& other);
+  void xorWith(const BitVector& other);
+
+private:
+  static const unsigned int SUPER_BITS = 4096;
+  static const unsigned int BLOCK_BITS = 512;
+  static const unsigned int SAMPLE_EVERY = 8192;
+
+  struct Superblock {
+    unsigned long long before;     // 1s before the superblock
+    unsigned short blockBefore[8]; // 1s before each block, within the superblock
+  };
+
+  DynamicArray<unsigned long long> words; // bit i is bit i%64 of words[i/64]
+  unsigned int numBits;
+
+  DynamicArray<Superblock> supers;
+  DynamicArray<unsigned int> samples; // superblock holding 1 number k*SAMPLE_EVERY
+  unsigned int numOnes;
+
+  // applies op to each pair of 128-bit chunks, then to the leftover word
+  template <typename Op, typename WordOp>
+  void combine(const BitVector& other, Op op, WordOp wordOp);
+};
+
+BitVector::BitVector(unsigned int size) : words((size + 63) / 64) {
+  numBits = size;
+  numOnes = 0;
+  for (unsigned int w = 0; w < words.size(); w++) {
+    words[w] = 0;
+  }
+}
+
+void BitVector::pushBack(bool bit) {
+  if (numBits % 64 == 0) {
+    words.pushBack(0);
+  }
+  numBits++;
+  if (bit) {
+    set(numBits - 1);
+  }
+}
+
+bool BitVector::get(unsigned int i) const {
+  assert(i < numBits);
+  return (words[i / 64] >> (i % 64)) & 1;
+}
+
+void BitVector::set(unsigned int i) {
+  assert(i < numBits);
+  words[i / 64] |= 1ull << (i % 64);
+}
+
+void BitVector::reset(unsigned int i) {
+  assert(i < numBits);
+  words[i / 64] &= ~(1ull << (i % 64));
+}
+
+unsigned int BitVector::size() const {
+  return numBits;
+}
+
+unsigned int BitVector::bytesUsed() const {
+  return words.size() * sizeof(unsigned long long) + supers.size() * sizeof(Superblock)
+    + samples.size() * sizeof(unsigned int);
+}
+
+void BitVector::buildIndex() {
+  unsigned int numWords = words.size();
+  supers.resize((numWords + 63) / 64 + 1);
+  samples.resize(0);
+
+  unsigned long long total = 0;
+  for (unsigned int s = 0; s < supers.size(); s++) {
+    supers[s].before = total;
+    unsigned int within = 0;
+    for (unsigned int b = 0; b < 8; b++) {
+      supers[s].blockBefore[b] = within;
+      for (unsigned int w = 64*s + 8*b; w < 64*s + 8*b + 8 && w < numWords; w++) {
+        unsigned int ones = popcount(words[w]);
+
+        // sample the superblock of every SAMPLE_EVERY-th 1
+        while (samples.size() * SAMPLE_EVERY < total + within + ones) {
+          samples.pushBack(s);
+        }
+        within += ones;
+      }
+    }
+    total += within;
+  }
+  numOnes = total;
+}
+
+unsigned int BitVector::rank(unsigned int i) const {
+  assert(i <= numBits);
+  const Superblock& super = supers[i / SUPER_BITS];
+  unsigned int count = super.before + super.blockBefore[(i / BLOCK_BITS) % 8];
+  for (unsigned int w = (i / BLOCK_BITS) * 8; w < i / 64; w++) {
+    count += popcount(words[w]);
+  }
+  if (i % 64 != 0) {
+    count += popcount(words[i / 64] & ((1ull << (i % 64)) - 1));
+  }
+  return count;
+}
+
+unsigned int BitVector::select(unsigned int k) const {
+  assert(k < numOnes);
+
+  // the last superblock with fewer than k+1 ones before it lies between
+  // the superblocks of the samples on either side of k
+  unsigned int lo = samples[k / SAMPLE_EVERY];
+  unsigned int hi = (k / SAMPLE_EVERY + 1 < samples.size())
+    ? samples[k / SAMPLE_EVERY + 1] : supers.size() - 1;
+  while (lo < hi) {
+    unsigned int mid = (lo + hi + 1) / 2;
+    if (supers[mid].before <= k) {
+      lo = mid;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+
+  const Superblock& super = supers[lo];
+  unsigned int left = k - super.before;
+  unsigned int b = 7;
+  while (super.blockBefore[b] > left) {
+    b--;
+  }
+  left -= super.blockBefore[b];
+
+  for (unsigned int w = 64*lo + 8*b; ; w++) {
+    unsigned int ones = popcount(words[w]);
+    if (left < ones) {
+      return 64*w + selectInWord(words[w], left);
+    }
+    left -= ones;
+  }
+}
+
+unsigned int BitVector::count() const {
+  unsigned int total = 0;
+  for (unsigned int w = 0; w < words.size(); w++) {
+    total += popcount(words[w]);
+  }
+  return total;
+}
+
+template <typename Op, typename WordOp>
+void BitVector::combine(const BitVector& other, Op op, WordOp wordOp) {
+  assert(numBits == other.numBits);
+  unsigned int numWords = words.size(), w = 0;
+  if (numWords == 0) {
+    return;
+  }
+
+  unsigned long long *mine = &words[0];
+  const unsigned long long *theirs = &other.words[0];
+  for (; w + 2 <= numWords; w += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i*) (mine + w));
+    __m128i b = _mm_loadu_si128((const __m128i*) (theirs + w));
+    _mm_storeu_si128((__m128i*) (mine + w), op(a, b));
+  }
+  if (w < numWords) {
+    mine[w] = wordOp(mine[w], theirs[w]);
+  }
+}
+
+void BitVector::andWith(const BitVector& other) {
+  combine(other, [](__m128i a, __m128i b) { return _mm_and_si128(a, b); },
+          [](unsigned long long a, unsigned long long b) { return a & b; });
+}
+
+void BitVector::orWith(const BitVector& other) {
+  combine(other, [](__m128i a, __m128i b) { return _mm_or_si128(a, b); },
+          [](unsigned long long a, unsigned long long b) { return a | b; });
+}
+
+void BitVector::xorWith(const BitVector& other) {
+  combine(other, [](__m128i a, __m128i b) { return _mm_xor_si128(a, b); },
+          [](unsigned long long a, unsigned long long b) { return a ^ b; });
+}
+
+/*
+  A roaring bitmap: a set of 32-bit ints split by their top 16 bits into
+  containers of up to 65536 values. A container holding at most 4096
+  values is a sorted array of their low 16 bits (2 bytes per value),
+  a fuller one is a bitmap of 65536 bits (8KB), so both sparse and dense
+  ranges take at most about 2 bytes per value.
+
+  add, remove and contains binary search the containers and then the
+  array (or test a bit); & and | work a container at a time, merging
+  arrays and combining bitmaps word by word.
+*/
+class RoaringBitmap {
+public:
+  RoaringBitmap();
+  RoaringBitmap(const RoaringBitmap& copy);
+  ~RoaringBitmap();
+
+  RoaringBitmap& operator=(const RoaringBitmap& rhs);
+
+  // returns true iff the value was not in the set yet
+  bool add(unsigned int value);
+
+  // returns true iff the value was in the set
+  bool remove(unsigned int value);
+
+  bool contains(unsigned int value) const;
+
+  // the number of values in the set
+  unsigned int size() const;
+
+  // bytes used by the containers
+  unsigned int bytesUsed() const;
+
+  // intersection and union
+  RoaringBitmap operator&(const RoaringBitmap& rhs) const;
+  RoaringBitmap operator|(const RoaringBitmap& rhs) const;
+
+  // calls visit(value) for each value in increasing order
+  template <typename Visit>
+  void forEach(Visit visit) const;
+
+private:
+  static const unsigned int ARRAY_MAX = 4096;
+  static const unsigned int BITMAP_WORDS = 65536 / 64;
+
+  struct Container {
+    unsigned short key;                 // the top 16 bits of its values
+    unsigned int cardinality;
+    DynamicArray<unsigned short> array; // sorted low bits, if not a bitmap
+    DynamicArray<unsigned long long> bitmap; // BITMAP_WORDS words, or empty
+
+    bool isBitmap() const {
+      return bitmap.size() != 0;
+    }
+  };
+
+  // sorted by key
+  DynamicArray<Container*> containers;
+
+  // the index of the container with the key, or where it would go
+  unsigned int findContainer(unsigned short key) const;
+  bool hasContainer(unsigned int index, unsigned short key) const;
+
+  // the index of the first value in the sorted array not below low
+  static unsigned int position(const DynamicArray<unsigned short>& array, unsigned short low);
+
+  void clear();
+
+  // the low bits of the values of a container, in order
+  static void lowBits(const Container& c, DynamicArray<unsigned short>& out);
+
+  static void toBitmap(Container& c);
+  static void toArray(Container& c);
+
+  // intersection and union of two containers with the same key, NULL
+  // if the intersection is empty
+  static Container* intersect(const Container& a, const Container& b);
+  static Container* unite(const Container& a, const Container& b);
+};
+
+RoaringBitmap::RoaringBitmap() {
+  // the containers array starts out empty
+}
+
+RoaringBitmap::RoaringBitmap(const RoaringBitmap& copy) {
+  *this = copy;
+}
+
+RoaringBitmap::~RoaringBitmap() {
+  clear();
+}
+
+void RoaringBitmap::clear() {
+  for (unsigned int i = 0; i < containers.size(); i++) {
+    delete containers[i];
+  }
+  containers.resize(0);
+}
+
+RoaringBitmap& RoaringBitmap::operator=(const RoaringBitmap& rhs) {
+  if (this != &rhs) {
+    clear();
+    for (unsigned int i = 0; i < rhs.containers.size(); i++) {
+      containers.pushBack(new Container(*rhs.containers[i]));
+    }
+  }
+  return *this;
+}
+
+unsigned int RoaringBitmap::findContainer(unsigned short key) const {
+  unsigned int lo = 0, hi = containers.size();
+  while (lo < hi) {
+    unsigned int mid = (lo + hi) / 2;
+    if (containers[mid]->key < key) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+bool RoaringBitmap::hasContainer(unsigned int index, unsigned short key) const {
+  return index < containers.size() && containers[index]->key == key;
+}
+
+unsigned int RoaringBitmap::position(const DynamicArray<unsigned short>& array, unsigned short low) {
+  unsigned int lo = 0, hi = array.size();
+  while (lo < hi) {
+    unsigned int mid = (lo + hi) / 2;
+    if (array[mid] < low) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+void RoaringBitmap::toBitmap(Container& c) {
+  c.bitmap.resize(BITMAP_WORDS);
+  for (unsigned int w = 0; w < BITMAP_WORDS; w++) {
+    c.bitmap[w] = 0;
+  }
+  for (unsigned int i = 0; i < c.array.size(); i++) {
+    c.bitmap[c.array[i] / 64] |= 1ull << (c.array[i] % 64);
+  }
+  c.array.resize(0);
+}
+
+void RoaringBitmap::toArray(Container& c) {
+  DynamicArray<unsigned short> values;
+  lowBits(c, values);
+  c.array = values;
+  c.bitmap.resize(0);
+}
+
+void RoaringBitmap::lowBits(const Container& c, DynamicArray<unsigned short>& out) {
+  if (!c.isBitmap()) {
+    out = c.array;
+    return;
+  }
+  out.resize(0);
+  for (unsigned int w = 0; w < BITMAP_WORDS; w++) {
+    for (unsigned long long word = c.bitmap[w]; word != 0; word &= word - 1) {
+      out.pushBack(64*w + __builtin_ctzll(word));
+    }
+  }
+}
+
+bool RoaringBitmap::add(unsigned int value) {
+  unsigned short key = value >> 16, low = value & 0xFFFF;
+  unsigned int index = findContainer(key);
+  if (!hasContainer(index, key)) {
+    Container *fresh = new Container();
+    fresh->key = key;
+    fresh->cardinality = 0;
+    containers.pushBack(NULL);
+    for (unsigned int i = containers.size() - 1; i > index; i--) {
+      containers[i] = containers[i-1];
+    }
+    containers[index] = fresh;
+  }
+
+  Container& c = *containers[index];
+  if (c.isBitmap()) {
+    unsigned long long bit = 1ull << (low % 64);
+    if (c.bitmap[low / 64] & bit) {
+      return false;
+    }
+    c.bitmap[low / 64] |= bit;
+    c.cardinality++;
+    return true;
+  }
+
+  // insert into the sorted array, shifting the larger values up
+  unsigned int n = c.array.size();
+  unsigned int pos = position(c.array, low);
+  if (pos < n && c.array[pos] == low) {
+    return false;
+  }
+  c.array.pushBack(low);
+  for (unsigned int i = n; i > pos; i--) {
+    c.array[i] = c.array[i-1];
+  }
+  c.array[pos] = low;
+  c.cardinality++;
+
+  if (c.cardinality > ARRAY_MAX) {
+    toBitmap(c);
+  }
+  return true;
+}
+
+bool RoaringBitmap::remove(unsigned int value) {
+  unsigned short key = value >> 16, low = value & 0xFFFF;
+  unsigned int index = findContainer(key);
+  if (!hasContainer(index, key)) {
+    return false;
+  }
+
+  Container& c = *containers[index];
+  if (c.isBitmap()) {
+    unsigned long long bit = 1ull << (low % 64);
+    if (!(c.bitmap[low / 64] & bit)) {
+      return false;
+    }
+    c.bitmap[low / 64] &= ~bit;
+    c.cardinality--;
+    if (c.cardinality <= ARRAY_MAX) {
+      toArray(c);
+    }
+  }
+  else {
+    unsigned int n = c.array.size();
+    unsigned int pos = position(c.array, low);
+    if (pos == n || c.array[pos] != low) {
+      return false;
+    }
+    for (unsigned int i = pos; i+1 < n; i++) {
+      c.array[i] = c.array[i+1];
+    }
+    c.array.resize(n - 1);
+    c.cardinality--;
+  }
+
+  // drop empty containers
+  if (c.cardinality == 0) {
+    delete containers[index];
+    for (unsigned int i = index; i+1 < containers.size(); i++) {
+      containers[i] = containers[i+1];
+    }
+    containers.resize(containers.size() - 1);
+  }
+  return true;
+}
+
+bool RoaringBitmap::contains(unsigned int value) const {
+  unsigned short key = value >> 16, low = value & 0xFFFF;
+  unsigned int index = findContainer(key);
+  if (!hasContainer(index, key)) {
+    return false;
+  }
+
+  const Container& c = *containers[index];
+  if (c.isBitmap()) {
+    return (c.bitmap[low / 64] >> (low % 64)) & 1;
+  }
+  unsigned int pos = position(c.array, low);
+  return pos < c.array.size() && c.array[pos] == low;
+}
+
+unsigned int RoaringBitmap::size() const {
+  unsigned int total = 0;
+  for (unsigned int i = 0; i < containers.size(); i++) {
+    total += containers[i]->cardinality;
+  }
+  return total;
+}
+
+unsigned int RoaringBitmap::bytesUsed() const {
+  unsigned int total = containers.size() * sizeof(Container*);
+  for (unsigned int i = 0; i < containers.size(); i++) {
+    const Container& c = *containers[i];
+    total += sizeof(Container) + c.array.size() * sizeof(unsigned short)
+      + c.bitmap.size() * sizeof(unsigned long long);
+  }
+  return total;
+}
+
+RoaringBitmap::Container* RoaringBitmap::intersect(const Container& a, const Container& b) {
+  Container *out = new Container();
+  out->key = a.key;
+  out->cardinality = 0;
+
+  if (a.isBitmap() && b.isBitmap()) {
+    // word by word, 128 bits at a time
+    out->bitmap.resize(BITMAP_WORDS);
+    for (unsigned int w = 0; w < BITMAP_WORDS; w += 2) {
+      __m128i x = _mm_loadu_si128((const __m128i*) (&a.bitmap[0] + w));
+      __m128i y = _mm_loadu_si128((const __m128i*) (&b.bitmap[0] + w));
+      _mm_storeu_si128((__m128i*) (&out->bitmap[0] + w), _mm_and_si128(x, y));
+      out->cardinality += popcount(out->bitmap[w]) + popcount(out->bitmap[w+1]);
+    }
+    if (out->cardinality <= ARRAY_MAX) {
+      toArray(*out);
+    }
+  }
+  else if (a.isBitmap() || b.isBitmap()) {
+    // keep the values of the array that are set in the bitmap
+    const Container& array = a.isBitmap() ? b : a;
+    const Container& bitmap = a.isBitmap() ? a : b;
+    for (unsigned int i = 0; i < array.array.size(); i++) {
+      unsigned short low = array.array[i];
+      if ((bitmap.bitmap[low / 64] >> (low % 64)) & 1) {
+        out->array.pushBack(low);
+      }
+    }
+    out->cardinality = out->array.size();
+  }
+  else {
+    // merge the two sorted arrays
+    unsigned int i = 0, j = 0;
+    while (i < a.array.size() && j < b.array.size()) {
+      if (a.array[i] < b.array[j]) {
+        i++;
+      }
+      else if (b.array[j] < a.array[i]) {
+        j++;
+      }
+      else {
+        out->array.pushBack(a.array[i]);
+        i++;
+        j++;
+      }
+    }
+    out->cardinality = out->array.size();
+  }
+
+  if (out->cardinality == 0) {
+    delete out;
+    return NULL;
+  }
+  return out;
+}
+
+RoaringBitmap::Container* RoaringBitmap::unite(const Container& a, const Container& b) {
+  Container *out = new Container();
+  out->key = a.key;
+  out->cardinality = 0;
+
+  if (!a.isBitmap() && !b.isBitmap() && a.cardinality + b.cardinality <= ARRAY_MAX) {
+    // merge the two sorted arrays
+    unsigned int i = 0, j = 0;
+    while (i < a.array.size() || j < b.array.size()) {
+      if (j == b.array.size() || (i < a.array.size() && a.array[i] < b.array[j])) {
+        out->array.pushBack(a.array[i++]);
+      }
+      else if (i == a.array.size() || b.array[j] < a.array[i]) {
+        out->array.pushBack(b.array[j++]);
+      }
+      else {
+        out->array.pushBack(a.array[i]);
+        i++;
+        j++;
+      }
+    }
+    out->cardinality = out->array.size();
+    return out;
+  }
+
+  // otherwise the union is built as a bitmap
+  out->bitmap.resize(BITMAP_WORDS);
+  for (unsigned int w = 0; w < BITMAP_WORDS; w++) {
+    out->bitmap[w] = a.isBitmap() ? a.bitmap[w] : 0;
+  }
+  if (b.isBitmap()) {
+    for (unsigned int w = 0; w < BITMAP_WORDS; w += 2) {
+      __m128i x = _mm_loadu_si128((const __m128i*) (&out->bitmap[0] + w));
+      __m128i y = _mm_loadu_si128((const __m128i*) (&b.bitmap[0] + w));
+      _mm_storeu_si128((__m128i*) (&out->bitmap[0] + w), _mm_or_si128(x, y));
+    }
+  }
+  else {
+    for (unsigned int i = 0; i < b.array.size(); i++) {
+      out->bitmap[b.array[i] / 64] |= 1ull << (b.array[i] % 64);
+    }
+  }
+  if (!a.isBitmap()) {
+    for (unsigned int i = 0; i < a.array.size(); i++) {
+      out->bitmap[a.array[i] / 64] |= 1ull << (a.array[i] % 64);
+    }
+  }
+  for (unsigned int w = 0; w < BITMAP_WORDS; w++) {
+    out->cardinality += popcount(out->bitmap[w]);
+  }
+  if (out->cardinality <= ARRAY_MAX) {
+    toArray(*out);
+  }
+  return out;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap& rhs) const {
+  RoaringBitmap result;
+  unsigned int i = 0, j = 0;
+  while (i < containers.size() && j < rhs.containers.size()) {
+    unsigned short a = containers[i]->key, b = rhs.containers[j]->key;
+    if (a < b) {
+      i++;
+    }
+    else if (b < a) {
+      j++;
+    }
+    else {
+      Container *both = intersect(*containers[i], *rhs.containers[j]);
+      if (both != NULL) {
+        result.containers.pushBack(both);
+      }
+      i++;
+      j++;
+    }
+  }
+  return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap& rhs) const {
+  RoaringBitmap result;
+  unsigned int i = 0, j = 0;
+  while (i < containers.size() || j < rhs.containers.size()) {
+    if (j == rhs.containers.size() ||
+        (i < containers.size() && containers[i]->key < rhs.containers[j]->key)) {
+      result.containers.pushBack(new Container(*containers[i++]));
+    }
+    else if (i == containers.size() || rhs.containers[j]->key < containers[i]->key) {
+      result.containers.pushBack(new Container(*rhs.containers[j++]));
+    }
+    else {
+      result.containers.pushBack(unite(*containers[i], *rhs.containers[j]));
+      i++;
+      j++;
+    }
+  }
+  return result;
+}
+
+template <typename Visit>
+void RoaringBitmap::forEach(Visit visit) const {
+  DynamicArray<unsigned short> values;
+  for (unsigned int i = 0; i < containers.size(); i++) {
+    lowBits(*containers[i], values);
+    unsigned int high = (unsigned int) containers[i]->key << 16;
+    for (unsigned int v = 0; v < values.size(); v++) {
+      visit(high | values[v]);
+    }
+  }
+}
+
+int main() {
+  const unsigned int N = 1000000;
+  srand(1);
+
+  cout << "Flags for " << N << " students, every third one enrolled" << endl;
+  BitVector enrolled(N);
+  for (unsigned int i = 0; i < N; i += 3) {
+    enrolled.set(i);
+  }
+  enrolled.buildIndex();
+  assert(enrolled.count() == (N + 2) / 3);
+  for (unsigned int i = 0; i < N; i += 997) {
+    assert(enrolled.rank(i) == (i + 2) / 3);
+  }
+  for (unsigned int k = 0; k < enrolled.count(); k += 1009) {
+    assert(enrolled.select(k) == 3*k);
+  }
+  cout << "as ints: " << N * sizeof(int) << " bytes, as a BitVector with rank/select: "
+       << enrolled.bytesUsed() << " bytes" << endl;
+
+  BitVector passed(N);
+  for (unsigned int i = 0; i < N; i += 2) {
+    passed.set(i);
+  }
+  passed.andWith(enrolled);
+  cout << "enrolled and passed: " << passed.count() << endl << endl;
+
+  cout << "Two sets of student ids" << endl;
+  RoaringBitmap a, b;
+  DynamicArray<unsigned int> idsA;
+  for (unsigned int i = 0; i < N; i++) {
+    // a: dense in the low ids, b: sparser over a wider range
+    unsigned int x = rand() % (4*N);
+    unsigned int y = rand() % (16*N);
+    if (a.add(x)) {
+      idsA.pushBack(x);
+    }
+    b.add(y);
+    b.add(x ^ 1);
+  }
+  assert(a.size() == idsA.size());
+  for (unsigned int i = 0; i < idsA.size(); i += 101) {
+    assert(a.contains(idsA[i]));
+  }
+
+  auto start = chrono::steady_clock::now();
+  RoaringBitmap both = a & b;
+  RoaringBitmap either = a | b;
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  assert(both.size() + either.size() == a.size() + b.size());
+  cout << "|a| = " << a.size() << " (" << a.bytesUsed() << " bytes, "
+       << a.size() * sizeof(unsigned int) << " as ints)" << endl;
+  cout << "|b| = " << b.size() << " (" << b.bytesUsed() << " bytes)" << endl;
+  cout << "|a & b| = " << both.size() << ", |a | b| = " << either.size()
+       << " in " << setprecision(3) << ms << " ms" << endl;
+
+  return 0;
+}
@@ -0,0 +1,717 @@
+/*
+  Compressed arrays of unsigned ints, for columns (ids, grades, ...) whose
+  values need far fewer than 32 bits each.
+
+  - BitPackedArray stores every value in the same number of bits.
+  - FrameOfReferenceArray stores blocks of values as offsets from the
+    smallest value of the block, or for sorted blocks as the gaps between
+    neighbouring values, which suits sorted or clustered data.
+  - StreamVByteArray stores each value in 1 to 4 bytes with the lengths
+    kept in separate control bytes, which suits data with a few large
+    values among many small ones.
+
+  All of them support random access, bulk decoding and appending.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <emmintrin.h>
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+// every byte buffer below keeps this many zero bytes after its end, so
+// a value can always be read with one unaligned 8-byte (or 16-byte) load
+const unsigned int PADDING = 16;
+
+// appends n zero bytes before the padding of the buffer
+inline void growBytes(DynamicArray<unsigned char>& bytes, unsigned int n) {
+  for (unsigned int i = 0; i < n; i++) {
+    bytes.pushBack(0);
+  }
+}
+
+inline unsigned long long loadWord(const unsigned char* at) {
+  unsigned long long word;
+  memcpy(&word, at, sizeof(word));
+  return word;
+}
+
+inline void storeWord(unsigned char* at, unsigned long long word) {
+  memcpy(at, &word, sizeof(word));
+}
+
+// the number of bits needed to store values up to maxValue
+inline unsigned int bitsFor(unsigned int maxValue) {
+  return maxValue == 0 ? 0 : 32 - __builtin_clz(maxValue);
+}
+
+// writes value in bits bits starting bitOffset bits into packed,
+// the bits must still be 0
+inline void packValue(unsigned char* packed, unsigned long long bitOffset,
+                      unsigned int bits, unsigned int value) {
+  assert(bits == 32 || (value >> bits) == 0);
+  (void) bits;
+  unsigned char *at = packed + (bitOffset >> 3);
+  storeWord(at, loadWord(at) | ((unsigned long long) value << (bitOffset & 7)));
+}
+
+inline unsigned int unpackValue(const unsigned char* packed, unsigned long long bitOffset,
+                                unsigned int bits) {
+  // bits + 7 <= 39 bits always fit in the 8-byte load
+  unsigned long long mask = (1ull << bits) - 1;
+  return (loadWord(packed + (bitOffset >> 3)) >> (bitOffset & 7)) & mask;
+}
+
+/*
+  An array storing every value in the same number of bits (0 to 32), e.g.
+  7 bits for grades from 0 to 100 instead of 32.
+    operator[] and pushBack take O(1) time.
+*/
+class BitPackedArray {
+public:
+  // values must be below 2^bits
+  BitPackedArray(unsigned int bits);
+
+  void pushBack(unsigned int value);
+
+  unsigned int operator[](unsigned int index) const;
+
+  // out[0..count) = the values at start, ..., start+count-1
+  void decode(unsigned int start, unsigned int count, unsigned int* out) const;
+
+  unsigned int size() const;
+
+  // bytes of packed data
+  unsigned int bytesUsed() const;
+
+private:
+  unsigned int bits;
+  unsigned int numItems;
+  DynamicArray<unsigned char> bytes; // packed values, then PADDING zero bytes
+};
+
+BitPackedArray::BitPackedArray(unsigned int bits) : bytes(PADDING) {
+  assert(bits <= 32);
+  this->bits = bits;
+  numItems = 0;
+  for (unsigned int i = 0; i < PADDING; i++) {
+    bytes[i] = 0;
+  }
+}
+
+void BitPackedArray::pushBack(unsigned int value) {
+  assert(bits == 32 || value < (1u << bits));
+
+  unsigned long long bitOffset = (unsigned long long) numItems * bits;
+  unsigned int needed = (bitOffset + bits + 7) / 8;
+  if (needed > bytesUsed()) {
+    growBytes(bytes, needed - bytesUsed());
+  }
+  packValue(&bytes[0], bitOffset, bits, value);
+  numItems++;
+}
+
+unsigned int BitPackedArray::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return unpackValue(&bytes[0], (unsigned long long) index * bits, bits);
+}
+
+void BitPackedArray::decode(unsigned int start, unsigned int count, unsigned int* out) const {
+  assert(start + count <= numItems);
+  const unsigned char *packed = &bytes[0];
+  unsigned long long bitOffset = (unsigned long long) start * bits;
+  for (unsigned int i = 0; i < count; i++, bitOffset += bits) {
+    out[i] = unpackValue(packed, bitOffset, bits);
+  }
+}
+
+unsigned int BitPackedArray::size() const {
+  return numItems;
+}
+
+unsigned int BitPackedArray::bytesUsed() const {
+  return bytes.size() - PADDING;
+}
+
+/*
+  An array split into blocks of 128 values, each stored as the smallest
+  value of the block plus the offsets of the values from it, bit-packed
+  in as many bits as the block needs. If the block is sorted and the gaps
+  between neighbouring values need fewer bits, it stores the gaps
+  instead (delta coding). Sorted ids or timestamps then need only a few
+  bits per value.
+
+  The values of the last, incomplete block are kept as they are until
+  the block fills up.
+    operator[] and pushBack take O(1) time (pushBack amortized), though
+    operator[] in a delta-coded block adds up to 127 gaps.
+*/
+class FrameOfReferenceArray {
+public:
+  FrameOfReferenceArray();
+
+  void pushBack(unsigned int value);
+
+  unsigned int operator[](unsigned int index) const;
+
+  // out[0..count) = the values at start, ..., start+count-1
+  void decode(unsigned int start, unsigned int count, unsigned int* out) const;
+
+  unsigned int size() const;
+
+  // bytes of packed data and block headers
+  unsigned int bytesUsed() const;
+
+  static const unsigned int BLOCK = 128;
+
+private:
+  struct Block {
+    unsigned int base;   // the smallest (for delta: first) value in the block
+    unsigned int bits;   // bits per offset or gap
+    unsigned int offset; // where the packed offsets start in bytes
+    bool delta;          // gaps from the previous value rather than offsets
+  };
+
+  DynamicArray<Block> blocks;        // the full blocks
+  DynamicArray<unsigned char> bytes; // packed offsets, then PADDING zero bytes
+  unsigned int tail[BLOCK];          // the values of the last block
+  unsigned int numItems;
+
+  // decodes all of full block b into out
+  void decodeBlock(unsigned int b, unsigned int* out) const;
+};
+
+FrameOfReferenceArray::FrameOfReferenceArray() : bytes(PADDING) {
+  numItems = 0;
+  for (unsigned int i = 0; i < PADDING; i++) {
+    bytes[i] = 0;
+  }
+}
+
+void FrameOfReferenceArray::pushBack(unsigned int value) {
+  tail[numItems % BLOCK] = value;
+  numItems++;
+  if (numItems % BLOCK != 0) {
+    return;
+  }
+
+  // the tail is full, pack it, as gaps if it is sorted and they are smaller
+  Block block;
+  block.base = *min_element(tail, tail + BLOCK);
+  block.bits = bitsFor(*max_element(tail, tail + BLOCK) - block.base);
+  block.offset = bytes.size() - PADDING;
+  block.delta = false;
+
+  unsigned int packing[BLOCK];
+  for (unsigned int i = 0; i < BLOCK; i++) {
+    packing[i] = tail[i] - block.base;
+  }
+  if (is_sorted(tail, tail + BLOCK)) {
+    unsigned int maxGap = 0;
+    for (unsigned int i = 1; i < BLOCK; i++) {
+      maxGap = max(maxGap, tail[i] - tail[i-1]);
+    }
+    if (bitsFor(maxGap) < block.bits) {
+      block.bits = bitsFor(maxGap);
+      block.delta = true;
+      packing[0] = 0;
+      for (unsigned int i = 1; i < BLOCK; i++) {
+        packing[i] = tail[i] - tail[i-1];
+      }
+    }
+  }
+
+  // 128 values of b bits take exactly 16*b bytes
+  growBytes(bytes, 16*block.bits);
+  unsigned char *packed = &bytes[0] + block.offset;
+  for (unsigned int i = 0; i < BLOCK; i++) {
+    packValue(packed, (unsigned long long) i * block.bits, block.bits, packing[i]);
+  }
+  blocks.pushBack(block);
+}
+
+unsigned int FrameOfReferenceArray::operator[](unsigned int index) const {
+  assert(index < numItems);
+  unsigned int b = index / BLOCK;
+  if (b == blocks.size()) {
+    return tail[index % BLOCK];
+  }
+
+  const Block& block = blocks[b];
+  const unsigned char *packed = &bytes[0] + block.offset;
+  if (!block.delta) {
+    return block.base + unpackValue(packed, (unsigned long long) (index % BLOCK) * block.bits,
+                                    block.bits);
+  }
+
+  unsigned int value = block.base;
+  for (unsigned int i = 1; i <= index % BLOCK; i++) {
+    value += unpackValue(packed, (unsigned long long) i * block.bits, block.bits);
+  }
+  return value;
+}
+
+void FrameOfReferenceArray::decodeBlock(unsigned int b, unsigned int* out) const {
+  const Block& block = blocks[b];
+  const unsigned char *packed = &bytes[0] + block.offset;
+  for (unsigned int i = 0; i < BLOCK; i++) {
+    out[i] = unpackValue(packed, (unsigned long long) i * block.bits, block.bits);
+  }
+
+  // add the base back, four values at a time, for delta coding as the
+  // running sum of the gaps (a prefix sum within the four lanes, plus the
+  // last sum of the previous four)
+  __m128i base = _mm_set1_epi32(block.base);
+  for (unsigned int i = 0; i < BLOCK; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i*) (out + i));
+    if (block.delta) {
+      v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+      v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+      v = _mm_add_epi32(v, base);
+      base = _mm_shuffle_epi32(v, 0xFF);
+    }
+    else {
+      v = _mm_add_epi32(v, base);
+    }
+    _mm_storeu_si128((__m128i*) (out + i), v);
+  }
+}
+
+void FrameOfReferenceArray::decode(unsigned int start, unsigned int count, unsigned int* out) const {
+  assert(start + count <= numItems);
+  unsigned int end = start + count;
+
+  // one value at a time up to a block boundary, then whole blocks
+  while (start < end && (start % BLOCK != 0 || end - start < BLOCK ||
+                         start / BLOCK == blocks.size())) {
+    *out++ = (*this)[start++];
+    if (start % BLOCK == 0 && end - start >= BLOCK && start / BLOCK < blocks.size()) {
+      break;
+    }
+  }
+  while (end - start >= BLOCK && start / BLOCK < blocks.size()) {
+    decodeBlock(start / BLOCK, out);
+    out += BLOCK;
+    start += BLOCK;
+  }
+  while (start < end) {
+    *out++ = (*this)[start++];
+  }
+}
+
+unsigned int FrameOfReferenceArray::size() const {
+  return numItems;
+}
+
+unsigned int FrameOfReferenceArray::bytesUsed() const {
+  return bytes.size() - PADDING + blocks.size() * sizeof(Block) + sizeof(tail);
+}
+
+/*
+  Stream VByte: every value takes the 1 to 4 bytes it needs, and the
+  lengths are kept apart from the data as 2-bit codes, four to a control
+  byte. A control byte tells where all four of its values are at once,
+  so (with SSSE3) four values are decoded with a single byte shuffle and
+  no branches.
+
+  The data offset of every 64th value is kept in an index, so
+  operator[] only has to add up at most 16 control bytes.
+    operator[] and pushBack take O(1) time (pushBack amortized).
+*/
+class StreamVByteArray {
+public:
+  StreamVByteArray();
+
+  void pushBack(unsigned int value);
+
+  unsigned int operator[](unsigned int index) const;
+
+  // out[0..count) = the values at start, ..., start+count-1
+  void decode(unsigned int start, unsigned int count, unsigned int* out) const;
+
+  unsigned int size() const;
+
+  // bytes of control bytes, data and index
+  unsigned int bytesUsed() const;
+
+  static const unsigned int INDEX_EVERY = 64;
+
+private:
+  DynamicArray<unsigned char> control;  // 2-bit length codes, 4 per byte
+  DynamicArray<unsigned char> data;     // the value bytes, then PADDING zero bytes
+  DynamicArray<unsigned int> index;     // data offset of values 0, 64, 128, ...
+  unsigned int numItems;
+
+  // the data offset of the value at i
+  unsigned int dataOffset(unsigned int i) const;
+
+  // reads the value of length code code at offset
+  unsigned int readValue(unsigned int offset, unsigned int code) const;
+
+  // total data bytes of the four values of each control byte
+  static const unsigned char* groupLengths();
+
+#ifdef __SSSE3__
+  // pshufb masks that spread the data bytes of each control byte into
+  // four 32-bit lanes
+  static const unsigned char (*shuffleMasks())[16];
+#endif
+};
+
+StreamVByteArray::StreamVByteArray() : data(PADDING) {
+  numItems = 0;
+  for (unsigned int i = 0; i < PADDING; i++) {
+    data[i] = 0;
+  }
+}
+
+const unsigned char* StreamVByteArray::groupLengths() {
+  static unsigned char lengths[256];
+  static bool ready = [] {
+    for (unsigned int c = 0; c < 256; c++) {
+      lengths[c] = 4 + (c & 3) + ((c >> 2) & 3) + ((c >> 4) & 3) + (c >> 6);
+    }
+    return true;
+  }();
+  (void) ready;
+  return lengths;
+}
+
+#ifdef __SSSE3__
+const unsigned char (*StreamVByteArray::shuffleMasks())[16] {
+  static unsigned char masks[256][16];
+  static bool ready = [] {
+    for (unsigned int c = 0; c < 256; c++) {
+      unsigned char from = 0;
+      for (unsigned int lane = 0; lane < 4; lane++) {
+        unsigned int length = ((c >> (2*lane)) & 3) + 1;
+        for (unsigned int k = 0; k < 4; k++) {
+          // 0x80 zeroes the byte
+          masks[c][4*lane + k] = k < length ? from++ : 0x80;
+        }
+      }
+    }
+    return true;
+  }();
+  (void) ready;
+  return masks;
+}
+#endif
+
+void StreamVByteArray::pushBack(unsigned int value) {
+  unsigned int code = value < (1u << 8) ? 0 : value < (1u << 16) ? 1 : value < (1u << 24) ? 2 : 3;
+
+  if (numItems % 4 == 0) {
+    control.pushBack(0);
+  }
+  if (numItems % INDEX_EVERY == 0) {
+    index.pushBack(data.size() - PADDING);
+  }
+  control[control.size()-1] |= code << (2*(numItems % 4));
+
+  unsigned int offset = data.size() - PADDING;
+  growBytes(data, code + 1);
+  for (unsigned int k = 0; k <= code; k++) {
+    data[offset + k] = (value >> (8*k)) & 0xFF;
+  }
+  numItems++;
+}
+
+unsigned int StreamVByteArray::dataOffset(unsigned int i) const {
+  const unsigned char *lengths = groupLengths();
+  unsigned int offset = index[i / INDEX_EVERY];
+  for (unsigned int c = (i / INDEX_EVERY) * (INDEX_EVERY/4); c < i/4; c++) {
+    offset += lengths[control[c]];
+  }
+  for (unsigned int lane = 0; lane < i % 4; lane++) {
+    offset += ((control[i/4] >> (2*lane)) & 3) + 1;
+  }
+  return offset;
+}
+
+unsigned int StreamVByteArray::readValue(unsigned int offset, unsigned int code) const {
+  unsigned int mask = code == 3 ? 0xFFFFFFFFu : (1u << (8*(code+1))) - 1;
+  return (unsigned int) loadWord(&data[0] + offset) & mask;
+}
+
+unsigned int StreamVByteArray::operator[](unsigned int i) const {
+  assert(i < numItems);
+  return readValue(dataOffset(i), (control[i/4] >> (2*(i % 4))) & 3);
+}
+
+void StreamVByteArray::decode(unsigned int start, unsigned int count, unsigned int* out) const {
+  assert(start + count <= numItems);
+  if (count == 0) {
+    return;
+  }
+
+  unsigned int end = start + count;
+  unsigned int offset = dataOffset(start);
+
+  // one value at a time up to a control byte boundary
+  while (start < end && start % 4 != 0) {
+    unsigned int code = (control[start/4] >> (2*(start % 4))) & 3;
+    *out++ = readValue(offset, code);
+    offset += code + 1;
+    start++;
+  }
+
+  // then four values per control byte
+  const unsigned char *lengths = groupLengths();
+  const unsigned char *bytes = &data[0];
+  for (; end - start >= 4; start += 4, out += 4) {
+    unsigned char c = control[start/4];
+#ifdef __SSSE3__
+    __m128i in = _mm_loadu_si128((const __m128i*) (bytes + offset));
+    __m128i mask = _mm_loadu_si128((const __m128i*) shuffleMasks()[c]);
+    _mm_storeu_si128((__m128i*) out, _mm_shuffle_epi8(in, mask));
+    offset += lengths[c];
+#else
+    for (unsigned int lane = 0; lane < 4; lane++) {
+      unsigned int code = (c >> (2*lane)) & 3;
+      out[lane] = readValue(offset, code);
+      offset += code + 1;
+    }
+    (void) lengths;
+    (void) bytes;
+#endif
+  }
+
+  while (start < end) {
+    unsigned int code = (control[start/4] >> (2*(start % 4))) & 3;
+    *out++ = readValue(offset, code);
+    offset += code + 1;
+    start++;
+  }
+}
+
+unsigned int StreamVByteArray::size() const {
+  return numItems;
+}
+
+unsigned int StreamVByteArray::bytesUsed() const {
+  return control.size() + (data.size() - PADDING) + index.size() * sizeof(unsigned int);
+}
+
+// checks that decoding all of the array, in pieces, gives back values
+template <typename Array>
+void checkArray(const Array& array, const DynamicArray<unsigned int>& values) {
+  assert(array.size() == values.size());
+  for (unsigned int i = 0; i < values.size(); i += 7) {
+    assert(array[i] == values[i]);
+  }
+
+  DynamicArray<unsigned int> out(values.size());
+  for (unsigned int start = 0; start < values.size(); start += 1000) {
+    unsigned int count = min(1000u, values.size() - start);
+    array.decode(start, count, &out[0] + start);
+  }
+  for (unsigned int i = 0; i < values.size(); i++) {
+    assert(out[i] == values[i]);
+  }
+}
+
+// prints the size of the array compared to plain 32-bit ints, and how
+// fast it decodes
+template <typename Array>
+void report(const char* name, const Array& array) {
+  DynamicArray<unsigned int> out(array.size());
+  auto start = chrono::steady_clock::now();
+  for (int round = 0; round < 10; round++) {
+    array.decode(0, array.size(), &out[0]);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  cout << setw(24) << left << name
+       << setw(10) << array.bytesUsed()
+       << setw(10) << setprecision(3) << 4.0 * array.size() / array.bytesUsed()
+       << setprecision(4) << 10.0 * array.size() / seconds / 1e6 << endl;
+}
+
+int main() {
+  const unsigned int N = 1000000;
+  srand(1);
+
+  // grades: 0 to 100, so 7 bits each
+  DynamicArray<unsigned int> grades(N);
+  BitPackedArray packedGrades(bitsFor(100));
+  for (unsigned int i = 0; i < N; i++) {
+    grades[i] = rand() % 101;
+    packedGrades.pushBack(grades[i]);
+  }
+  checkArray(packedGrades, grades);
+
+  // sorted student ids with small gaps
+  DynamicArray<unsigned int> ids(N);
+  FrameOfReferenceArray forIds;
+  unsigned int id = 10000000;
+  for (unsigned int i = 0; i < N; i++) {
+    id += 1 + rand() % 20;
+    ids[i] = id;
+    forIds.pushBack(id);
+  }
+  checkArray(forIds, ids);
+
+  // counts: mostly small, sometimes large
+  DynamicArray<unsigned int> counts(N);
+  StreamVByteArray vbyteCounts;
+  for (unsigned int i = 0; i < N; i++) {
+    counts[i] = rand() % 16 == 0 ? rand() : rand() % 200;
+    vbyteCounts.pushBack(counts[i]);
+  }
+  checkArray(vbyteCounts, counts);
+
+  cout << N << " values each, plain ints take " << 4*N << " bytes" << endl;
+  cout << setw(24) << left << "array" << setw(10) << "bytes"
+       << setw(10) << "ratio" << "decode (M values/s)" << endl;
+  report("grades, bit-packed", packedGrades);
+  report("ids, frame of reference", forIds);
+  report("counts, Stream VByte", vbyteCounts);
+
+  return 0;
+}
@@ -5,6 +5,15 @@
 #include <iostream>
 #include <cassert>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <string>
+#include <charconv>
+#include <type_traits>
+#include <atomic>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -42,8 +51,6 @@ public:
 
   int find(const T& item);
 
-  unsigned int size() const;
-
 private:
   T *array; // the actual array allocated in the heap
   unsigned int numItems;  // number of items in the array, for the user
@@ -69,7 +76,7 @@ DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
   // was not initialized at all
   // FURTHER STUDY FOR THE CURIOUS: constructor delegation
   array = NULL;
-  resize(numItems);
+  resize(copy.numItems);
 
   // now the array has the proper size, so just copy the contents of the other
   // array into this array
@@ -215,13 +222,356 @@ int DynamicArray<T>::find(const T& item) {
 }
 
 
+/*
+  A vector that many threads can pushBack into at once, without a lock.
+
+  The items live in buckets of 32, 64, 128, ... slots that are never
+  moved or freed until the vector is, so growing never invalidates items
+  other threads are reading. pushBack claims an index with one atomic
+  fetch-add and, the first time an index lands in a new bucket, the
+  threads race to install the bucket with a compare-and-swap (losers
+  free theirs).
+
+  An item may be read, from any thread, once the pushBack that returned
+  its index has finished. size() counts claimed indices, so it can run
+  ahead of the items that are finished while pushBacks are in flight.
+
+  Assumes:
+    - T has a default constructor and assignment operator
+*/
+template <typename T>
+class ConcurrentVector {
+public:
+  ConcurrentVector();
+  ~ConcurrentVector();
+
+  ConcurrentVector(const ConcurrentVector& copy) = delete;
+  ConcurrentVector& operator=(const ConcurrentVector& rhs) = delete;
+
+  // add the item at the end, returns its index
+  unsigned int pushBack(const T& item);
+
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // the number of indices handed out so far
+  unsigned int size() const;
+
+private:
+  // bucket b holds FIRST_BUCKET << b slots, for indices
+  // (FIRST_BUCKET << b) - FIRST_BUCKET and on
+  static const unsigned int FIRST_BITS = 5;
+  static const unsigned int FIRST_BUCKET = 1u << FIRST_BITS;
+  static const unsigned int NUM_BUCKETS = 32 - FIRST_BITS;
+
+  atomic<T*> buckets[NUM_BUCKETS];
+  atomic<unsigned int> numItems;
+
+  // the bucket holding the index, and the index within that bucket
+  static unsigned int bucketOf(unsigned int index);
+  static unsigned int offsetOf(unsigned int index, unsigned int bucket);
+};
+
+template <typename T>
+ConcurrentVector<T>::ConcurrentVector() : numItems(0) {
+  for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+    buckets[b].store(NULL, memory_order_relaxed);
+  }
+}
+
+template <typename T>
+ConcurrentVector<T>::~ConcurrentVector() {
+  for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+    delete[] buckets[b].load(memory_order_relaxed);
+  }
+}
+
+template <typename T>
+unsigned int ConcurrentVector<T>::bucketOf(unsigned int index) {
+  // the highest set bit of index + FIRST_BUCKET picks the bucket
+  unsigned int shifted = index + FIRST_BUCKET;
+  return (31 - __builtin_clz(shifted)) - FIRST_BITS;
+}
+
+template <typename T>
+unsigned int ConcurrentVector<T>::offsetOf(unsigned int index, unsigned int bucket) {
+  return index + FIRST_BUCKET - (FIRST_BUCKET << bucket);
+}
+
+template <typename T>
+unsigned int ConcurrentVector<T>::pushBack(const T& item) {
+  unsigned int index = numItems.fetch_add(1, memory_order_relaxed);
+
+  // make sure the index still fits in the last bucket
+  assert(index < 0u - FIRST_BUCKET);
+
+  unsigned int bucket = bucketOf(index);
+  T *slots = buckets[bucket].load(memory_order_acquire);
+  if (slots == NULL) {
+    T *fresh = new T[FIRST_BUCKET << bucket];
+    if (buckets[bucket].compare_exchange_strong(slots, fresh, memory_order_acq_rel,
+                                                memory_order_acquire)) {
+      slots = fresh;
+    }
+    else {
+      // another thread installed the bucket first, slots now points to it
+      delete[] fresh;
+    }
+  }
+
+  slots[offsetOf(index, bucket)] = item;
+  return index;
+}
+
+template <typename T>
+T& ConcurrentVector<T>::operator[](unsigned int index) {
+  assert(index < size());
+  unsigned int bucket = bucketOf(index);
+  return buckets[bucket].load(memory_order_acquire)[offsetOf(index, bucket)];
+}
+
+template <typename T>
+const T& ConcurrentVector<T>::operator[](unsigned int index) const {
+  assert(index < size());
+  unsigned int bucket = bucketOf(index);
+  return buckets[bucket].load(memory_order_acquire)[offsetOf(index, bucket)];
+}
+
+template <typename T>
+unsigned int ConcurrentVector<T>::size() const {
+  return numItems.load(memory_order_acquire);
+}
+
+/*
+  Buffered output straight to a file descriptor, for dumping large
+  containers.
+
+  Text and numbers are collected in one large buffer and handed to the
+  kernel with a single write() whenever it fills up, instead of going
+  through the formatting and per-line flushing of iostream. Integers are
+  formatted with to_chars.
+
+  When writing to standard output, whatever cout still holds is flushed
+  first, so output from the two comes out in the order it was produced.
+
+  A failed open() or write() does not stop the program: the writer keeps
+  the first error, drops everything after it, and reports it from
+  flush(), close() and error(). Writes cut short by a signal are retried.
+*/
+
+// the formats containers can be exported in: one tab-separated line per
+// entry, or the raw bytes of the entries
+enum ExportFormat {
+  EXPORT_TSV,
+  EXPORT_BINARY
+};
+
+class BufferedWriter {
+public:
+  // writes to the open file descriptor fd, which stays open
+  BufferedWriter(int fd = STDOUT_FILENO, unsigned int capacity = 1 << 20);
+
+  // creates (or truncates) the file at path and writes to it
+  BufferedWriter(const string& path, unsigned int capacity = 1 << 20);
+
+  // closes the writer, ignoring errors; call close() to see them
+  ~BufferedWriter();
+
+  BufferedWriter(const BufferedWriter& copy) = delete;
+  BufferedWriter& operator=(const BufferedWriter& rhs) = delete;
+
+  BufferedWriter& operator<<(char c);
+  BufferedWriter& operator<<(const char* text);
+  BufferedWriter& operator<<(const string& text);
+
+  // any integer type, formatted in decimal
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type operator<<(Int value);
+
+  // the text or number left-aligned in a field of width characters,
+  // like cout << setw(width) << left
+  BufferedWriter& padded(const char* text, unsigned int width);
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+  padded(Int value, unsigned int width);
+
+  // raw bytes, for binary formats
+  void write(const void* bytes, size_t length);
+
+  // hands everything buffered so far to the kernel, returns false if
+  // the file could not be opened or any write so far failed
+  bool flush();
+
+  // flushes, and closes the file if it was opened by path; returns false
+  // like flush, or if closing the file failed
+  bool close();
+
+  // the errno of the first failure, or 0 if there was none
+  int error() const;
+
+private:
+  int fd;
+  bool ownsFd;
+  char *buffer;
+  size_t capacity, used;
+  int firstError;
+
+  // makes room for length more bytes, unless length exceeds the capacity
+  void reserve(size_t length);
+
+  // write() until all the bytes are out
+  void writeAll(const char* bytes, size_t length);
+};
+
+BufferedWriter::BufferedWriter(int fd, unsigned int capacity) {
+  if (fd == STDOUT_FILENO) {
+    cout.flush();
+  }
+  assert(capacity >= 64);
+  this->fd = fd;
+  ownsFd = false;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = 0;
+}
+
+BufferedWriter::BufferedWriter(const string& path, unsigned int capacity) {
+  assert(capacity >= 64);
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ownsFd = fd >= 0;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = (fd >= 0) ? 0 : errno;
+}
+
+BufferedWriter::~BufferedWriter() {
+  close();
+  delete[] buffer;
+}
+
+void BufferedWriter::writeAll(const char* bytes, size_t length) {
+  // once something is missing the rest is no use, so it is dropped
+  while (length > 0 && firstError == 0) {
+    ssize_t n = ::write(fd, bytes, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      firstError = (n < 0) ? errno : EIO;
+      return;
+    }
+    bytes += n;
+    length -= n;
+  }
+}
+
+bool BufferedWriter::flush() {
+  writeAll(buffer, used);
+  used = 0;
+  return firstError == 0;
+}
+
+bool BufferedWriter::close() {
+  flush();
+  if (ownsFd) {
+    if (::close(fd) != 0 && firstError == 0) {
+      firstError = errno;
+    }
+    ownsFd = false;
+    fd = -1;
+  }
+  return firstError == 0;
+}
+
+int BufferedWriter::error() const {
+  return firstError;
+}
+
+void BufferedWriter::reserve(size_t length) {
+  if (used + length > capacity) {
+    flush();
+  }
+}
+
+void BufferedWriter::write(const void* bytes, size_t length) {
+  reserve(length);
+  if (length > capacity) {
+    // too big to buffer, so it goes out directly
+    writeAll((const char*) bytes, length);
+    return;
+  }
+  memcpy(buffer + used, bytes, length);
+  used += length;
+}
+
+BufferedWriter& BufferedWriter::operator<<(char c) {
+  reserve(1);
+  buffer[used++] = c;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const char* text) {
+  write(text, strlen(text));
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const string& text) {
+  write(text.data(), text.size());
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::operator<<(Int value) {
+  // 20 digits and a sign cover any 64-bit integer
+  reserve(21);
+  used = to_chars(buffer + used, buffer + used + 21, value).ptr - buffer;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::padded(const char* text, unsigned int width) {
+  size_t length = strlen(text);
+  write(text, length);
+  for (; length < width; length++) {
+    *this << ' ';
+  }
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::padded(Int value, unsigned int width) {
+  char digits[21];
+  *to_chars(digits, digits + 20, value).ptr = '\0';
+  return padded(digits, width);
+}
+
 void dumpArray(DynamicArray<int> &a) {
-  cout << "Size is: " << a.size() << endl;
-  cout << "Items:";
+  BufferedWriter out;
+  out << "Size is: " << a.size() << '\n';
+  out << "Items:";
+  for (unsigned int i = 0; i < a.size(); i++) {
+    out << ' ' << a[i];
+  }
+  out << "\n\n";
+}
+
+// writes the items of the array to the file at path, either one per line
+// or as their raw bytes; returns false if the file could not be written
+bool exportArray(DynamicArray<int> &a, const string& path, ExportFormat format) {
+  BufferedWriter out(path);
+  if (format == EXPORT_BINARY) {
+    if (a.size() > 0) {
+      out.write(&a[0], a.size() * sizeof(int));
+    }
+    return out.close();
+  }
   for (unsigned int i = 0; i < a.size(); i++) {
-    cout << ' ' << a[i];
+    out << a[i] << '\n';
   }
-  cout << endl << endl;
+  return out.close();
 }
 
 int main() {
@@ -264,5 +614,32 @@ int main() {
   cout << "Now printing b, which was assigned to be a copy of the old 'a'" << endl;
   dumpArray(b);
 
+  // testing the concurrent vector: 4 threads push 1000 numbers each
+  ConcurrentVector<int> shared;
+  thread pushers[4];
+  for (int t = 0; t < 4; t++) {
+    pushers[t] = thread([&shared, t]() {
+      for (int i = 0; i < 1000; i++) {
+        shared.pushBack(1000*t + i);
+      }
+    });
+  }
+  for (int t = 0; t < 4; t++) {
+    pushers[t].join();
+  }
+
+  // every number should show up exactly once, in some order
+  DynamicArray<int> seen(4000);
+  for (unsigned int i = 0; i < seen.size(); i++) {
+    seen[i] = 0;
+  }
+  for (unsigned int i = 0; i < shared.size(); i++) {
+    seen[shared[i]]++;
+  }
+  for (unsigned int i = 0; i < seen.size(); i++) {
+    assert(seen[i] == 1);
+  }
+  cout << "4 threads pushed " << shared.size() << " items into a ConcurrentVector" << endl;
+
   return 0;
 }
@@ -0,0 +1,756 @@
+/*
+  A sorted, array-backed map (a "flat map") as a read-optimized
+  alternative to the AVL tree map.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <charconv>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+// forward declaration so the iterator can name its map
+template <typename K, typename T> class FlatMap;
+
+/*
+  Iterator class for the FlatMap class, just an index into the arrays.
+
+  Supports:
+  - key()
+  - item(), as an l-value as well
+  - prefix and postfix increment
+  - == and !=
+*/
+template <typename K, typename T>
+class FlatIterator {
+public:
+  const K& key() const {
+    return map->keys[index];
+  }
+
+  const T& item() const {
+    return map->items[index];
+  }
+
+  T& item() {
+    return map->items[index];
+  }
+
+  // prefix operator: ++iter
+  FlatIterator<K,T> operator++() {
+    ++index;
+    return *this;
+  }
+
+  // postfix operator: iter++
+  FlatIterator<K,T> operator++(int) {
+    FlatIterator<K,T> tmp(*this);
+    ++index;
+    return tmp;
+  }
+
+  bool operator==(const FlatIterator<K,T>& rhs) const {
+    return index == rhs.index;
+  }
+
+  bool operator!=(const FlatIterator<K,T>& rhs) const {
+    return index != rhs.index;
+  }
+
+private:
+  FlatIterator(FlatMap<K,T>* map, unsigned int index) {
+    this->map = map;
+    this->index = index;
+  }
+
+  FlatMap<K,T> *map;
+  unsigned int index;
+
+  friend class FlatMap<K,T>;
+};
+
+/*
+  An associative container (map/dict) keeping its keys in one sorted
+  DynamicArray and the items in another, in the same order.
+
+  Lookups are a binary search over the contiguous keys, which touches far
+  fewer cache lines than chasing AVL node pointers, and the items are only
+  touched once the key is found. The price is that update and remove of a
+  single new or existing key shift the later entries, so they take O(n)
+  time; updateBatch merges many entries in a single O(n + m log m) pass.
+    hasKey, [] (for existing keys) and at take O(log n) time.
+
+  Offers the same interface as AVLMap, so the two can be swapped.
+
+  Assumes:
+    - K is totally ordered and can be compared via <
+    - K and T have default constructors
+*/
+template <typename K, typename T>
+class FlatMap {
+public:
+  // creates an empty FlatMap with 0 items
+  FlatMap();
+
+  // add the item with the given key, replacing
+  // the old item at that key if the key already exists
+  void update(const K& key, const T& item);
+
+  // add or replace numEntries entries at once, if a key appears more
+  // than once in the batch the last one wins
+  void updateBatch(const K* newKeys, const T* newItems, unsigned int numEntries);
+
+  // remove the key and its associated item
+  void remove(const K& key);
+
+  // returns true iff the key exists
+  bool hasKey(const K& key) const;
+
+  // access the item at the given key, allows assignment
+  // as an l-value, eg. tree["Zac"] = 20;
+  T& operator[](const K& key);
+
+  // does not create the entry if it does not exist
+  const T& at(const K& key) const;
+
+  // returns the number of entries
+  unsigned int size() const;
+
+  // returns an iterator to the first item (ordered by key)
+  FlatIterator<K,T> begin() const;
+
+  // returns an iterator signalling the end iterator
+  FlatIterator<K,T> end() const;
+
+private:
+  DynamicArray<K> keys;  // sorted
+  DynamicArray<T> items; // items[i] belongs to keys[i]
+
+  // the index of the first key that is not less than the given key
+  // (size() if there is none)
+  unsigned int lowerBound(const K& key) const;
+
+  // true iff index is in range and holds exactly the key
+  bool foundAt(unsigned int index, const K& key) const;
+
+  // opens a gap at index and puts the entry there
+  void insertAt(unsigned int index, const K& key, const T& item);
+
+  friend class FlatIterator<K,T>;
+};
+
+template <typename K, typename T>
+FlatMap<K,T>::FlatMap() {
+  // the DynamicArrays start out empty
+}
+
+template <typename K, typename T>
+unsigned int FlatMap<K,T>::lowerBound(const K& key) const {
+  unsigned int n = keys.size();
+  if (n == 0) {
+    return 0;
+  }
+
+  // branchless binary search: the loop always runs log n times and the
+  // comparison only picks which half to keep (compiled to a conditional
+  // move), so there are no hard-to-predict branches
+  const K *first = &keys[0], *base = first;
+  while (n > 1) {
+    unsigned int half = n/2;
+    base = (base[half] < key) ? base + half : base;
+    n -= half;
+  }
+  return (base - first) + (*base < key);
+}
+
+template <typename K, typename T>
+bool FlatMap<K,T>::foundAt(unsigned int index, const K& key) const {
+  return index < keys.size() && !(key < keys[index]);
+}
+
+template <typename K, typename T>
+void FlatMap<K,T>::insertAt(unsigned int index, const K& key, const T& item) {
+  // grow by one at the back, then shift everything after index right
+  keys.pushBack(key);
+  items.pushBack(item);
+  for (unsigned int i = keys.size()-1; i > index; i--) {
+    keys[i] = keys[i-1];
+    items[i] = items[i-1];
+  }
+  keys[index] = key;
+  items[index] = item;
+}
+
+template <typename K, typename T>
+void FlatMap<K,T>::update(const K& key, const T& item) {
+  unsigned int index = lowerBound(key);
+  if (foundAt(index, key)) {
+    items[index] = item;
+  }
+  else {
+    insertAt(index, key, item);
+  }
+}
+
+template <typename K, typename T>
+void FlatMap<K,T>::updateBatch(const K* newKeys, const T* newItems, unsigned int numEntries) {
+  if (numEntries == 0) {
+    return;
+  }
+
+  // sort the batch by key, stable so the last of equal keys stays last
+  DynamicArray<unsigned int> order(numEntries);
+  for (unsigned int i = 0; i < numEntries; i++) {
+    order[i] = i;
+  }
+  stable_sort(&order[0], &order[0] + numEntries,
+    [&](unsigned int a, unsigned int b) { return newKeys[a] < newKeys[b]; });
+
+  // merge the old entries and the batch into new arrays in one pass
+  DynamicArray<K> mergedKeys;
+  DynamicArray<T> mergedItems;
+  unsigned int old = 0, i = 0;
+  while (i < numEntries) {
+    const K& key = newKeys[order[i]];
+
+    // skip to the last entry of a run of equal keys in the batch
+    while (i+1 < numEntries && !(key < newKeys[order[i+1]])) {
+      i++;
+    }
+
+    // old entries before the key stay, an old entry with the key is replaced
+    while (old < keys.size() && keys[old] < key) {
+      mergedKeys.pushBack(keys[old]);
+      mergedItems.pushBack(items[old]);
+      old++;
+    }
+    if (foundAt(old, key)) {
+      old++;
+    }
+    mergedKeys.pushBack(key);
+    mergedItems.pushBack(newItems[order[i]]);
+    i++;
+  }
+  while (old < keys.size()) {
+    mergedKeys.pushBack(keys[old]);
+    mergedItems.pushBack(items[old]);
+    old++;
+  }
+
+  keys = mergedKeys;
+  items = mergedItems;
+}
+
+template <typename K, typename T>
+void FlatMap<K,T>::remove(const K& key) {
+  unsigned int index = lowerBound(key);
+
+  // make sure the key is in the map
+  assert(foundAt(index, key));
+
+  // shift everything after index left and drop the last slot
+  for (unsigned int i = index; i+1 < keys.size(); i++) {
+    keys[i] = keys[i+1];
+    items[i] = items[i+1];
+  }
+  keys.resize(keys.size()-1);
+  items.resize(items.size()-1);
+}
+
+template <typename K, typename T>
+bool FlatMap<K,T>::hasKey(const K& key) const {
+  return foundAt(lowerBound(key), key);
+}
+
+template <typename K, typename T>
+T& FlatMap<K,T>::operator[](const K& key) {
+  // one search finds either the entry or where it goes
+  unsigned int index = lowerBound(key);
+  if (!foundAt(index, key)) {
+    insertAt(index, key, T());
+  }
+  return items[index];
+}
+
+template <typename K, typename T>
+const T& FlatMap<K,T>::at(const K& key) const {
+  unsigned int index = lowerBound(key);
+  assert(foundAt(index, key));
+  return items[index];
+}
+
+template <typename K, typename T>
+unsigned int FlatMap<K,T>::size() const {
+  return keys.size();
+}
+
+// the iterators only hand out const access to keys, so it is safe
+// to let them point at a const map
+template <typename K, typename T>
+FlatIterator<K,T> FlatMap<K,T>::begin() const {
+  return FlatIterator<K,T>(const_cast<FlatMap<K,T>*>(this), 0);
+}
+
+template <typename K, typename T>
+FlatIterator<K,T> FlatMap<K,T>::end() const {
+  return FlatIterator<K,T>(const_cast<FlatMap<K,T>*>(this), keys.size());
+}
+
+/*
+  Buffered output straight to a file descriptor, for dumping large
+  containers.
+
+  Text and numbers are collected in one large buffer and handed to the
+  kernel with a single write() whenever it fills up, instead of going
+  through the formatting and per-line flushing of iostream. Integers are
+  formatted with to_chars.
+
+  When writing to standard output, whatever cout still holds is flushed
+  first, so output from the two comes out in the order it was produced.
+
+  A failed open() or write() does not stop the program: the writer keeps
+  the first error, drops everything after it, and reports it from
+  flush(), close() and error(). Writes cut short by a signal are retried.
+*/
+
+// the formats containers can be exported in: one tab-separated line per
+// entry, or the raw bytes of the entries
+enum ExportFormat {
+  EXPORT_TSV,
+  EXPORT_BINARY
+};
+
+class BufferedWriter {
+public:
+  // writes to the open file descriptor fd, which stays open
+  BufferedWriter(int fd = STDOUT_FILENO, unsigned int capacity = 1 << 20);
+
+  // creates (or truncates) the file at path and writes to it
+  BufferedWriter(const string& path, unsigned int capacity = 1 << 20);
+
+  // closes the writer, ignoring errors; call close() to see them
+  ~BufferedWriter();
+
+  BufferedWriter(const BufferedWriter& copy) = delete;
+  BufferedWriter& operator=(const BufferedWriter& rhs) = delete;
+
+  BufferedWriter& operator<<(char c);
+  BufferedWriter& operator<<(const char* text);
+  BufferedWriter& operator<<(const string& text);
+
+  // any integer type, formatted in decimal
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type operator<<(Int value);
+
+  // the text or number left-aligned in a field of width characters,
+  // like cout << setw(width) << left
+  BufferedWriter& padded(const char* text, unsigned int width);
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+  padded(Int value, unsigned int width);
+
+  // raw bytes, for binary formats
+  void write(const void* bytes, size_t length);
+
+  // hands everything buffered so far to the kernel, returns false if
+  // the file could not be opened or any write so far failed
+  bool flush();
+
+  // flushes, and closes the file if it was opened by path; returns false
+  // like flush, or if closing the file failed
+  bool close();
+
+  // the errno of the first failure, or 0 if there was none
+  int error() const;
+
+private:
+  int fd;
+  bool ownsFd;
+  char *buffer;
+  size_t capacity, used;
+  int firstError;
+
+  // makes room for length more bytes, unless length exceeds the capacity
+  void reserve(size_t length);
+
+  // write() until all the bytes are out
+  void writeAll(const char* bytes, size_t length);
+};
+
+BufferedWriter::BufferedWriter(int fd, unsigned int capacity) {
+  if (fd == STDOUT_FILENO) {
+    cout.flush();
+  }
+  assert(capacity >= 64);
+  this->fd = fd;
+  ownsFd = false;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = 0;
+}
+
+BufferedWriter::BufferedWriter(const string& path, unsigned int capacity) {
+  assert(capacity >= 64);
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ownsFd = fd >= 0;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = (fd >= 0) ? 0 : errno;
+}
+
+BufferedWriter::~BufferedWriter() {
+  close();
+  delete[] buffer;
+}
+
+void BufferedWriter::writeAll(const char* bytes, size_t length) {
+  // once something is missing the rest is no use, so it is dropped
+  while (length > 0 && firstError == 0) {
+    ssize_t n = ::write(fd, bytes, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      firstError = (n < 0) ? errno : EIO;
+      return;
+    }
+    bytes += n;
+    length -= n;
+  }
+}
+
+bool BufferedWriter::flush() {
+  writeAll(buffer, used);
+  used = 0;
+  return firstError == 0;
+}
+
+bool BufferedWriter::close() {
+  flush();
+  if (ownsFd) {
+    if (::close(fd) != 0 && firstError == 0) {
+      firstError = errno;
+    }
+    ownsFd = false;
+    fd = -1;
+  }
+  return firstError == 0;
+}
+
+int BufferedWriter::error() const {
+  return firstError;
+}
+
+void BufferedWriter::reserve(size_t length) {
+  if (used + length > capacity) {
+    flush();
+  }
+}
+
+void BufferedWriter::write(const void* bytes, size_t length) {
+  reserve(length);
+  if (length > capacity) {
+    // too big to buffer, so it goes out directly
+    writeAll((const char*) bytes, length);
+    return;
+  }
+  memcpy(buffer + used, bytes, length);
+  used += length;
+}
+
+BufferedWriter& BufferedWriter::operator<<(char c) {
+  reserve(1);
+  buffer[used++] = c;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const char* text) {
+  write(text, strlen(text));
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const string& text) {
+  write(text.data(), text.size());
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::operator<<(Int value) {
+  // 20 digits and a sign cover any 64-bit integer
+  reserve(21);
+  used = to_chars(buffer + used, buffer + used + 21, value).ptr - buffer;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::padded(const char* text, unsigned int width) {
+  size_t length = strlen(text);
+  write(text, length);
+  for (; length < width; length++) {
+    *this << ' ';
+  }
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::padded(Int value, unsigned int width) {
+  char digits[21];
+  *to_chars(digits, digits + 20, value).ptr = '\0';
+  return padded(digits, width);
+}
+
+void printTree(const FlatMap<string, int>& tree) {
+  BufferedWriter out;
+  for (FlatIterator<string, int> iter = tree.begin(); iter != tree.end(); ++iter) {
+    out << " - " << iter.key() << ' ' << iter.item() << '\n';
+  }
+  out << '\n';
+}
+
+// writes every entry of the tree to the file at path, in key order, either
+// as a line of key and item separated by a tab or as the key's length (4
+// bytes), the key and the item (4 bytes); returns false if the file could
+// not be written
+bool exportTree(const FlatMap<string, int>& tree, const string& path, ExportFormat format) {
+  BufferedWriter out(path);
+  for (FlatIterator<string, int> iter = tree.begin(); iter != tree.end(); ++iter) {
+    if (format == EXPORT_BINARY) {
+      unsigned int length = iter.key().size();
+      int item = iter.item();
+      out.write(&length, sizeof(length));
+      out.write(iter.key().data(), length);
+      out.write(&item, sizeof(item));
+    }
+    else {
+      out << iter.key() << '\t' << iter.item() << '\n';
+    }
+  }
+  return out.close();
+}
+
+int main() {
+  FlatMap<string, int> tree;
+
+  // load a few entries in one batch, "Zac" appears twice so the later
+  // grade is the one kept
+  string names[] = {"Zac", "Omid", "Alexa", "Siri", "Zac"};
+  int grades[] = {89, 89, 34, 84, 91};
+  tree.updateBatch(names, grades, 5);
+  assert(tree.size() == 4 && tree.at("Zac") == 91);
+
+  cout << "Loaded by batch" << endl;
+  printTree(tree);
+
+  // then the same commands as the AVLMap demo
+  while (true) {
+    char cmd;
+    string name;
+    int grade;
+
+    cin >> cmd;
+    if (cmd == 'S') {
+        cout << tree.size() << endl;
+    }
+    else if (cmd == 'U') {
+      cin >> name >> grade;
+      tree[name] = grade;
+    }
+    else if (cmd == 'F') {
+      cin >> name;
+      if (tree.hasKey(name)) {
+        cout << name << " found with grade " << tree[name] << endl;
+      }
+      else {
+        cout << name << " not found" << endl;
+      }
+    }
+    else if (cmd == 'R') {
+      cin >> name;
+      if (!tree.hasKey(name)) {
+        cout << name << " not found" << endl;
+      }
+      else {
+        tree.remove(name);
+      }
+    }
+    else if (cmd == 'P') {
+      cout << "Printing" << endl;
+      printTree(tree);
+    }
+    else if (cmd == 'E') {
+      cin >> name;
+      if (exportTree(tree, name, EXPORT_TSV)) {
+        cout << "Exported to " << name << endl;
+      }
+      else {
+        cout << "Could not export to " << name << endl;
+      }
+    }
+    else if (cmd == 'Q') {
+      cout << "stopping" << endl;
+      return 0;
+    }
+    else {
+      cout << "invalid command" << endl;
+      cout << "Possible Commands:" << endl
+      << "S - print the size of the map" << endl
+      << "U <name> <grade> - update the grade for the name" << endl
+      << "F <name> - check if the name is in the tree" << endl
+      << "R <name> - remove the entry with the given name" << endl
+      << "P - print all entries in the tree, ordered by key" << endl
+      << "E <file> - write all entries to the file, one tab-separated line each" << endl
+      << "Q - stop" << endl;
+
+      // eat up the rest of the line
+      getline(cin, name);
+    }
+  }
+}
@@ -0,0 +1,869 @@
+/*
+  Sequences with cheap edits in the middle: a gap buffer for edits that
+  cluster around a moving cursor, and a rope for huge sequences that get
+  cut up and pasted together.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <string>
+#include <chrono>
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+/*
+  A sequence stored in one array with a gap of unused slots at the
+  cursor, like a text editor's buffer.
+
+  Inserting or erasing at the cursor only grows or shrinks the gap, so it
+  takes O(1) amortized time. Editing somewhere else first moves the gap
+  there, which copies only the items between the old and the new spot:
+  for a cursor that moves around a little between edits, that is a few
+  items instead of the whole tail. operator[] skips over the gap.
+
+  Assumes:
+    - T has a default constructor and assignment operator
+*/
+template <typename T>
+class GapBuffer {
+public:
+  // creates an empty buffer
+  GapBuffer();
+  ~GapBuffer();
+
+  GapBuffer(const GapBuffer& copy);
+  GapBuffer& operator=(const GapBuffer& rhs);
+
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // inserts the item so it ends up at the index, and puts the cursor after it
+  void insert(unsigned int index, const T& item);
+
+  // erases the item at the index and puts the cursor there
+  void erase(unsigned int index);
+
+  unsigned int size() const;
+
+  // where the gap is, i.e. the index the next insert there would take
+  unsigned int cursor() const;
+
+  // moves the gap to the index without editing anything
+  void moveCursor(unsigned int index);
+
+private:
+  T *buffer;
+  unsigned int capacity;
+  unsigned int gapStart, gapEnd; // the gap is buffer[gapStart], ..., buffer[gapEnd-1]
+
+  // grows the buffer so the gap has room for at least one more item
+  void grow();
+};
+
+template <typename T>
+GapBuffer<T>::GapBuffer() {
+  capacity = 16;
+  buffer = new T[capacity];
+  gapStart = 0;
+  gapEnd = capacity;
+}
+
+template <typename T>
+GapBuffer<T>::~GapBuffer() {
+  delete[] buffer;
+}
+
+template <typename T>
+GapBuffer<T>::GapBuffer(const GapBuffer& copy) {
+  buffer = NULL;
+  *this = copy;
+}
+
+template <typename T>
+GapBuffer<T>& GapBuffer<T>::operator=(const GapBuffer& rhs) {
+  if (this != &rhs) {
+    delete[] buffer;
+    capacity = rhs.capacity;
+    buffer = new T[capacity];
+    gapStart = rhs.gapStart;
+    gapEnd = rhs.gapEnd;
+    for (unsigned int i = 0; i < gapStart; i++) {
+      buffer[i] = rhs.buffer[i];
+    }
+    for (unsigned int i = gapEnd; i < capacity; i++) {
+      buffer[i] = rhs.buffer[i];
+    }
+  }
+  return *this;
+}
+
+template <typename T>
+T& GapBuffer<T>::operator[](unsigned int index) {
+  assert(index < size());
+  return buffer[index < gapStart ? index : index + (gapEnd - gapStart)];
+}
+
+template <typename T>
+const T& GapBuffer<T>::operator[](unsigned int index) const {
+  assert(index < size());
+  return buffer[index < gapStart ? index : index + (gapEnd - gapStart)];
+}
+
+template <typename T>
+void GapBuffer<T>::moveCursor(unsigned int index) {
+  assert(index <= size());
+
+  // the items between the old and the new cursor hop over the gap
+  while (gapStart > index) {
+    buffer[--gapEnd] = buffer[--gapStart];
+  }
+  while (gapStart < index) {
+    buffer[gapStart++] = buffer[gapEnd++];
+  }
+}
+
+template <typename T>
+void GapBuffer<T>::grow() {
+  // double the capacity, all the new room goes to the gap
+  unsigned int newCapacity = 2 * capacity;
+  unsigned int tail = capacity - gapEnd;
+  T *newBuffer = new T[newCapacity];
+  for (unsigned int i = 0; i < gapStart; i++) {
+    newBuffer[i] = buffer[i];
+  }
+  for (unsigned int i = 0; i < tail; i++) {
+    newBuffer[newCapacity - tail + i] = buffer[gapEnd + i];
+  }
+  delete[] buffer;
+
+  buffer = newBuffer;
+  capacity = newCapacity;
+  gapEnd = newCapacity - tail;
+}
+
+template <typename T>
+void GapBuffer<T>::insert(unsigned int index, const T& item) {
+  moveCursor(index);
+  if (gapStart == gapEnd) {
+    grow();
+  }
+  buffer[gapStart++] = item;
+}
+
+template <typename T>
+void GapBuffer<T>::erase(unsigned int index) {
+  assert(index < size());
+  moveCursor(index);
+  gapEnd++;
+}
+
+template <typename T>
+unsigned int GapBuffer<T>::size() const {
+  return capacity - (gapEnd - gapStart);
+}
+
+template <typename T>
+unsigned int GapBuffer<T>::cursor() const {
+  return gapStart;
+}
+
+/*
+  A rope: a sequence kept as a balanced binary tree whose leaves hold
+  chunks of up to CHUNK consecutive items, and whose internal nodes
+  record how many items lie below them.
+
+  The tree is balanced like an AVL tree, and two ropes are joined by
+  walking down the spine of the taller one to a subtree as tall as the
+  shorter one and rebalancing on the way back up, which takes time
+  proportional to their difference in height. split cuts the path to an
+  index and joins the pieces hanging off it back together, so both
+  split and concat take O(log n) time, without copying items other than
+  those of the leaf split in two.
+
+  operator[] takes O(log n) time. insert and erase change a leaf in
+  place when it has room (or more than one item) and fall back to split
+  and join otherwise, so they are O(log n + CHUNK).
+
+  Assumes:
+    - T has a default constructor and assignment operator
+*/
+template <typename T>
+class Rope {
+public:
+  // creates an empty rope
+  Rope();
+
+  // a rope of the n items, built as a perfectly balanced tree
+  Rope(const T* items, unsigned int n);
+
+  ~Rope();
+
+  Rope(const Rope& copy);
+  Rope& operator=(const Rope& rhs);
+
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // inserts the item so it ends up at the index
+  void insert(unsigned int index, const T& item);
+
+  // erases the item at the index
+  void erase(unsigned int index);
+
+  unsigned int size() const;
+
+  // appends the items of other, leaving other empty
+  void concat(Rope& other);
+
+  // moves the items from the index on to rest, which is emptied first
+  void split(unsigned int index, Rope& rest);
+
+  // copies the items into out, which must have room for size() items
+  void copyTo(T* out) const;
+
+private:
+  static const unsigned int CHUNK = sizeof(T) >= 64 ? 16 : 1024 / sizeof(T);
+
+  struct Node {
+    Node *left, *right; // both NULL for a leaf
+    unsigned int size;  // # of items below, or in the leaf
+    int height;         // 0 for a leaf
+    T *items;           // CHUNK slots, for a leaf only
+  };
+
+  Node *root;
+
+  static Node* makeLeaf();
+  static Node* makeInternal(Node* left, Node* right);
+  static void destroy(Node* node);
+  static Node* clone(const Node* node);
+  static Node* build(const T* items, unsigned int n);
+
+  static int height(const Node* node);
+  static unsigned int size(const Node* node);
+  static void update(Node* node);
+
+  // AVL rotations and rebalancing of a node whose children differ in
+  // height by at most 2, returning the new root of the subtree
+  static Node* rotateLeft(Node* node);
+  static Node* rotateRight(Node* node);
+  static Node* rebalance(Node* node);
+
+  // the rope of the items of a followed by those of b
+  static Node* join(Node* a, Node* b);
+
+  // cuts the tree so the first index items end up in left and the rest in right
+  static void split(Node* node, unsigned int index, Node*& left, Node*& right);
+
+  static void copyTo(const Node* node, T* out);
+
+  // the leaf holding the index, with the index turned into one within the leaf
+  Node* findLeaf(unsigned int& index) const;
+
+  // adds delta to the sizes on the path from the root to the index's leaf
+  void adjustPath(unsigned int index, int delta);
+};
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::makeLeaf() {
+  Node *leaf = new Node();
+  leaf->left = leaf->right = NULL;
+  leaf->size = 0;
+  leaf->height = 0;
+  leaf->items = new T[CHUNK];
+  return leaf;
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::makeInternal(Node* left, Node* right) {
+  Node *node = new Node();
+  node->left = left;
+  node->right = right;
+  node->items = NULL;
+  update(node);
+  return node;
+}
+
+template <typename T>
+void Rope<T>::destroy(Node* node) {
+  if (node == NULL) {
+    return;
+  }
+  destroy(node->left);
+  destroy(node->right);
+  delete[] node->items;
+  delete node;
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::clone(const Node* node) {
+  if (node == NULL) {
+    return NULL;
+  }
+  if (node->height == 0) {
+    Node *leaf = makeLeaf();
+    leaf->size = node->size;
+    for (unsigned int i = 0; i < node->size; i++) {
+      leaf->items[i] = node->items[i];
+    }
+    return leaf;
+  }
+  return makeInternal(clone(node->left), clone(node->right));
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::build(const T* items, unsigned int n) {
+  if (n == 0) {
+    return NULL;
+  }
+  if (n <= CHUNK) {
+    Node *leaf = makeLeaf();
+    leaf->size = n;
+    for (unsigned int i = 0; i < n; i++) {
+      leaf->items[i] = items[i];
+    }
+    return leaf;
+  }
+
+  // split on a chunk boundary so every leaf but the last is full
+  unsigned int chunks = (n + CHUNK - 1) / CHUNK;
+  unsigned int half = (chunks / 2) * CHUNK;
+  return makeInternal(build(items, half), build(items + half, n - half));
+}
+
+template <typename T>
+int Rope<T>::height(const Node* node) {
+  return node == NULL ? -1 : node->height;
+}
+
+template <typename T>
+unsigned int Rope<T>::size(const Node* node) {
+  return node == NULL ? 0 : node->size;
+}
+
+template <typename T>
+void Rope<T>::update(Node* node) {
+  node->size = node->left->size + node->right->size;
+  node->height = 1 + max(node->left->height, node->right->height);
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::rotateLeft(Node* node) {
+  Node *pivot = node->right;
+  node->right = pivot->left;
+  update(node);
+  pivot->left = node;
+  update(pivot);
+  return pivot;
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::rotateRight(Node* node) {
+  Node *pivot = node->left;
+  node->left = pivot->right;
+  update(node);
+  pivot->right = node;
+  update(pivot);
+  return pivot;
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::rebalance(Node* node) {
+  update(node);
+  int balance = node->right->height - node->left->height;
+  if (balance > 1) {
+    if (node->right->right->height < node->right->left->height) {
+      node->right = rotateRight(node->right);
+    }
+    return rotateLeft(node);
+  }
+  if (balance < -1) {
+    if (node->left->left->height < node->left->right->height) {
+      node->left = rotateLeft(node->left);
+    }
+    return rotateRight(node);
+  }
+  return node;
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::join(Node* a, Node* b) {
+  if (a == NULL) {
+    return b;
+  }
+  if (b == NULL) {
+    return a;
+  }
+
+  // hang the shorter tree off the spine of the taller one
+  if (a->height > b->height + 1) {
+    a->right = join(a->right, b);
+    return rebalance(a);
+  }
+  if (b->height > a->height + 1) {
+    b->left = join(a, b->left);
+    return rebalance(b);
+  }
+
+  // two leaves that fit in one are merged, so edits do not leave
+  // a trail of tiny leaves behind
+  if (a->height == 0 && b->height == 0 && a->size + b->size <= CHUNK) {
+    for (unsigned int i = 0; i < b->size; i++) {
+      a->items[a->size + i] = b->items[i];
+    }
+    a->size += b->size;
+    destroy(b);
+    return a;
+  }
+  return makeInternal(a, b);
+}
+
+template <typename T>
+void Rope<T>::split(Node* node, unsigned int index, Node*& left, Node*& right) {
+  if (node == NULL) {
+    left = right = NULL;
+    return;
+  }
+
+  if (node->height == 0) {
+    if (index == 0) {
+      left = NULL;
+      right = node;
+    }
+    else if (index == node->size) {
+      left = node;
+      right = NULL;
+    }
+    else {
+      // the leaf keeps the front of its chunk, a new one gets the back
+      Node *back = makeLeaf();
+      back->size = node->size - index;
+      for (unsigned int i = 0; i < back->size; i++) {
+        back->items[i] = node->items[index + i];
+      }
+      node->size = index;
+      left = node;
+      right = back;
+    }
+    return;
+  }
+
+  // the node itself goes away, its children are joined with the pieces
+  Node *l = node->left, *r = node->right;
+  delete node;
+  Node *middle;
+  if (index <= l->size) {
+    split(l, index, left, middle);
+    right = join(middle, r);
+  }
+  else {
+    split(r, index - l->size, middle, right);
+    left = join(l, middle);
+  }
+}
+
+template <typename T>
+void Rope<T>::copyTo(const Node* node, T* out) {
+  if (node == NULL) {
+    return;
+  }
+  if (node->height == 0) {
+    for (unsigned int i = 0; i < node->size; i++) {
+      out[i] = node->items[i];
+    }
+    return;
+  }
+  copyTo(node->left, out);
+  copyTo(node->right, out + node->left->size);
+}
+
+template <typename T>
+Rope<T>::Rope() {
+  root = NULL;
+}
+
+template <typename T>
+Rope<T>::Rope(const T* items, unsigned int n) {
+  root = build(items, n);
+}
+
+template <typename T>
+Rope<T>::~Rope() {
+  destroy(root);
+}
+
+template <typename T>
+Rope<T>::Rope(const Rope& copy) {
+  root = clone(copy.root);
+}
+
+template <typename T>
+Rope<T>& Rope<T>::operator=(const Rope& rhs) {
+  if (this != &rhs) {
+    destroy(root);
+    root = clone(rhs.root);
+  }
+  return *this;
+}
+
+template <typename T>
+typename Rope<T>::Node* Rope<T>::findLeaf(unsigned int& index) const {
+  Node *node = root;
+  while (node->height > 0) {
+    if (index < node->left->size) {
+      node = node->left;
+    }
+    else {
+      index -= node->left->size;
+      node = node->right;
+    }
+  }
+  return node;
+}
+
+template <typename T>
+void Rope<T>::adjustPath(unsigned int index, int delta) {
+  Node *node = root;
+  while (node->height > 0) {
+    node->size += delta;
+    if (index < node->left->size) {
+      node = node->left;
+    }
+    else {
+      index -= node->left->size;
+      node = node->right;
+    }
+  }
+  node->size += delta;
+}
+
+template <typename T>
+T& Rope<T>::operator[](unsigned int index) {
+  assert(index < size());
+  Node *leaf = findLeaf(index);
+  return leaf->items[index];
+}
+
+template <typename T>
+const T& Rope<T>::operator[](unsigned int index) const {
+  assert(index < size());
+  Node *leaf = findLeaf(index);
+  return leaf->items[index];
+}
+
+template <typename T>
+void Rope<T>::insert(unsigned int index, const T& item) {
+  assert(index <= size());
+
+  // an index at the end of one leaf belongs to it, not the next one,
+  // so appending goes into the last leaf
+  if (root != NULL) {
+    unsigned int within = index > 0 ? index - 1 : 0;
+    Node *leaf = findLeaf(within);
+    if (index > 0) {
+      within++;
+    }
+    if (leaf->size < CHUNK) {
+      for (unsigned int i = leaf->size; i > within; i--) {
+        leaf->items[i] = leaf->items[i-1];
+      }
+      leaf->items[within] = item;
+      adjustPath(index > 0 ? index - 1 : 0, 1);
+      return;
+    }
+  }
+
+  // the leaf is full: cut the rope there and join a new leaf in between
+  Node *single = makeLeaf();
+  single->items[0] = item;
+  single->size = 1;
+  Node *left, *right;
+  split(root, index, left, right);
+  root = join(join(left, single), right);
+}
+
+template <typename T>
+void Rope<T>::erase(unsigned int index) {
+  assert(index < size());
+  unsigned int within = index;
+  Node *leaf = findLeaf(within);
+  if (leaf->size > 1) {
+    for (unsigned int i = within; i+1 < leaf->size; i++) {
+      leaf->items[i] = leaf->items[i+1];
+    }
+    adjustPath(index, -1);
+    return;
+  }
+
+  // the last item of its leaf: cut the leaf out
+  Node *left, *middle, *right;
+  split(root, index + 1, middle, right);
+  split(middle, index, left, middle);
+  destroy(middle);
+  root = join(left, right);
+}
+
+template <typename T>
+unsigned int Rope<T>::size() const {
+  return size(root);
+}
+
+template <typename T>
+void Rope<T>::concat(Rope& other) {
+  if (this == &other) {
+    return;
+  }
+  root = join(root, other.root);
+  other.root = NULL;
+}
+
+template <typename T>
+void Rope<T>::split(unsigned int index, Rope& rest) {
+  assert(index <= size() && this != &rest);
+  destroy(rest.root);
+  split(root, index, root, rest.root);
+}
+
+template <typename T>
+void Rope<T>::copyTo(T* out) const {
+  copyTo(root, out);
+}
+
+// types a line of text at a cursor that wanders around the document: a
+// few characters typed, a few backspaced, then the cursor moves a little
+template <typename Sequence>
+double typeAround(Sequence& doc, unsigned int edits, unsigned int seed) {
+  srand(seed);
+  unsigned int cursor = doc.size() / 2;
+  auto start = chrono::steady_clock::now();
+  for (unsigned int e = 0; e < edits; e++) {
+    int action = rand() % 10;
+    if (action < 6) {
+      doc.insert(cursor, 'a' + rand() % 26);
+      cursor++;
+    }
+    else if (action < 8 && cursor > 0) {
+      cursor--;
+      doc.erase(cursor);
+    }
+    else {
+      int step = rand() % 81 - 40;
+      cursor = min((unsigned int) max((int) cursor + step, 0), doc.size());
+    }
+  }
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// what we had: DynamicArray with every edit shifting the tail
+struct ShiftingText {
+  DynamicArray<char> chars; // the first length are the text, never shrunk
+  unsigned int length = 0;
+
+  void insert(unsigned int index, char c) {
+    if (length == chars.size()) {
+      chars.pushBack(c);
+    }
+    for (unsigned int i = length; i > index; i--) {
+      chars[i] = chars[i-1];
+    }
+    chars[index] = c;
+    length++;
+  }
+
+  void erase(unsigned int index) {
+    for (unsigned int i = index; i+1 < length; i++) {
+      chars[i] = chars[i+1];
+    }
+    length--;
+  }
+
+  unsigned int size() const {
+    return length;
+  }
+};
+
+int main() {
+  const unsigned int LENGTH = 1000000, EDITS = 5000;
+
+  string text(LENGTH, ' ');
+  for (unsigned int i = 0; i < LENGTH; i++) {
+    text[i] = (i % 80 == 79) ? '\n' : 'a' + i % 26;
+  }
+
+  ShiftingText shifting;
+  GapBuffer<char> gap;
+  for (unsigned int i = 0; i < LENGTH; i++) {
+    shifting.insert(i, text[i]);
+    gap.insert(i, text[i]);
+  }
+  Rope<char> rope(text.data(), LENGTH);
+
+  cout << EDITS << " edits around a cursor in a " << LENGTH << " character document" << endl;
+  cout << fixed << setprecision(1)
+       << "  shifting DynamicArray: " << typeAround(shifting, EDITS, 7) << " ms" << endl
+       << "  gap buffer:            " << typeAround(gap, EDITS, 7) << " ms" << endl
+       << "  rope:                  " << typeAround(rope, EDITS, 7) << " ms" << endl;
+
+  assert(shifting.size() == gap.size() && gap.size() == rope.size());
+  for (unsigned int i = 0; i < gap.size(); i++) {
+    assert(shifting.chars[i] == gap[i] && gap[i] == rope[i]);
+  }
+  cout << endl;
+
+  // cut and paste in a much larger document: move its second quarter to the end
+  const unsigned int BIG = 100000000;
+  string big(BIG, 'x');
+  Rope<char> book(big.data(), BIG);
+  auto start = chrono::steady_clock::now();
+  Rope<char> quarter, rest;
+  book.split(BIG / 4, quarter);
+  quarter.split(BIG / 4, rest);
+  book.concat(rest);
+  book.concat(quarter);
+  double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  assert(book.size() == BIG);
+  cout << "moved " << BIG / 4 << " characters within a " << BIG << " character rope in "
+       << setprecision(3) << ms << " ms" << endl;
+
+  return 0;
+}
@@ -1,14 +1,232 @@
 #include <cassert>
 #include <iostream>
 #include <cstdlib>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
 #include <string>
+#include <string_view>
+#include <fstream>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <coroutine>
+#include <exception>
+#include <charconv>
+#include <type_traits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+// pulled in by io_uring.h from linux/fs.h, and clashes with StringInterner
+#undef BLOCK_SIZE
 
 using namespace std;
 
 // forward declaration of class, so AVLNode can establish it's "friends" :)
-template <typename K, typename T> class AVLMap;
 template <typename K, typename T> class AVLIterator;
 
+/*
+  Balancing policies for AVLMap, picked by its third template parameter.
+
+  AVLBalance keeps the classic AVL property (child heights differ by at
+  most 1), which makes for the shallowest trees but may take O(log n)
+  rotations to restore after a removal.
+
+  WAVLBalance keeps the weak AVL (rank-balanced) property instead: every
+  node has a rank, rank differences to children are 1 or 2, and leaves
+  have rank 0. Inserts rebalance exactly as in an AVL tree, so a tree
+  built without removals is an AVL tree, but a removal does at most two
+  rotations and O(1) amortized rank changes. This makes it the better
+  choice for maps with as many removals as updates.
+*/
+struct AVLBalance {
+  static const bool WEAK = false;
+};
+
+struct WAVLBalance {
+  static const bool WEAK = true;
+};
+
+/*
+  Augmentation policies for AVLMap, picked by its fourth template parameter.
+
+  Whenever the subtree below a node changes, AVLMap calls
+  Augment::combine(item, left, right) with the node's item and the items
+  of its children (NULL if missing), lower nodes first, so each item can
+  keep a summary of its whole subtree. Rotations redo the two nodes they
+  move, and inserts, updates and removals redo the path up to the root.
+  NoAugment skips all of this.
+*/
+struct NoAugment {
+  static const bool ENABLED = false;
+
+  template <typename T>
+  static void combine(T&, const T*, const T*) {}
+};
+
+template <typename K, typename T, typename Balance = AVLBalance,
+  typename Augment = NoAugment> class AVLMap;
+template <typename K, typename T, typename Balance = AVLBalance> class IntervalMap;
+template <typename K, typename T> class CachedAVLMap;
+
+/*
+  Support for interleaving many independent lookups on one thread.
+
+  A lookup is written as a C++20 coroutine that prefetches each node before
+  following the pointer to it and suspends in the meantime. runInterleaved
+  keeps a group of such lookups in flight and resumes them round robin, so
+  by the time a lookup runs again its node is usually in cache and the
+  cache misses of the whole group overlap instead of being paid one after
+  the other.
+*/
+
+// the most lookups runInterleaved keeps in flight at once
+const unsigned int MAX_INTERLEAVE = 32;
+
+// the frames of finished lookups are kept on a per-thread free list until
+// runInterleaved returns, every lookup frame fits in one block of this size
+const size_t FRAME_BLOCK = 256;
+
+struct FrameBlock {
+  FrameBlock *next;
+};
+
+inline thread_local FrameBlock *freeFrames = NULL;
+
+// a lookup that has not run to completion yet
+class LookupTask {
+public:
+  struct promise_type {
+    LookupTask get_return_object() {
+      return LookupTask(coroutine_handle<promise_type>::from_promise(*this));
+    }
+
+    // lookups run until their first prefetch as soon as they are started,
+    // and stay around when done so runInterleaved can see that they are
+    suspend_never initial_suspend() noexcept { return {}; }
+    suspend_always final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { terminate(); }
+
+    static void* operator new(size_t size) {
+      if (size > FRAME_BLOCK) {
+        return ::operator new(size);
+      }
+      FrameBlock *block = freeFrames;
+      if (block == NULL) {
+        return ::operator new(FRAME_BLOCK);
+      }
+      freeFrames = block->next;
+      return block;
+    }
+
+    static void operator delete(void* frame, size_t size) {
+      if (size > FRAME_BLOCK) {
+        ::operator delete(frame);
+        return;
+      }
+      FrameBlock *block = (FrameBlock*) frame;
+      block->next = freeFrames;
+      freeFrames = block;
+    }
+  };
+
+  // hands the coroutine over to the caller, who must destroy() it
+  coroutine_handle<> release() {
+    coroutine_handle<> released = handle;
+    handle = NULL;
+    return released;
+  }
+
+  LookupTask(LookupTask&& other) {
+    handle = other.release();
+  }
+
+  LookupTask(const LookupTask& copy) = delete;
+  LookupTask& operator=(const LookupTask& rhs) = delete;
+
+  ~LookupTask() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+private:
+  LookupTask(coroutine_handle<> handle) {
+    this->handle = handle;
+  }
+
+  coroutine_handle<> handle;
+};
+
+// co_await PrefetchNode{p} starts loading *p into cache and lets the other
+// lookups run until it is there
+struct PrefetchNode {
+  const void *address;
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(coroutine_handle<>) const noexcept { __builtin_prefetch(address); }
+  void await_resume() const noexcept {}
+};
+
+// runs the lookups start(0), ..., start(count-1), keeping up to group
+// of them in flight
+template <typename Start>
+void runInterleaved(unsigned int count, unsigned int group, Start start) {
+  assert(group > 0 && group <= MAX_INTERLEAVE);
+
+  coroutine_handle<> inFlight[MAX_INTERLEAVE];
+  unsigned int active = 0, next = 0;
+  while (true) {
+    // top the group up with new lookups, each runs up to its first prefetch
+    while (active < group && next < count) {
+      coroutine_handle<> lookup = start(next++).release();
+      if (lookup.done()) {
+        lookup.destroy();
+      }
+      else {
+        inFlight[active++] = lookup;
+      }
+    }
+    if (active == 0) {
+      break;
+    }
+
+    // resume each lookup in flight once, the last one takes the slot of
+    // any that finish
+    for (unsigned int i = 0; i < active; ) {
+      inFlight[i].resume();
+      if (inFlight[i].done()) {
+        inFlight[i].destroy();
+        inFlight[i] = inFlight[--active];
+      }
+      else {
+        i++;
+      }
+    }
+  }
+
+  // hand the recycled frames back to the heap
+  while (freeFrames != NULL) {
+    FrameBlock *next = freeFrames->next;
+    ::operator delete(freeFrames);
+    freeFrames = next;
+  }
+}
+
 /*
   Node for holding the key, item, and pointers for a node in the AVL.
   Everything is private, only AVLMap abd AVLIterator have access.
@@ -62,7 +280,9 @@ private:
   int height;
 
   // give access to the AVL map class itself and its iterators
-  friend class AVLMap<K,T>;
+  template <typename, typename, typename, typename> friend class AVLMap;
+  template <typename, typename, typename> friend class IntervalMap;
+  friend class CachedAVLMap<K,T>;
   friend class AVLIterator<K,T>;
 };
 
@@ -148,7 +368,7 @@ private:
   AVLNode<K,T> *node;
 
   // needed so AVLMap can access the constructor
-  friend class AVLMap<K,T>;
+  template <typename, typename, typename, typename> friend class AVLMap;
 };
 
 
@@ -161,9 +381,13 @@ private:
   Assumes:
     - K is totally ordered and can be compared via <, !=, and ==
     - T has a default constructor (i.e. T())
+
+  With the WAVLBalance policy the "height" of a node is its WAVL rank.
+  With an Augment policy other than NoAugment, items must only be changed
+  through update so the summaries stay correct, not through [].
 */
 
-template <typename K, typename T>
+template <typename K, typename T, typename Balance, typename Augment>
 class AVLMap {
 public:
     // creates an empty AVLMap with 0 items
@@ -182,6 +406,16 @@ public:
     // returns true iff the key exists
     bool hasKey(const K& key) const;
 
+    // returns a pointer to the item at the given key, or NULL if the key
+    // does not exist, using a single descent of the tree
+    T* lookup(const K& key) const;
+
+    // items[i] = lookup(keys[i]) for each of the numKeys keys, walking up
+    // to group of the searches down the tree at once so their cache misses
+    // overlap; much faster than separate lookups for large trees
+    void lookupBatch(const K* keys, unsigned int numKeys, T** items,
+        unsigned int group = 16) const;
+
     // access the item at the given key, allows assignment
     // as an l-value, eg. tree["Zac"] = 20;
     // where tree is an instance of AVLMap<string, int>
@@ -199,6 +433,13 @@ public:
     // returns an iterator signalling the end iterator
     AVLIterator<K,T> end() const;
 
+    // returns an iterator to the first item whose key is not less than
+    // the given key, or end() if there is none
+    AVLIterator<K,T> lowerBound(const K& key) const;
+
+    // removes all entries
+    void clear();
+
 private:
     AVLNode<K,T> *root;
     unsigned int avlSize;
@@ -208,6 +449,15 @@ private:
     // or NULL if the tree is currently empty
     AVLNode<K,T>* findNode(const K& key) const;
 
+    // one lookup of lookupBatch, as a coroutine that suspends before
+    // visiting each node
+    LookupTask lookupTask(const K& key, T** item) const;
+
+    // create a node for a key that is not in the tree as a child of parent,
+    // which must be what findNode(key) returned, and rebalance the tree
+    // returns the new node
+    AVLNode<K,T>* insertBelow(AVLNode<K,T>* parent, const K& key, const T& item);
+
     // assumes at least one child of node is NULL, will delete
     // the node and move its only child (if any) to its place
     void pluckNode(AVLNode<K,T>* node);
@@ -216,6 +466,22 @@ private:
     // nodes above it
     void fixUp(AVLNode<K,T>* node);
 
+    // WAVL rebalancing after node was added as a new leaf
+    void fixInsertWAVL(AVLNode<K,T>* node);
+
+    // WAVL rebalancing after a node was removed below parent, leaving
+    // child (possibly NULL) in its place
+    void fixRemoveWAVL(AVLNode<K,T>* parent, AVLNode<K,T>* child);
+
+    // rank of a node, where a missing node has rank -1
+    static int rank(const AVLNode<K,T>* node);
+
+    // recompute the augmented summary of the node from its children
+    void augment(AVLNode<K,T>* node);
+
+    // recompute the augmented summary of the node and every node above it
+    void augmentUp(AVLNode<K,T>* node);
+
     // recalculate the height of the node, assuming its children's heights
     // are correct
     void recalcHeight(AVLNode<K,T>* node);
@@ -225,17 +491,21 @@ private:
     // node->left or node->right are not null
     AVLNode<K,T>* rotateLeft(AVLNode<K,T>* node);
     AVLNode<K,T>* rotateRight(AVLNode<K,T>* node);
+
+    // interval queries and the hot-key cache work on the nodes directly
+    template <typename, typename, typename> friend class IntervalMap;
+    friend class CachedAVLMap<K,T>;
 };
 
 
-template <typename K, typename T>
-AVLMap<K,T>::AVLMap() {
+template <typename K, typename T, typename Balance, typename Augment>
+AVLMap<K,T,Balance,Augment>::AVLMap() {
     this->root = NULL;
     this->avlSize = 0;
 }
 
-template <typename K, typename T>
-AVLMap<K,T>::~AVLMap() {
+template <typename K, typename T, typename Balance, typename Augment>
+AVLMap<K,T,Balance,Augment>::~AVLMap() {
     if (this->root != NULL) {
         delete this->root;
 
@@ -245,43 +515,58 @@ AVLMap<K,T>::~AVLMap() {
     }
 }
 
-template <typename K, typename T>
-void AVLMap<K,T>::update(const K& key, const T& item) {
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::update(const K& key, const T& item) {
     AVLNode<K,T>* node = findNode(key);
 
     // if there was no node in the tree with this key, create one
     if (node == NULL || node->key != key) {
-        AVLNode<K,T> *newNode = new AVLNode<K,T>(key, item, NULL, NULL, node, 0);
-        assert(newNode != NULL);
+        insertBelow(node, key, item);
+    }
+    else {
+        // the key existed, so just update the item
+        node->item = item;
+        augmentUp(node);
+    }
+}
 
-        // change the left or right pointer of the parent node
-        // whichever is appropriate to preserve the AVL property
-        if (node == NULL) {
-            // the tree was empty, so this is the new root
-            root = newNode;
+template <typename K, typename T, typename Balance, typename Augment>
+AVLNode<K,T>* AVLMap<K,T,Balance,Augment>::insertBelow(AVLNode<K,T>* parent, const K& key, const T& item) {
+    AVLNode<K,T> *newNode = new AVLNode<K,T>(key, item, NULL, NULL, parent, 0);
+    assert(newNode != NULL);
+
+    // change the left or right pointer of the parent node
+    // whichever is appropriate to preserve the AVL property
+    if (parent == NULL) {
+        // the tree was empty, so this is the new root
+        root = newNode;
+    }
+    else {
+        // the tree was not empty, so put it as the appropriate child of "parent"
+        if (key < parent->key) {
+            parent->left = newNode;
         }
         else {
-            // the tree was not empty, so put it as the appropriate child of "node"
-            if (key < node->key) {
-                node->left = newNode;
-            }
-            else {
-                node->right = newNode;
-            }
+            parent->right = newNode;
         }
-        ++avlSize;
+    }
+    ++avlSize;
+    augmentUp(newNode);
 
-        // now fix the AVL property up the tree
-        fixUp(newNode);
+    // now fix the AVL property up the tree, rotations relink nodes
+    // rather than moving keys so newNode still holds this key afterwards
+    if (Balance::WEAK) {
+        fixInsertWAVL(newNode);
     }
     else {
-        // the key existed, so just update the item
-        node->item = item;
+        fixUp(newNode);
     }
+
+    return newNode;
 }
 
-template <typename K, typename T>
-void AVLMap<K,T>::remove(const K& key) {
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::remove(const K& key) {
     AVLNode<K,T>* node = findNode(key);
 
     // make sure the key is in the tree
@@ -302,51 +587,101 @@ void AVLMap<K,T>::remove(const K& key) {
     node->item = pluck->item;
 
     AVLNode<K,T> *pluckParent = pluck->parent;
+    AVLNode<K,T> *pluckChild = pluck->left ? pluck->left : pluck->right;
 
     // this function will delete a node with no left child and
     // restructure the tree
     pluckNode(pluck);
 
+    // node took over the contents of pluck, it is pluckParent or above it
+    augmentUp(pluckParent);
+
     // now fix the AVL tree up starting from the parent
     // of the recently-deleted node
-    fixUp(pluckParent);
+    if (Balance::WEAK) {
+        fixRemoveWAVL(pluckParent, pluckChild);
+    }
+    else {
+        fixUp(pluckParent);
+    }
 }
 
-template <typename K, typename T>
-bool AVLMap<K,T>::hasKey(const K& key) const {
+template <typename K, typename T, typename Balance, typename Augment>
+bool AVLMap<K,T,Balance,Augment>::hasKey(const K& key) const {
 
     // "find" the node, and then check it really has the key
     AVLNode<K,T> *node = findNode(key);
     return node != NULL && !(node->key != key);
 }
 
-template <typename K, typename T>
-T& AVLMap<K,T>::operator[](const K& key) {
+template <typename K, typename T, typename Balance, typename Augment>
+T& AVLMap<K,T,Balance,Augment>::operator[](const K& key) {
 
     // "find" the node, if not found then create an entry
     // using the default constructor for the item type
-    if (!hasKey(key)) {
-        update(key, T());
+    // the node found is reused, so this only descends the tree once
+    AVLNode<K,T> *node = findNode(key);
+    if (node == NULL || node->key != key) {
+        node = insertBelow(node, key, T());
     }
 
-    return findNode(key)->item;
+    return node->item;
 }
 
-template <typename K, typename T>
-const T& AVLMap<K,T>::at(const K& key) const {
+template <typename K, typename T, typename Balance, typename Augment>
+T* AVLMap<K,T,Balance,Augment>::lookup(const K& key) const {
+    AVLNode<K,T> *node = findNode(key);
+    if (node == NULL || node->key != key) {
+        return NULL;
+    }
+
+    return &node->item;
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::lookupBatch(const K* keys, unsigned int numKeys, T** items,
+    unsigned int group) const {
+    runInterleaved(numKeys, group, [&](unsigned int i) {
+        return lookupTask(keys[i], &items[i]);
+    });
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+LookupTask AVLMap<K,T,Balance,Augment>::lookupTask(const K& key, T** item) const {
+    AVLNode<K,T> *node = this->root;
+    while (node != NULL) {
+        co_await PrefetchNode{node};
+
+        if (key < node->key) {
+            node = node->left;
+        }
+        else if (node->key < key) {
+            node = node->right;
+        }
+        else {
+            *item = &node->item;
+            co_return;
+        }
+    }
+
+    *item = NULL;
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+const T& AVLMap<K,T,Balance,Augment>::at(const K& key) const {
     const AVLNode<K,T> *node = findNode(key);
     assert(node != NULL && !(node->key != key));
 
     return node->item;
 }
 
-template <typename K, typename T>
-unsigned int AVLMap<K,T>::size() const {
+template <typename K, typename T, typename Balance, typename Augment>
+unsigned int AVLMap<K,T,Balance,Augment>::size() const {
     return this->avlSize;
 }
 
-template <typename K, typename T>
-AVLNode<K,T>* AVLMap<K,T>::findNode(const K& key) const {
+template <typename K, typename T, typename Balance, typename Augment>
+AVLNode<K,T>* AVLMap<K,T,Balance,Augment>::findNode(const K& key) const {
     AVLNode<K,T> *node = this->root, *parent = NULL;
 
     // traverse down the tree, going left and right as appropriate,
@@ -373,20 +708,49 @@ AVLNode<K,T>* AVLMap<K,T>::findNode(const K& key) const {
 }
 
 // an AVLIterator is just a wrapper for a pointer to a node
-template <typename K, typename T>
-AVLIterator<K,T> AVLMap<K,T>::begin() const {
+template <typename K, typename T, typename Balance, typename Augment>
+AVLIterator<K,T> AVLMap<K,T,Balance,Augment>::begin() const {
     return AVLIterator<K,T>(this->root);
 }
 
 // the NULL pointer represents the end iterator
-template <typename K, typename T>
-AVLIterator<K,T> AVLMap<K,T>::end() const {
+template <typename K, typename T, typename Balance, typename Augment>
+AVLIterator<K,T> AVLMap<K,T,Balance,Augment>::end() const {
     return AVLIterator<K,T>(NULL);
 }
 
+template <typename K, typename T, typename Balance, typename Augment>
+AVLIterator<K,T> AVLMap<K,T,Balance,Augment>::lowerBound(const K& key) const {
+    // remember the last node we went left from, that is the smallest
+    // key seen so far that is not less than the given key
+    AVLNode<K,T> *node = this->root, *bound = NULL;
+    while (node != NULL) {
+        if (node->key < key) {
+            node = node->right;
+        }
+        else {
+            bound = node;
+            node = node->left;
+        }
+    }
+
+    AVLIterator<K,T> iter(NULL);
+    iter.node = bound;
+    return iter;
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::clear() {
+    if (this->root != NULL) {
+        delete this->root;
+        this->root = NULL;
+    }
+    this->avlSize = 0;
+}
+
 
-template <typename K, typename T>
-void AVLMap<K,T>::pluckNode(AVLNode<K,T>* node) {
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::pluckNode(AVLNode<K,T>* node) {
 
     // first find the only child (if any) of "node"
     AVLNode<K,T> *child;
@@ -426,8 +790,8 @@ void AVLMap<K,T>::pluckNode(AVLNode<K,T>* node) {
     --avlSize;
 }
 
-template <typename K, typename T>
-void AVLMap<K,T>::fixUp(AVLNode<K,T> *node) {
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::fixUp(AVLNode<K,T> *node) {
     // keep climbing up the tree until we are past the root
     while (node != NULL) {
         // first make sure the height of node is correctly computed
@@ -477,8 +841,159 @@ void AVLMap<K,T>::fixUp(AVLNode<K,T> *node) {
     }
 }
 
-template <typename K, typename T>
-AVLNode<K,T>* AVLMap<K,T>::rotateRight(AVLNode<K,T>* node) {
+template <typename K, typename T, typename Balance, typename Augment>
+int AVLMap<K,T,Balance,Augment>::rank(const AVLNode<K,T>* node) {
+    return node == NULL ? -1 : node->height;
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::fixInsertWAVL(AVLNode<K,T>* node) {
+    // node has rank 0, the only possible violation is a parent of the
+    // same rank (a rank difference of 0), which is pushed up the tree
+    AVLNode<K,T> *parent = node->parent;
+    while (parent != NULL && parent->height == node->height) {
+        AVLNode<K,T> *sibling = (parent->left == node) ? parent->right : parent->left;
+
+        if (parent->height - rank(sibling) == 1) {
+            // promote the parent, the violation may move up one level
+            parent->height++;
+            node = parent;
+            parent = node->parent;
+            continue;
+        }
+
+        // the sibling's difference is 2: one or two rotations finish the job
+        if (node == parent->left) {
+            AVLNode<K,T> *inner = node->right;
+            if (node->height - rank(inner) == 2) {
+                rotateRight(parent);
+                parent->height--;
+            }
+            else {
+                rotateLeft(node);
+                rotateRight(parent);
+                inner->height++;
+                node->height--;
+                parent->height--;
+            }
+        }
+        else {
+            AVLNode<K,T> *inner = node->left;
+            if (node->height - rank(inner) == 2) {
+                rotateLeft(parent);
+                parent->height--;
+            }
+            else {
+                rotateRight(node);
+                rotateLeft(parent);
+                inner->height++;
+                node->height--;
+                parent->height--;
+            }
+        }
+        return;
+    }
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::fixRemoveWAVL(AVLNode<K,T>* parent, AVLNode<K,T>* child) {
+    if (parent == NULL) {
+        return;
+    }
+
+    // a leaf must have rank 0, so a parent left with no children at
+    // rank 1 is demoted, which may give it a difference of 3 above
+    if (parent->left == NULL && parent->right == NULL && parent->height == 1) {
+        parent->height = 0;
+        child = parent;
+        parent = parent->parent;
+    }
+
+    // the violation is now a rank difference of 3 between parent and child
+    while (parent != NULL && parent->height - rank(child) == 3) {
+        // the parent has rank >= 2 so it has a second child, even if
+        // child is NULL this picks the right sibling
+        AVLNode<K,T> *sibling = (parent->left == child) ? parent->right : parent->left;
+
+        if (parent->height - sibling->height == 2) {
+            // demote the parent, the violation may move up one level
+            parent->height--;
+            child = parent;
+            parent = parent->parent;
+            continue;
+        }
+
+        if (sibling->height - rank(sibling->left) == 2 &&
+            sibling->height - rank(sibling->right) == 2) {
+            // demote both the parent and the sibling
+            parent->height--;
+            sibling->height--;
+            child = parent;
+            parent = parent->parent;
+            continue;
+        }
+
+        // one or two rotations finish the job
+        if (sibling == parent->right) {
+            AVLNode<K,T> *outer = sibling->right, *inner = sibling->left;
+            if (sibling->height - rank(outer) == 1) {
+                rotateLeft(parent);
+                sibling->height++;
+                parent->height--;
+                if (parent->left == NULL && parent->right == NULL) {
+                    parent->height--;
+                }
+            }
+            else {
+                rotateRight(sibling);
+                rotateLeft(parent);
+                inner->height += 2;
+                sibling->height--;
+                parent->height -= 2;
+            }
+        }
+        else {
+            AVLNode<K,T> *outer = sibling->left, *inner = sibling->right;
+            if (sibling->height - rank(outer) == 1) {
+                rotateRight(parent);
+                sibling->height++;
+                parent->height--;
+                if (parent->left == NULL && parent->right == NULL) {
+                    parent->height--;
+                }
+            }
+            else {
+                rotateLeft(sibling);
+                rotateRight(parent);
+                inner->height += 2;
+                sibling->height--;
+                parent->height -= 2;
+            }
+        }
+        return;
+    }
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::augment(AVLNode<K,T>* node) {
+    if (Augment::ENABLED) {
+        Augment::combine(node->item,
+            node->left ? &node->left->item : NULL,
+            node->right ? &node->right->item : NULL);
+    }
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+void AVLMap<K,T,Balance,Augment>::augmentUp(AVLNode<K,T>* node) {
+    if (Augment::ENABLED) {
+        for (; node != NULL; node = node->parent) {
+            augment(node);
+        }
+    }
+}
+
+template <typename K, typename T, typename Balance, typename Augment>
+AVLNode<K,T>* AVLMap<K,T,Balance,Augment>::rotateRight(AVLNode<K,T>* node) {
     AVLNode<K,T> *lchild = node->left;
     assert(left != NULL);
 
@@ -506,14 +1021,19 @@ AVLNode<K,T>* AVLMap<K,T>::rotateRight(AVLNode<K,T>* node) {
     node->left = lchild->right;
     lchild->right = node;
 
-    node->recalcHeight();
-    lchild->recalcHeight();
+    // WAVL ranks are not heights, the WAVL fix routines adjust them instead
+    if (!Balance::WEAK) {
+        node->recalcHeight();
+        lchild->recalcHeight();
+    }
+    augment(node);
+    augment(lchild);
 
     return lchild;
 }
 
-template <typename K, typename T>
-AVLNode<K,T>* AVLMap<K,T>::rotateLeft(AVLNode<K,T>* node) {
+template <typename K, typename T, typename Balance, typename Augment>
+AVLNode<K,T>* AVLMap<K,T,Balance,Augment>::rotateLeft(AVLNode<K,T>* node) {
     AVLNode<K,T> *rchild = node->right;
     assert(left != NULL);
 
@@ -542,46 +1062,4272 @@ AVLNode<K,T>* AVLMap<K,T>::rotateLeft(AVLNode<K,T>* node) {
     node->right = rchild->left;
     rchild->left = node;
 
-    node->recalcHeight();
-    rchild->recalcHeight();
+    if (!Balance::WEAK) {
+        node->recalcHeight();
+        rchild->recalcHeight();
+    }
+    augment(node);
+    augment(rchild);
 
     return rchild;
 }
 
-void printTree(const AVLMap<string, int>& tree) {
-  for (AVLIterator<string, int> iter = tree.begin(); iter != tree.end(); ++iter) {
-    cout << " - " << iter.key() << ' ' << iter.item() << endl;
-  }
-  cout << endl;
-}
+/*
+  A multiset using an AVLMap that stores one node per distinct key along
+  with the number of copies of that key, instead of a node per copy.
+    add, remove and count take O(log n) time with a single descent
+    of the tree, where n = # distinct keys.
 
-int main() {
-  AVLMap<string, int> tree;
+  Iterating yields each distinct key once, with item() being its count.
+*/
+template <typename K>
+class AVLMultiset {
+public:
+    AVLMultiset();
 
-  while (true) {
-    char cmd;
-    string name;
-    int grade;
+    // add n copies of the key
+    void add(const K& key, unsigned int n = 1);
 
-    cin >> cmd;
-    if (cmd == 'S') {
-        cout << tree.size() << endl;
+    // add one copy of each of the keys in keys[0], ..., keys[numKeys-1]
+    // the keys are sorted first so a run of equal keys costs one descent
+    void addBatch(const K* keys, unsigned int numKeys);
+
+    // remove n copies of the key, which must have at least n copies
+    void remove(const K& key, unsigned int n = 1);
+
+    // returns the number of copies of the key (0 if there are none)
+    unsigned int count(const K& key) const;
+
+    // returns the number of distinct keys
+    unsigned int size() const;
+
+    // returns the total number of copies of all keys
+    unsigned long long total() const;
+
+    AVLIterator<K, unsigned int> begin() const;
+    AVLIterator<K, unsigned int> end() const;
+
+private:
+    AVLMap<K, unsigned int> counts;
+    unsigned long long numCopies;
+};
+
+template <typename K>
+AVLMultiset<K>::AVLMultiset() {
+    numCopies = 0;
+}
+
+template <typename K>
+void AVLMultiset<K>::add(const K& key, unsigned int n) {
+    // adding no copies must not leave a key with a count of 0 behind
+    if (n == 0) {
+        return;
     }
-    else if (cmd == 'U') {
-      cin >> name >> grade;
-      tree[name] = grade;
+
+    // operator[] creates the count at 0 if the key is new
+    counts[key] += n;
+    numCopies += n;
+}
+
+template <typename K>
+void AVLMultiset<K>::addBatch(const K* keys, unsigned int numKeys) {
+    K *sorted = new K[numKeys];
+    for (unsigned int i = 0; i < numKeys; i++) {
+        sorted[i] = keys[i];
     }
-    else if (cmd == 'F') {
-      cin >> name;
-      if (tree.hasKey(name)) {
-        cout << name << " found with grade " << tree[name] << endl;
-      }
-      else {
-        cout << name << " not found" << endl;
-      }
+    sort(sorted, sorted+numKeys);
+
+    // add each run of equal keys all at once
+    unsigned int runStart = 0;
+    for (unsigned int i = 1; i <= numKeys; i++) {
+        if (i == numKeys || sorted[runStart] < sorted[i]) {
+            add(sorted[runStart], i - runStart);
+            runStart = i;
+        }
     }
-    else if (cmd == 'R') {
-      cin >> name;
+
+    delete[] sorted;
+}
+
+template <typename K>
+void AVLMultiset<K>::remove(const K& key, unsigned int n) {
+    unsigned int *copies = counts.lookup(key);
+
+    // make sure there are enough copies to remove
+    assert(copies != NULL && *copies >= n);
+
+    *copies -= n;
+    numCopies -= n;
+
+    // keys with no copies left do not keep a node
+    if (*copies == 0) {
+        counts.remove(key);
+    }
+}
+
+template <typename K>
+unsigned int AVLMultiset<K>::count(const K& key) const {
+    const unsigned int *copies = counts.lookup(key);
+    return copies == NULL ? 0 : *copies;
+}
+
+template <typename K>
+unsigned int AVLMultiset<K>::size() const {
+    return counts.size();
+}
+
+template <typename K>
+unsigned long long AVLMultiset<K>::total() const {
+    return numCopies;
+}
+
+template <typename K>
+AVLIterator<K, unsigned int> AVLMultiset<K>::begin() const {
+    return counts.begin();
+}
+
+template <typename K>
+AVLIterator<K, unsigned int> AVLMultiset<K>::end() const {
+    return counts.end();
+}
+
+// the item of an IntervalMap node: the range is [key, end]
+template <typename K, typename T>
+struct IntervalEntry {
+    K end;
+    K maxEnd; // the largest end of any range in this subtree
+    T item;
+};
+
+// keeps IntervalEntry::maxEnd up to date
+struct MaxEndAugment {
+    static const bool ENABLED = true;
+
+    template <typename E>
+    static void combine(E& entry, const E* left, const E* right) {
+        entry.maxEnd = entry.end;
+        if (left != NULL && entry.maxEnd < left->maxEnd) {
+            entry.maxEnd = left->maxEnd;
+        }
+        if (right != NULL && entry.maxEnd < right->maxEnd) {
+            entry.maxEnd = right->maxEnd;
+        }
+    }
+};
+
+/*
+  An interval map: holds ranges [lo, hi], each with an item, keyed by lo
+  (so at most one range starts at any lo), and finds the ranges that
+  overlap a point or another range.
+
+  Built on an AVLMap whose nodes also keep the largest hi in their subtree.
+  A query skips every subtree whose largest hi is before the query and
+  every subtree starting after it, so it takes O(log n) time plus O(log n)
+  per range reported in the worst case, and close to O(log n + k) when the
+  k ranges reported are near each other in lo order.
+    update, remove and hasKey take O(log n) time.
+
+  Assumes:
+    - K is totally ordered and can be compared via <, !=, and ==
+    - K and T have default constructors
+*/
+template <typename K, typename T, typename Balance>
+class IntervalMap {
+public:
+    // add the range [lo, hi] with the item, replacing the range that
+    // starts at lo if there is one, needs lo <= hi
+    void update(const K& lo, const K& hi, const T& item);
+
+    // remove the range starting at lo, which must exist
+    void remove(const K& lo);
+
+    // returns true iff a range starts at lo
+    bool hasKey(const K& lo) const;
+
+    // returns the number of ranges
+    unsigned int size() const;
+
+    // calls visit(lo, hi, item) for each range containing the point,
+    // ordered by lo
+    template <typename Visit>
+    void overlapping(const K& point, Visit visit) const;
+
+    // calls visit(lo, hi, item) for each range sharing at least one point
+    // with [lo, hi], ordered by lo
+    template <typename Visit>
+    void overlapping(const K& lo, const K& hi, Visit visit) const;
+
+private:
+    typedef IntervalEntry<K,T> Entry;
+
+    AVLMap<K, Entry, Balance, MaxEndAugment> ranges;
+
+    // the in-order walk behind overlapping, over the subtree at node
+    template <typename Visit>
+    static void visitOverlapping(const AVLNode<K,Entry>* node,
+        const K& lo, const K& hi, Visit& visit);
+};
+
+template <typename K, typename T, typename Balance>
+void IntervalMap<K,T,Balance>::update(const K& lo, const K& hi, const T& item) {
+    assert(!(hi < lo));
+
+    // maxEnd is filled in by the augmentation
+    Entry entry;
+    entry.end = entry.maxEnd = hi;
+    entry.item = item;
+    ranges.update(lo, entry);
+}
+
+template <typename K, typename T, typename Balance>
+void IntervalMap<K,T,Balance>::remove(const K& lo) {
+    ranges.remove(lo);
+}
+
+template <typename K, typename T, typename Balance>
+bool IntervalMap<K,T,Balance>::hasKey(const K& lo) const {
+    return ranges.hasKey(lo);
+}
+
+template <typename K, typename T, typename Balance>
+unsigned int IntervalMap<K,T,Balance>::size() const {
+    return ranges.size();
+}
+
+template <typename K, typename T, typename Balance>
+template <typename Visit>
+void IntervalMap<K,T,Balance>::overlapping(const K& point, Visit visit) const {
+    visitOverlapping(ranges.root, point, point, visit);
+}
+
+template <typename K, typename T, typename Balance>
+template <typename Visit>
+void IntervalMap<K,T,Balance>::overlapping(const K& lo, const K& hi, Visit visit) const {
+    assert(!(hi < lo));
+    visitOverlapping(ranges.root, lo, hi, visit);
+}
+
+template <typename K, typename T, typename Balance>
+template <typename Visit>
+void IntervalMap<K,T,Balance>::visitOverlapping(const AVLNode<K,Entry>* node,
+    const K& lo, const K& hi, Visit& visit) {
+    // nothing in this subtree reaches lo
+    if (node == NULL || node->item.maxEnd < lo) {
+        return;
+    }
+
+    visitOverlapping(node->left, lo, hi, visit);
+
+    // this range and everything to its right start after hi
+    if (hi < node->key) {
+        return;
+    }
+
+    if (!(node->item.end < lo)) {
+        visit(node->key, node->item.end, node->item.item);
+    }
+    visitOverlapping(node->right, lo, hi, visit);
+}
+
+/*
+  An AVLMap with a small direct-mapped cache in front of it, for access
+  patterns where a few keys get most of the lookups.
+
+  Each cache slot remembers the node of one key (picked by the key's hash)
+  and how often it was hit, so a hot key is found with one hash and one
+  node access instead of a descent through O(log n) nodes. A key that
+  misses only takes over a slot once the key in it has lost its hits,
+  so a stream of cold keys does not push out the hot ones. Rotations do
+  not move keys between nodes, only remove invalidates slots.
+
+  relayout() copies the nodes into fresh allocations in access order:
+  the paths to the cached keys first, hottest first, then the rest of the
+  tree in preorder. Each node is still its own allocation, but allocated
+  back to back like this most allocators hand out neighbouring memory, so
+  the hot paths tend to end up close together instead of wherever the
+  nodes were first allocated. It frees the old nodes, so every reference
+  to an item and every iterator is invalidated. Lookups never relayout;
+  with relayoutEvery != 0, update and remove also relayout once that many
+  lookups have been made, and at least 16 per entry so the copying stays
+  a small part of the work.
+
+  Assumes:
+    - K is totally ordered and can be compared via <, !=, and ==
+    - std::hash<K> exists
+    - T has a default constructor (i.e. T())
+*/
+template <typename K, typename T>
+class CachedAVLMap {
+public:
+    // cacheSlots is rounded up to a power of 2, relayoutEvery = 0 means
+    // only relayout when relayout() is called
+    CachedAVLMap(unsigned int cacheSlots = 1024, unsigned int relayoutEvery = 0);
+
+    // may relayout first (see above), invalidating references and iterators
+    void update(const K& key, const T& item);
+
+    // remove the key and its associated item, may relayout first like update
+    void remove(const K& key);
+
+    bool hasKey(const K& key) const;
+
+    T& operator[](const K& key);
+
+    const T& at(const K& key) const;
+
+    unsigned int size() const;
+
+    AVLIterator<K,T> begin() const;
+    AVLIterator<K,T> end() const;
+
+    // copy the nodes into fresh memory, hot paths first, invalidates
+    // every reference to an item and every iterator
+    void relayout();
+
+private:
+    struct Slot {
+        AVLNode<K,T> *node;
+        unsigned int hits;
+    };
+
+    AVLMap<K,T> map;
+    mutable vector<Slot> cache;
+    unsigned int slotShift;     // slot = (mixed hash) >> slotShift
+    unsigned int relayoutEvery;
+    mutable unsigned int lookupsSinceRelayout;
+
+    Slot& slotOf(const K& key) const;
+
+    // the node holding the key, or NULL, going through the cache
+    AVLNode<K,T>* cachedNode(const K& key) const;
+
+    // relayout if relayoutEvery asks for it
+    void relayoutIfDue();
+};
+
+template <typename K, typename T>
+CachedAVLMap<K,T>::CachedAVLMap(unsigned int cacheSlots, unsigned int relayoutEvery) {
+    unsigned int bits = 0;
+    while ((1u << bits) < cacheSlots) {
+        bits++;
+    }
+    cache.assign(1u << bits, Slot{NULL, 0});
+    slotShift = 64 - bits;
+    this->relayoutEvery = relayoutEvery;
+    lookupsSinceRelayout = 0;
+}
+
+template <typename K, typename T>
+typename CachedAVLMap<K,T>::Slot& CachedAVLMap<K,T>::slotOf(const K& key) const {
+    // Fibonacci hashing: the top bits of the product mix all bits of the hash
+    unsigned long long h = hash<K>()(key) * 0x9E3779B97F4A7C15ull;
+    return cache[slotShift == 64 ? 0 : h >> slotShift];
+}
+
+template <typename K, typename T>
+AVLNode<K,T>* CachedAVLMap<K,T>::cachedNode(const K& key) const {
+    lookupsSinceRelayout++;
+
+    Slot& slot = slotOf(key);
+    if (slot.node != NULL && !(slot.node->key != key)) {
+        slot.hits++;
+        return slot.node;
+    }
+
+    AVLNode<K,T> *node = map.findNode(key);
+    if (node == NULL || node->key != key) {
+        return NULL;
+    }
+
+    // the key in the slot keeps it while it has hits left
+    if (slot.hits > 0) {
+        slot.hits--;
+    }
+    else {
+        slot.node = node;
+        slot.hits = 1;
+    }
+    return node;
+}
+
+template <typename K, typename T>
+void CachedAVLMap<K,T>::relayoutIfDue() {
+    if (relayoutEvery != 0 && lookupsSinceRelayout >= relayoutEvery &&
+        lookupsSinceRelayout/16 >= map.size()) {
+        relayout();
+    }
+}
+
+template <typename K, typename T>
+void CachedAVLMap<K,T>::update(const K& key, const T& item) {
+    relayoutIfDue();
+    AVLNode<K,T> *node = cachedNode(key);
+    if (node != NULL) {
+        node->item = item;
+    }
+    else {
+        map.update(key, item);
+    }
+}
+
+template <typename K, typename T>
+void CachedAVLMap<K,T>::remove(const K& key) {
+    relayoutIfDue();
+    AVLNode<K,T> *node = map.findNode(key);
+    assert(node != NULL && !(node->key != key));
+
+    // AVLMap::remove moves the key of pluck, the largest key in the left
+    // subtree, into node and frees pluck, so neither may stay cached
+    AVLNode<K,T> *pluck = node;
+    for (AVLNode<K,T> *tmp = node->left; tmp != NULL; tmp = tmp->right) {
+        pluck = tmp;
+    }
+    Slot& keySlot = slotOf(key);
+    if (keySlot.node == node || keySlot.node == pluck) {
+        keySlot = Slot{NULL, 0};
+    }
+    Slot& pluckSlot = slotOf(pluck->key);
+    if (pluckSlot.node == node || pluckSlot.node == pluck) {
+        pluckSlot = Slot{NULL, 0};
+    }
+
+    map.remove(key);
+}
+
+template <typename K, typename T>
+bool CachedAVLMap<K,T>::hasKey(const K& key) const {
+    return cachedNode(key) != NULL;
+}
+
+template <typename K, typename T>
+T& CachedAVLMap<K,T>::operator[](const K& key) {
+    AVLNode<K,T> *node = cachedNode(key);
+    if (node != NULL) {
+        return node->item;
+    }
+    return map[key];
+}
+
+template <typename K, typename T>
+const T& CachedAVLMap<K,T>::at(const K& key) const {
+    AVLNode<K,T> *node = cachedNode(key);
+    assert(node != NULL);
+    return node->item;
+}
+
+template <typename K, typename T>
+unsigned int CachedAVLMap<K,T>::size() const {
+    return map.size();
+}
+
+template <typename K, typename T>
+AVLIterator<K,T> CachedAVLMap<K,T>::begin() const {
+    return map.begin();
+}
+
+template <typename K, typename T>
+AVLIterator<K,T> CachedAVLMap<K,T>::end() const {
+    return map.end();
+}
+
+template <typename K, typename T>
+void CachedAVLMap<K,T>::relayout() {
+    lookupsSinceRelayout = 0;
+    if (map.root == NULL) {
+        return;
+    }
+
+    // the order to copy the nodes in: first the path from the root to each
+    // cached node, hottest first, then the whole tree in preorder so each
+    // subtree is allocated in one run
+    vector<Slot*> hot;
+    for (unsigned int i = 0; i < cache.size(); i++) {
+        if (cache[i].node != NULL) {
+            hot.push_back(&cache[i]);
+        }
+    }
+    sort(hot.begin(), hot.end(),
+        [](const Slot* a, const Slot* b) { return a->hits > b->hits; });
+
+    vector<AVLNode<K,T>*> order, path;
+    for (unsigned int i = 0; i < hot.size(); i++) {
+        path.clear();
+        for (AVLNode<K,T> *node = hot[i]->node; node != NULL; node = node->parent) {
+            path.push_back(node);
+        }
+        order.insert(order.end(), path.rbegin(), path.rend());
+    }
+    vector<AVLNode<K,T>*> stack(1, map.root);
+    while (!stack.empty()) {
+        AVLNode<K,T> *node = stack.back();
+        stack.pop_back();
+        order.push_back(node);
+        if (node->right) {
+            stack.push_back(node->right);
+        }
+        if (node->left) {
+            stack.push_back(node->left);
+        }
+    }
+
+    // copy each node the first time it comes up in the order, the parent
+    // pointer of the original is free to point at its copy once the order
+    // is known, and a negative height marks it as copied
+    for (unsigned int i = 0; i < order.size(); i++) {
+        AVLNode<K,T> *node = order[i];
+        if (node->height >= 0) {
+            node->parent = new AVLNode<K,T>(node->key, node->item,
+                NULL, NULL, NULL, node->height);
+            node->height = -1;
+        }
+    }
+
+    // link up the copies and free the originals, stack holds every
+    // original once, in preorder, as the tail of order
+    AVLNode<K,T> **originals = &order[order.size() - map.size()];
+    for (unsigned int i = 0; i < map.size(); i++) {
+        AVLNode<K,T> *node = originals[i], *copy = node->parent;
+        if (node->left) {
+            copy->left = node->left->parent;
+            copy->left->parent = copy;
+        }
+        if (node->right) {
+            copy->right = node->right->parent;
+            copy->right->parent = copy;
+        }
+    }
+    map.root = map.root->parent;
+    for (unsigned int i = 0; i < cache.size(); i++) {
+        // the slots follow their nodes, and their hits are halved so the
+        // cache adapts if the hot keys change
+        if (cache[i].node != NULL) {
+            cache[i].node = cache[i].node->parent;
+            cache[i].hits /= 2;
+        }
+    }
+    for (unsigned int i = 0; i < map.size(); i++) {
+        originals[i]->left = originals[i]->right = NULL;
+        delete originals[i];
+    }
+}
+
+/*
+  A string interner, maps each distinct string to a small integer id.
+
+  The characters of every interned string are copied into an arena of
+  large blocks which are never moved or freed until the interner is
+  destroyed, so the string_view returned for an id stays valid. The hash
+  of each string is computed once and stored with it, so lookups in the
+  interner's own open-addressing index only compare characters when the
+  full hashes match.
+
+  Keying an AVLMap or HashTable on the InternedString handles instead of
+  on the strings means every comparison is a single integer comparison.
+  The catch is that the ordering is by id (i.e. the order in which the
+  strings were first interned), not alphabetical.
+*/
+
+// handle to an interned string, compares and hashes by id only, so handles
+// from different interners must not be mixed
+struct InternedString {
+  unsigned int id;
+
+  // ids are consecutive, so they spread evenly over hash table buckets
+  unsigned int hash() const {
+    return id;
+  }
+
+  bool operator==(const InternedString& rhs) const {
+    return id == rhs.id;
+  }
+
+  bool operator!=(const InternedString& rhs) const {
+    return id != rhs.id;
+  }
+
+  bool operator<(const InternedString& rhs) const {
+    return id < rhs.id;
+  }
+};
+
+class StringInterner {
+public:
+  // returned by find() for strings that were never interned
+  static constexpr unsigned int NOT_FOUND = 0xFFFFFFFFu;
+
+  StringInterner();
+  ~StringInterner();
+
+  // the arena hands out pointers into itself, so copying is not allowed
+  StringInterner(const StringInterner& copy) = delete;
+  StringInterner& operator=(const StringInterner& rhs) = delete;
+
+  // returns the handle of the string, interning it first if it is new
+  InternedString intern(string_view str);
+
+  // returns the id of the string, or NOT_FOUND if it was never interned
+  unsigned int find(string_view str) const;
+
+  // the characters of an interned string, valid as long as the interner is
+  string_view str(InternedString handle) const;
+
+  // returns the number of distinct strings interned
+  unsigned int size() const;
+
+private:
+  // an interned string: where its characters live and its full hash
+  struct Entry {
+    const char* chars;
+    unsigned int length;
+    unsigned int hash;
+  };
+
+  // size of a freshly allocated arena block, longer strings get their own
+  static constexpr unsigned int BLOCK_SIZE = 64*1024;
+
+  Entry *entries;          // entries[id] describes the string with that id
+  unsigned int numEntries; // # of interned strings
+  unsigned int entriesCap; // size of the entries array in the heap
+
+  // open-addressing index, slots[i] is 1 + the id stored there or 0
+  // if the slot is empty; the # of slots is a power of two
+  unsigned int *slots;
+  unsigned int numSlots;
+
+  // arena blocks, all but the last are full
+  char **blocks;
+  unsigned int numBlocks, blocksCap;
+  unsigned int blockUsed; // bytes used in the last block
+
+  // FNV-1a hash of the characters
+  static unsigned int hashChars(string_view str);
+
+  // returns the slot holding the string, or the empty slot where it belongs
+  unsigned int findSlot(string_view str, unsigned int hash) const;
+
+  // copy the characters into the arena, returns where they were put
+  const char* copyToArena(string_view str);
+
+  // double the index and re-place every id in it
+  void growIndex();
+};
+
+StringInterner::StringInterner() {
+  entriesCap = 16;
+  entries = new Entry[entriesCap];
+  numEntries = 0;
+
+  numSlots = 32;
+  slots = new unsigned int[numSlots];
+  for (unsigned int i = 0; i < numSlots; i++) {
+    slots[i] = 0;
+  }
+
+  blocksCap = 4;
+  blocks = new char*[blocksCap];
+  numBlocks = 0;
+  blockUsed = BLOCK_SIZE;
+}
+
+StringInterner::~StringInterner() {
+  for (unsigned int i = 0; i < numBlocks; i++) {
+    delete[] blocks[i];
+  }
+  delete[] blocks;
+  delete[] slots;
+  delete[] entries;
+}
+
+unsigned int StringInterner::hashChars(string_view str) {
+  unsigned int hash = 2166136261u;
+  for (size_t i = 0; i < str.size(); i++) {
+    hash = (hash ^ (unsigned char) str[i]) * 16777619u;
+  }
+  return hash;
+}
+
+unsigned int StringInterner::findSlot(string_view str, unsigned int hash) const {
+  // linear probing, the stored hash rules out almost every mismatch
+  // before any characters are compared
+  unsigned int i = hash & (numSlots-1);
+  while (slots[i] != 0) {
+    const Entry& entry = entries[slots[i]-1];
+    if (entry.hash == hash && entry.length == str.size()
+        && memcmp(entry.chars, str.data(), str.size()) == 0) {
+      break;
+    }
+    i = (i+1) & (numSlots-1);
+  }
+  return i;
+}
+
+const char* StringInterner::copyToArena(string_view str) {
+  if (numBlocks == 0 || str.size() > BLOCK_SIZE - blockUsed) {
+    // there is no block yet or the last one is too full, start a new one
+    if (numBlocks == blocksCap) {
+      char **newBlocks = new char*[blocksCap*2];
+      for (unsigned int i = 0; i < numBlocks; i++) {
+        newBlocks[i] = blocks[i];
+      }
+      delete[] blocks;
+      blocks = newBlocks;
+      blocksCap *= 2;
+    }
+
+    unsigned int size = max((unsigned int) str.size(), BLOCK_SIZE);
+    blocks[numBlocks++] = new char[size];
+    blockUsed = 0;
+
+    if (size > BLOCK_SIZE) {
+      // an oversized string gets a block to itself, so mark it as full
+      memcpy(blocks[numBlocks-1], str.data(), str.size());
+      blockUsed = BLOCK_SIZE;
+      return blocks[numBlocks-1];
+    }
+  }
+
+  char *chars = blocks[numBlocks-1] + blockUsed;
+  memcpy(chars, str.data(), str.size());
+  blockUsed += str.size();
+  return chars;
+}
+
+void StringInterner::growIndex() {
+  delete[] slots;
+  numSlots *= 2;
+  slots = new unsigned int[numSlots];
+  for (unsigned int i = 0; i < numSlots; i++) {
+    slots[i] = 0;
+  }
+
+  // the stored hashes mean no string has to be rehashed
+  for (unsigned int id = 0; id < numEntries; id++) {
+    unsigned int i = entries[id].hash & (numSlots-1);
+    while (slots[i] != 0) {
+      i = (i+1) & (numSlots-1);
+    }
+    slots[i] = id+1;
+  }
+}
+
+InternedString StringInterner::intern(string_view str) {
+  unsigned int hash = hashChars(str);
+  unsigned int slot = findSlot(str, hash);
+
+  if (slots[slot] == 0) {
+    // a new string, give it the next id
+    if (numEntries == entriesCap) {
+      Entry *newEntries = new Entry[entriesCap*2];
+      for (unsigned int i = 0; i < numEntries; i++) {
+        newEntries[i] = entries[i];
+      }
+      delete[] entries;
+      entries = newEntries;
+      entriesCap *= 2;
+    }
+
+    Entry entry = {copyToArena(str), (unsigned int) str.size(), hash};
+    entries[numEntries] = entry;
+    slots[slot] = ++numEntries;
+
+    // keep the index at most half full so probe sequences stay short
+    if (numEntries*2 > numSlots) {
+      growIndex();
+    }
+    return InternedString{numEntries-1};
+  }
+
+  return InternedString{slots[slot]-1};
+}
+
+unsigned int StringInterner::find(string_view str) const {
+  unsigned int slot = findSlot(str, hashChars(str));
+  return slots[slot] == 0 ? NOT_FOUND : slots[slot]-1;
+}
+
+string_view StringInterner::str(InternedString handle) const {
+  assert(handle.id < numEntries);
+  return string_view(entries[handle.id].chars, entries[handle.id].length);
+}
+
+unsigned int StringInterner::size() const {
+  return numEntries;
+}
+
+/*
+  A log-structured merge (LSM) tree storing string keys with int items
+  on disk, for maps too large to keep in memory.
+
+  Updates and removals go into an AVLMap (the memtable). When the memtable
+  fills up it is written out in key order, as one sequential write, to an
+  immutable sorted run file. Runs are organized in levels:
+    - level 0 holds freshly flushed runs, whose key ranges may overlap
+    - every deeper level is split by key into runs of about a memtable's
+      size whose ranges do not overlap, each level allowed to be 10 times
+      larger than the one above it
+  A background thread merges level 0 into level 1 once it has 4 runs, and
+  pushes one run at a time of any level that grows too large into the
+  next one (leveled compaction). A compaction only rewrites the runs of
+  the next level whose key ranges overlap what is pushed down, so its
+  cost and the disk space it needs are bounded by a few runs rather than
+  the size of a level. If flushes outpace the compactor, flush() waits
+  once level 0 has 8 runs, so reads never have to check more than that.
+
+  A run file is a sequence of ~4KB data blocks followed by a block index
+  (first key of each block), a Bloom filter over all keys, and a fixed-size
+  footer. The index and Bloom filter are kept in memory, so a point read
+  touches at most one data block per run, and usually only runs that have
+  the key; below level 0 only the one run per level whose range covers
+  the key is consulted. Removals are recorded as tombstones, which are dropped once
+  they are compacted into the deepest level.
+
+  The set of runs is recorded in a MANIFEST file which is replaced
+  atomically after every flush and compaction, so reopening the directory
+  picks up where it left off. Entries still in the memtable are lost on a
+  crash; they are flushed by the destructor.
+
+  update, remove, get, and scan must all be called from the same thread,
+  only compaction runs in the background.
+*/
+
+// an entry of the memtable: the item, or a tombstone if the key was removed
+struct LSMValue {
+  int item;
+  bool deleted;
+};
+
+// a key with its entry, as stored in a run
+struct LSMRecord {
+  string key;
+  int item;
+  bool deleted;
+};
+
+// helpers for the little-endian binary encoding of run files
+inline void putU32(string& out, unsigned int v) {
+  for (int i = 0; i < 4; i++) {
+    out.push_back((char) (v >> (8*i)));
+  }
+}
+
+inline void putU64(string& out, unsigned long long v) {
+  for (int i = 0; i < 8; i++) {
+    out.push_back((char) (v >> (8*i)));
+  }
+}
+
+inline unsigned int getU32(const char*& in) {
+  unsigned int v = 0;
+  for (int i = 0; i < 4; i++) {
+    v |= (unsigned int) (unsigned char) in[i] << (8*i);
+  }
+  in += 4;
+  return v;
+}
+
+inline unsigned long long getU64(const char*& in) {
+  unsigned long long v = 0;
+  for (int i = 0; i < 8; i++) {
+    v |= (unsigned long long) (unsigned char) in[i] << (8*i);
+  }
+  in += 8;
+  return v;
+}
+
+// 64-bit FNV-1a hash of a key, split in two halves for the Bloom filter
+inline unsigned long long hashKey(const string& key) {
+  unsigned long long hash = 14695981039346656037ull;
+  for (size_t i = 0; i < key.size(); i++) {
+    hash = (hash ^ (unsigned char) key[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+/*
+  An immutable sorted run file, with its block index and Bloom filter
+  loaded in memory. Shared between the store and any reads or compactions
+  in progress; the file is deleted when the last user lets go of a run
+  that was compacted away.
+*/
+class SortedRun {
+public:
+  // opens an existing run file
+  SortedRun(const string& path);
+  ~SortedRun();
+
+  SortedRun(const SortedRun& copy) = delete;
+  SortedRun& operator=(const SortedRun& rhs) = delete;
+
+  // looks up the key, returns false if this run has no entry for it
+  bool get(const string& key, LSMValue& value) const;
+
+  // reads and decodes data block i
+  void readBlock(unsigned int i, vector<LSMRecord>& records) const;
+
+  // the block that would hold the key, i.e. the last block whose first
+  // key is not larger than it (0 if the key is before every block)
+  unsigned int findBlock(const string& key) const;
+
+  unsigned int numBlocks() const;
+  unsigned long long bytes() const;
+  const string& path() const;
+
+  // the smallest and largest key in the run, which must not be empty
+  const string& firstKey() const;
+  const string& lastKey() const;
+
+  // delete the file once the run is no longer in use
+  void markObsolete();
+
+private:
+  struct BlockInfo {
+    string firstKey;
+    unsigned long long offset;
+    unsigned int length;
+  };
+
+  string filePath;
+  int fd;
+  unsigned long long fileBytes;
+  vector<BlockInfo> index;
+  string largestKey;
+  vector<unsigned long long> bloom;
+  unsigned int numHashes;
+  bool obsolete;
+
+  bool mayContain(const string& key) const;
+};
+
+/*
+  Writes records, which must be given in increasing key order, to a new
+  run file.
+*/
+class RunWriter {
+public:
+  // expectedRecords sizes the Bloom filter (10 bits per record)
+  RunWriter(const string& path, unsigned long long expectedRecords);
+
+  void add(const string& key, int item, bool deleted);
+
+  // writes the index, Bloom filter and footer, syncs the file, and
+  // returns the number of records written
+  unsigned long long finish();
+
+  // # of bytes of records added so far
+  unsigned long long bytes() const;
+
+private:
+  static const unsigned int BLOCK_BYTES = 4096;
+
+  int fd;
+  unsigned long long offset; // bytes written so far
+  string block;              // the data block being filled
+  string blockFirstKey;
+  string indexBytes;         // the encoded block index
+  unsigned int numBlocks;
+  unsigned long long numRecords;
+  vector<unsigned long long> bloom;
+  unsigned int numHashes;
+
+  void writeAll(const string& bytes);
+  void finishBlock();
+};
+
+// number of bytes in the footer at the end of a run file
+const unsigned int RUN_FOOTER_BYTES = 32;
+const unsigned int RUN_MAGIC = 0x4C534D31; // "LSM1"
+
+RunWriter::RunWriter(const string& path, unsigned long long expectedRecords) {
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+
+  offset = 0;
+  numBlocks = 0;
+  numRecords = 0;
+
+  // 10 bits per key with 7 hash functions gives about 1% false positives
+  unsigned long long bits = max(64ull, expectedRecords*10);
+  bloom.assign((bits+63)/64, 0);
+  numHashes = 7;
+}
+
+void RunWriter::writeAll(const string& bytes) {
+  size_t done = 0;
+  while (done < bytes.size()) {
+    ssize_t n = write(fd, bytes.data() + done, bytes.size() - done);
+    assert(n > 0);
+    done += n;
+  }
+  offset += bytes.size();
+}
+
+void RunWriter::finishBlock() {
+  if (block.empty()) {
+    return;
+  }
+
+  putU32(indexBytes, blockFirstKey.size());
+  indexBytes += blockFirstKey;
+  putU64(indexBytes, offset);
+  putU32(indexBytes, block.size());
+  ++numBlocks;
+
+  writeAll(block);
+  block.clear();
+}
+
+void RunWriter::add(const string& key, int item, bool deleted) {
+  if (block.empty()) {
+    blockFirstKey = key;
+  }
+
+  // record: key length, key, item, tombstone flag
+  putU32(block, key.size());
+  block += key;
+  putU32(block, (unsigned int) item);
+  block.push_back(deleted ? 1 : 0);
+  ++numRecords;
+
+  // set the key's bits, positions come from double hashing
+  unsigned long long h = hashKey(key);
+  unsigned long long numBits = bloom.size()*64;
+  for (unsigned int i = 0; i < numHashes; i++) {
+    unsigned long long bit = ((h & 0xFFFFFFFFull) + i*(h >> 32)) % numBits;
+    bloom[bit/64] |= 1ull << (bit%64);
+  }
+
+  if (block.size() >= BLOCK_BYTES) {
+    finishBlock();
+  }
+}
+
+unsigned long long RunWriter::finish() {
+  finishBlock();
+
+  unsigned long long indexOffset = offset;
+  writeAll(indexBytes);
+
+  unsigned long long bloomOffset = offset;
+  string bloomBytes;
+  for (size_t i = 0; i < bloom.size(); i++) {
+    putU64(bloomBytes, bloom[i]);
+  }
+  writeAll(bloomBytes);
+
+  string footer;
+  putU64(footer, indexOffset);
+  putU64(footer, bloomOffset);
+  putU32(footer, numBlocks);
+  putU32(footer, bloom.size());
+  putU32(footer, numHashes);
+  putU32(footer, RUN_MAGIC);
+  writeAll(footer);
+
+  // the run must be on disk before the manifest can refer to it
+  int synced = fsync(fd);
+  assert(synced == 0);
+  (void) synced;
+  close(fd);
+
+  return numRecords;
+}
+
+unsigned long long RunWriter::bytes() const {
+  return offset + block.size();
+}
+
+SortedRun::SortedRun(const string& path) {
+  filePath = path;
+  obsolete = false;
+  fd = open(path.c_str(), O_RDONLY);
+  assert(fd >= 0);
+
+  struct stat info;
+  fstat(fd, &info);
+  fileBytes = info.st_size;
+  assert(fileBytes >= RUN_FOOTER_BYTES);
+
+  // the footer says where everything else is
+  char footer[RUN_FOOTER_BYTES];
+  ssize_t n = pread(fd, footer, RUN_FOOTER_BYTES, fileBytes - RUN_FOOTER_BYTES);
+  assert(n == RUN_FOOTER_BYTES);
+  const char *in = footer;
+  unsigned long long indexOffset = getU64(in);
+  unsigned long long bloomOffset = getU64(in);
+  unsigned int blocks = getU32(in);
+  unsigned int bloomWords = getU32(in);
+  numHashes = getU32(in);
+  unsigned int magic = getU32(in);
+  assert(magic == RUN_MAGIC);
+  (void) magic;
+
+  // the index and Bloom filter sit back to back, read them in one go
+  string meta(fileBytes - RUN_FOOTER_BYTES - indexOffset, '\0');
+  n = pread(fd, &meta[0], meta.size(), indexOffset);
+  assert(n == (ssize_t) meta.size());
+  (void) n;
+
+  in = meta.data();
+  index.resize(blocks);
+  for (unsigned int i = 0; i < blocks; i++) {
+    unsigned int keyLength = getU32(in);
+    index[i].firstKey.assign(in, keyLength);
+    in += keyLength;
+    index[i].offset = getU64(in);
+    index[i].length = getU32(in);
+  }
+
+  in = meta.data() + (bloomOffset - indexOffset);
+  bloom.resize(bloomWords);
+  for (unsigned int i = 0; i < bloomWords; i++) {
+    bloom[i] = getU64(in);
+  }
+
+  // the index only has first keys, the last key is in the last block
+  if (blocks > 0) {
+    vector<LSMRecord> records;
+    readBlock(blocks-1, records);
+    largestKey = records.back().key;
+  }
+}
+
+SortedRun::~SortedRun() {
+  close(fd);
+  if (obsolete) {
+    unlink(filePath.c_str());
+  }
+}
+
+bool SortedRun::mayContain(const string& key) const {
+  unsigned long long h = hashKey(key);
+  unsigned long long numBits = bloom.size()*64;
+  for (unsigned int i = 0; i < numHashes; i++) {
+    unsigned long long bit = ((h & 0xFFFFFFFFull) + i*(h >> 32)) % numBits;
+    if ((bloom[bit/64] & (1ull << (bit%64))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+unsigned int SortedRun::findBlock(const string& key) const {
+  // binary search for the last block starting at or before the key
+  unsigned int lo = 0, hi = index.size();
+  while (hi - lo > 1) {
+    unsigned int mid = (lo + hi)/2;
+    if (key < index[mid].firstKey) {
+      hi = mid;
+    }
+    else {
+      lo = mid;
+    }
+  }
+  return lo;
+}
+
+void SortedRun::readBlock(unsigned int i, vector<LSMRecord>& records) const {
+  string bytes(index[i].length, '\0');
+  ssize_t n = pread(fd, &bytes[0], bytes.size(), index[i].offset);
+  assert(n == (ssize_t) bytes.size());
+  (void) n;
+
+  records.clear();
+  const char *in = bytes.data(), *stop = bytes.data() + bytes.size();
+  while (in < stop) {
+    LSMRecord record;
+    unsigned int keyLength = getU32(in);
+    record.key.assign(in, keyLength);
+    in += keyLength;
+    record.item = (int) getU32(in);
+    record.deleted = *in++ != 0;
+    records.push_back(record);
+  }
+}
+
+bool SortedRun::get(const string& key, LSMValue& value) const {
+  if (index.empty() || key < index[0].firstKey || largestKey < key || !mayContain(key)) {
+    return false;
+  }
+
+  vector<LSMRecord> records;
+  readBlock(findBlock(key), records);
+
+  // the records of a block are sorted, so binary search them too
+  unsigned int lo = 0, hi = records.size();
+  while (lo < hi) {
+    unsigned int mid = (lo + hi)/2;
+    if (records[mid].key < key) {
+      lo = mid+1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  if (lo == records.size() || records[lo].key != key) {
+    return false;
+  }
+
+  value.item = records[lo].item;
+  value.deleted = records[lo].deleted;
+  return true;
+}
+
+unsigned int SortedRun::numBlocks() const {
+  return index.size();
+}
+
+unsigned long long SortedRun::bytes() const {
+  return fileBytes;
+}
+
+const string& SortedRun::path() const {
+  return filePath;
+}
+
+const string& SortedRun::firstKey() const {
+  assert(!index.empty());
+  return index[0].firstKey;
+}
+
+const string& SortedRun::lastKey() const {
+  assert(!index.empty());
+  return largestKey;
+}
+
+void SortedRun::markObsolete() {
+  obsolete = true;
+}
+
+/*
+  Walks the records of one source in key order, starting from a given key.
+  A source is either a run (read a block at a time) or a sorted vector of
+  records already in memory (used for the memtable).
+*/
+class LSMCursor {
+public:
+  // walk the records of the run with key >= from
+  LSMCursor(shared_ptr<SortedRun> run, const string& from);
+
+  // walk the records in memory, which must be sorted by key
+  LSMCursor(const vector<LSMRecord>& records);
+
+  bool valid() const;
+  const LSMRecord& record() const;
+  void next();
+
+private:
+  shared_ptr<SortedRun> run; // NULL for an in-memory source
+  unsigned int blockIndex;
+  vector<LSMRecord> block;
+  unsigned int pos;
+};
+
+LSMCursor::LSMCursor(shared_ptr<SortedRun> run, const string& from) : run(run) {
+  pos = 0;
+  blockIndex = 0;
+  if (run->numBlocks() == 0) {
+    return;
+  }
+
+  blockIndex = run->findBlock(from);
+  run->readBlock(blockIndex, block);
+  while (valid() && record().key < from) {
+    next();
+  }
+}
+
+LSMCursor::LSMCursor(const vector<LSMRecord>& records) : block(records) {
+  pos = 0;
+  blockIndex = 0;
+}
+
+bool LSMCursor::valid() const {
+  return pos < block.size();
+}
+
+const LSMRecord& LSMCursor::record() const {
+  return block[pos];
+}
+
+void LSMCursor::next() {
+  ++pos;
+
+  // move on to the next block of the run when this one is used up
+  if (pos == block.size() && run && blockIndex+1 < run->numBlocks()) {
+    ++blockIndex;
+    run->readBlock(blockIndex, block);
+    pos = 0;
+  }
+}
+
+/*
+  Merges cursors, ordered from newest source to oldest, calling
+  emit(record) for each distinct key in increasing order with the newest
+  record for that key (tombstones included). Stops before the first key
+  that is not less than "to", unless "to" is empty.
+*/
+template <typename Emit>
+void mergeCursors(vector<LSMCursor>& cursors, const string& to, Emit emit) {
+  while (true) {
+    // the smallest current key; on ties the newest source wins
+    int best = -1;
+    for (unsigned int i = 0; i < cursors.size(); i++) {
+      if (cursors[i].valid() &&
+          (best < 0 || cursors[i].record().key < cursors[best].record().key)) {
+        best = i;
+      }
+    }
+    if (best < 0 || (!to.empty() && !(cursors[best].record().key < to))) {
+      return;
+    }
+
+    LSMRecord record = cursors[best].record();
+    emit(record);
+
+    // skip the older entries for the same key
+    for (unsigned int i = 0; i < cursors.size(); i++) {
+      if (cursors[i].valid() && cursors[i].record().key == record.key) {
+        cursors[i].next();
+      }
+    }
+  }
+}
+
+class LSMStore {
+public:
+  // opens (or creates) the store kept in the given directory, the memtable
+  // is flushed once it holds memtableLimit keys
+  LSMStore(const string& dir, unsigned int memtableLimit = 65536);
+
+  // flushes the memtable and waits for compaction to stop
+  ~LSMStore();
+
+  LSMStore(const LSMStore& copy) = delete;
+  LSMStore& operator=(const LSMStore& rhs) = delete;
+
+  // add the item with the given key, replacing the old item (if any)
+  void update(const string& key, int item);
+
+  // remove the key, does nothing if the key does not exist
+  void remove(const string& key);
+
+  // returns true iff the key exists, and if so stores its item in "item"
+  bool get(const string& key, int& item) const;
+
+  // returns true iff the key exists
+  bool hasKey(const string& key) const;
+
+  // calls visit(key, item) for each key k with from <= k < to in
+  // increasing order of key, an empty "to" means no upper bound
+  template <typename Visit>
+  void scan(const string& from, const string& to, Visit visit) const;
+
+  // write the memtable out as a level 0 run
+  void flush();
+
+private:
+  static const unsigned int L0_RUNS = 4;       // level 0 runs that trigger compaction
+  static const unsigned int L0_STALL_RUNS = 8; // level 0 runs that make flush() wait
+  static const unsigned int LEVEL_RATIO = 10;  // growth between levels
+
+  typedef vector<shared_ptr<SortedRun> > RunList;
+
+  string dir;
+  AVLMap<string, LSMValue> memtable;
+  unsigned int memtableLimit;
+
+  // guards everything below, the memtable belongs to the user's thread
+  mutable mutex lock;
+  condition_variable wake, compacted;
+  RunList level0;                        // newest first
+  vector<RunList> levels;                // levels[i] is level i+1, sorted by key
+  vector<string> compactAfter;           // where each level's next push down starts
+  unsigned long long level1Bytes;        // size allowed for level 1
+  unsigned long long runBytes;           // size of the runs compactions write
+  unsigned int nextFileId;
+  bool stopping;
+  thread compactor;
+
+  string newRunPath();
+
+  // rewrites the MANIFEST, must hold the lock
+  void saveManifest();
+
+  // the runs that may hold keys in [lo, hi] (no upper bound if hi is
+  // empty), newest first, as of now
+  RunList snapshot(const string& lo, const string& hi) const;
+
+  // background thread body: compact until told to stop
+  void compactionLoop();
+
+  // performs one compaction if one is due, returns false otherwise
+  bool compactOnce();
+
+  // merges the runs (newest first) into new run files of about runBytes
+  // each, in key order
+  RunList mergeRuns(const RunList& runs, bool dropTombstones);
+};
+
+LSMStore::LSMStore(const string& dir, unsigned int memtableLimit) {
+  assert(memtableLimit > 0);
+  this->dir = dir;
+  this->memtableLimit = memtableLimit;
+  nextFileId = 0;
+  stopping = false;
+  mkdir(dir.c_str(), 0755);
+
+  // each line of the manifest is: <level> <file name>, level 0 runs
+  // are listed newest first
+  ifstream manifest((dir + "/MANIFEST").c_str());
+  unsigned int level;
+  string name;
+  while (manifest >> level >> name) {
+    shared_ptr<SortedRun> run(new SortedRun(dir + "/" + name));
+    if (level == 0) {
+      level0.push_back(run);
+    }
+    else {
+      if (levels.size() < level) {
+        levels.resize(level);
+      }
+      levels[level-1].push_back(run);
+    }
+    nextFileId = max(nextFileId, (unsigned int) atoi(name.c_str()) + 1);
+  }
+  for (unsigned int i = 0; i < levels.size(); i++) {
+    sort(levels[i].begin(), levels[i].end(),
+      [](const shared_ptr<SortedRun>& a, const shared_ptr<SortedRun>& b) {
+        return a->firstKey() < b->firstKey();
+      });
+  }
+  compactAfter.resize(levels.size());
+
+  // runs are about the size of a flushed memtable, and level 1 may hold
+  // about as much as a full level 0
+  runBytes = (unsigned long long) memtableLimit * 64;
+  level1Bytes = L0_RUNS * runBytes;
+
+  compactor = thread(&LSMStore::compactionLoop, this);
+}
+
+LSMStore::~LSMStore() {
+  flush();
+
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  wake.notify_one();
+  compactor.join();
+}
+
+string LSMStore::newRunPath() {
+  char name[32];
+  snprintf(name, sizeof(name), "%08u.run", nextFileId++);
+  return dir + "/" + name;
+}
+
+void LSMStore::saveManifest() {
+  // write a new manifest and rename it over the old one, so a crash
+  // leaves either the old or the new list of runs
+  string manifest;
+  for (unsigned int i = 0; i < level0.size(); i++) {
+    manifest += "0 " + level0[i]->path().substr(dir.size()+1) + '\n';
+  }
+  for (unsigned int i = 0; i < levels.size(); i++) {
+    for (unsigned int j = 0; j < levels[i].size(); j++) {
+      manifest += to_string(i+1) + ' ' + levels[i][j]->path().substr(dir.size()+1) + '\n';
+    }
+  }
+
+  string tmpPath = dir + "/MANIFEST.tmp";
+  int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  assert(fd >= 0);
+  for (size_t written = 0; written < manifest.size(); ) {
+    ssize_t n = write(fd, manifest.data() + written, manifest.size() - written);
+    assert(n > 0);
+    written += n;
+  }
+
+  // the new manifest must be on disk before it replaces the old one, and
+  // the rename before any run the old one lists is deleted (which happens
+  // once the caller lets go of the obsolete runs)
+  int synced = fsync(fd);
+  assert(synced == 0);
+  close(fd);
+  rename(tmpPath.c_str(), (dir + "/MANIFEST").c_str());
+  int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  assert(dirFd >= 0);
+  synced = fsync(dirFd);
+  assert(synced == 0);
+  (void) synced;
+  close(dirFd);
+}
+
+void LSMStore::update(const string& key, int item) {
+  LSMValue value = {item, false};
+  memtable.update(key, value);
+  if (memtable.size() >= memtableLimit) {
+    flush();
+  }
+}
+
+void LSMStore::remove(const string& key) {
+  // the key may still be in a run, so record a tombstone rather than
+  // just dropping it from the memtable
+  LSMValue value = {0, true};
+  memtable.update(key, value);
+  if (memtable.size() >= memtableLimit) {
+    flush();
+  }
+}
+
+LSMStore::RunList LSMStore::snapshot(const string& lo, const string& hi) const {
+  lock_guard<mutex> guard(lock);
+  RunList runs;
+  for (unsigned int i = 0; i < level0.size(); i++) {
+    if (!(level0[i]->lastKey() < lo) && (hi.empty() || !(hi < level0[i]->firstKey()))) {
+      runs.push_back(level0[i]);
+    }
+  }
+
+  // the runs of a deeper level are sorted and disjoint, so the ones in
+  // range are consecutive, starting at the first that ends at or after lo
+  for (unsigned int i = 0; i < levels.size(); i++) {
+    RunList::const_iterator run = lower_bound(levels[i].begin(), levels[i].end(), lo,
+      [](const shared_ptr<SortedRun>& r, const string& key) { return r->lastKey() < key; });
+    for (; run != levels[i].end() && (hi.empty() || !(hi < (*run)->firstKey())); ++run) {
+      runs.push_back(*run);
+    }
+  }
+  return runs;
+}
+
+bool LSMStore::get(const string& key, int& item) const {
+  // the newest entry for the key wins, so look from newest to oldest
+  const LSMValue *value = memtable.lookup(key);
+  if (value != NULL) {
+    item = value->item;
+    return !value->deleted;
+  }
+
+  RunList runs = snapshot(key, key);
+  for (unsigned int i = 0; i < runs.size(); i++) {
+    LSMValue found;
+    if (runs[i]->get(key, found)) {
+      item = found.item;
+      return !found.deleted;
+    }
+  }
+  return false;
+}
+
+bool LSMStore::hasKey(const string& key) const {
+  int item;
+  return get(key, item);
+}
+
+template <typename Visit>
+void LSMStore::scan(const string& from, const string& to, Visit visit) const {
+  vector<LSMCursor> cursors;
+
+  // the memtable part of the range comes first as the newest source
+  vector<LSMRecord> recent;
+  for (AVLIterator<string, LSMValue> iter = memtable.lowerBound(from);
+       iter != memtable.end() && (to.empty() || iter.key() < to); ++iter) {
+    LSMRecord record = {iter.key(), iter.item().item, iter.item().deleted};
+    recent.push_back(record);
+  }
+  cursors.push_back(LSMCursor(recent));
+
+  RunList runs = snapshot(from, to);
+  for (unsigned int i = 0; i < runs.size(); i++) {
+    cursors.push_back(LSMCursor(runs[i], from));
+  }
+
+  mergeCursors(cursors, to, [&](const LSMRecord& record) {
+    if (!record.deleted) {
+      visit(record.key, record.item);
+    }
+  });
+}
+
+void LSMStore::flush() {
+  if (memtable.size() == 0) {
+    return;
+  }
+
+  string path;
+  {
+    // stall while the compactor is behind, so level 0 (which every read
+    // has to check) stays short
+    unique_lock<mutex> guard(lock);
+    compacted.wait(guard, [&] { return level0.size() < L0_STALL_RUNS; });
+    path = newRunPath();
+  }
+
+  // the memtable iterates in key order, so it is written out sequentially
+  RunWriter writer(path, memtable.size());
+  for (AVLIterator<string, LSMValue> iter = memtable.begin(); iter != memtable.end(); ++iter) {
+    writer.add(iter.key(), iter.item().item, iter.item().deleted);
+  }
+  writer.finish();
+  shared_ptr<SortedRun> run(new SortedRun(path));
+
+  {
+    lock_guard<mutex> guard(lock);
+    level0.insert(level0.begin(), run);
+    saveManifest();
+  }
+  memtable.clear();
+  wake.notify_one();
+}
+
+LSMStore::RunList LSMStore::mergeRuns(const RunList& runs, bool dropTombstones) {
+  unsigned long long expected = 0;
+  vector<LSMCursor> cursors;
+  for (unsigned int i = 0; i < runs.size(); i++) {
+    // a rough upper bound on the records, just to size the Bloom filters
+    expected += runs[i]->bytes() / 16;
+    cursors.push_back(LSMCursor(runs[i], ""));
+  }
+  expected = min(expected, runBytes / 16);
+
+  RunList merged;
+  string path;
+  unique_ptr<RunWriter> writer;
+
+  // closes the run being written, if any, and adds it to merged
+  auto finishRun = [&]() {
+    if (writer) {
+      writer->finish();
+      writer.reset();
+      merged.push_back(shared_ptr<SortedRun>(new SortedRun(path)));
+    }
+  };
+
+  mergeCursors(cursors, "", [&](const LSMRecord& record) {
+    // nothing older is left below the deepest level for a tombstone to hide
+    if (record.deleted && dropTombstones) {
+      return;
+    }
+    if (writer && writer->bytes() >= runBytes) {
+      finishRun();
+    }
+    if (!writer) {
+      {
+        lock_guard<mutex> guard(lock);
+        path = newRunPath();
+      }
+      writer.reset(new RunWriter(path, expected));
+    }
+    writer->add(record.key, record.item, record.deleted);
+  });
+  finishRun();
+
+  return merged;
+}
+
+bool LSMStore::compactOnce() {
+  RunList inputs;
+  unsigned int target;   // the level the merged runs go to (1 or deeper)
+  unsigned int numUpper; // the first numUpper inputs come from the level above it
+  bool deepest = true;
+
+  {
+    lock_guard<mutex> guard(lock);
+    if (level0.size() >= L0_RUNS) {
+      // all of level 0 goes down to level 1
+      inputs = level0;
+      target = 1;
+    }
+    else {
+      // otherwise find a level that is too big and push one of its runs
+      // down a level, taking turns through its key range
+      unsigned long long limit = level1Bytes;
+      target = 0;
+      for (unsigned int i = 0; i < levels.size() && target == 0; i++) {
+        unsigned long long levelBytes = 0;
+        for (unsigned int j = 0; j < levels[i].size(); j++) {
+          levelBytes += levels[i][j]->bytes();
+        }
+        if (levelBytes > limit) {
+          unsigned int j = 0;
+          while (j < levels[i].size() && !(compactAfter[i] < levels[i][j]->firstKey())) {
+            j++;
+          }
+          if (j == levels[i].size()) {
+            j = 0;
+          }
+          inputs.push_back(levels[i][j]);
+          compactAfter[i] = levels[i][j]->lastKey();
+          target = i+2;
+        }
+        limit *= LEVEL_RATIO;
+      }
+      if (target == 0) {
+        return false;
+      }
+    }
+
+    // the key range being pushed down
+    numUpper = inputs.size();
+    string lo = inputs[0]->firstKey(), hi = inputs[0]->lastKey();
+    for (unsigned int i = 1; i < inputs.size(); i++) {
+      lo = min(lo, inputs[i]->firstKey());
+      hi = max(hi, inputs[i]->lastKey());
+    }
+
+    // the runs of the target level in that range are rewritten with it,
+    // and tombstones can go if no deeper run covers any of the range
+    for (unsigned int i = target-1; i < levels.size(); i++) {
+      for (unsigned int j = 0; j < levels[i].size(); j++) {
+        if (!(levels[i][j]->lastKey() < lo) && !(hi < levels[i][j]->firstKey())) {
+          if (i == target-1) {
+            inputs.push_back(levels[i][j]);
+          }
+          else {
+            deepest = false;
+          }
+        }
+      }
+    }
+  }
+
+  // the slow part happens without the lock, reads and flushes continue
+  RunList merged = mergeRuns(inputs, deepest);
+
+  {
+    lock_guard<mutex> guard(lock);
+    // drop the inputs, level 0 may have gained newer runs in the meantime
+    for (unsigned int i = 0; i < inputs.size(); i++) {
+      RunList& from = (i >= numUpper) ? levels[target-1]
+        : (target == 1) ? level0 : levels[target-2];
+      for (unsigned int j = 0; j < from.size(); j++) {
+        if (from[j] == inputs[i]) {
+          from.erase(from.begin() + j);
+          break;
+        }
+      }
+      inputs[i]->markObsolete();
+    }
+
+    // nothing else in the target level overlaps the merged runs, so they
+    // slot in as a block where the inputs were
+    if (levels.size() < target) {
+      levels.resize(target);
+      compactAfter.resize(target);
+    }
+    RunList& level = levels[target-1];
+    if (!merged.empty()) {
+      RunList::iterator at = lower_bound(level.begin(), level.end(), merged[0]->firstKey(),
+        [](const shared_ptr<SortedRun>& r, const string& key) { return r->firstKey() < key; });
+      level.insert(at, merged.begin(), merged.end());
+    }
+    saveManifest();
+  }
+  compacted.notify_all();
+  return true;
+}
+
+void LSMStore::compactionLoop() {
+  while (true) {
+    {
+      unique_lock<mutex> guard(lock);
+      if (stopping) {
+        return;
+      }
+    }
+
+    if (!compactOnce()) {
+      unique_lock<mutex> guard(lock);
+      if (stopping) {
+        return;
+      }
+      // sleep until a flush may have made more work
+      wake.wait_for(guard, chrono::milliseconds(100));
+    }
+  }
+}
+
+/*
+  An append-only write-ahead log (WAL) of binary records.
+
+  Each record is stored as its length, a CRC-32 of its bytes, and the bytes
+  themselves. Appends only copy the record into a buffer; a dedicated
+  flusher thread writes whatever has built up in one write() and, if the
+  durability level asks for it, one fdatasync(). Records appended while
+  a batch is being synced form the next batch, so many appends share a
+  single sync (group commit).
+
+  Replaying a log stops at the first record that is cut short or fails
+  its CRC, i.e. one that was being written when the process or machine
+  went down, and truncates the log there. Records are never empty, so a
+  zero-filled tail (a file extended but not written before a power loss)
+  is cut off the same way.
+
+  A failed write() or fdatasync() fails the log for good: the records it
+  held are not acknowledged, and every later append is refused, since
+  what reached the disk is no longer known.
+*/
+
+enum WALDurability {
+  // batches are written but never synced: survives the process
+  // crashing but not the machine
+  WAL_BUFFERED,
+
+  // the flusher syncs every batch but appends do not wait for it: a
+  // machine crash loses at most the batches in flight
+  WAL_PERIODIC,
+
+  // appends return only once their record is synced: nothing that
+  // was appended is ever lost
+  WAL_SYNC
+};
+
+// CRC-32 (IEEE polynomial) of the bytes
+inline unsigned int crc32(const char* bytes, size_t length) {
+  static unsigned int table[256];
+  static bool tableReady = [] {
+    for (unsigned int i = 0; i < 256; i++) {
+      unsigned int c = i;
+      for (int bit = 0; bit < 8; bit++) {
+        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+      }
+      table[i] = c;
+    }
+    return true;
+  }();
+  (void) tableReady;
+
+  unsigned int crc = 0xFFFFFFFFu;
+  for (size_t i = 0; i < length; i++) {
+    crc = table[(crc ^ (unsigned char) bytes[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return crc ^ 0xFFFFFFFFu;
+}
+
+class WriteAheadLog {
+public:
+  // opens the log for appending, creating it if needed
+  WriteAheadLog(const string& path, WALDurability durability = WAL_PERIODIC);
+
+  // writes (and syncs, unless buffered) everything appended, then closes
+  ~WriteAheadLog();
+
+  WriteAheadLog(const WriteAheadLog& copy) = delete;
+  WriteAheadLog& operator=(const WriteAheadLog& rhs) = delete;
+
+  // adds a record, which must not be empty, to the log; with WAL_SYNC
+  // this waits until it is synced. Returns false if the log has failed
+  // (for WAL_SYNC, including while writing this record)
+  bool append(const string& record);
+
+  // waits until every record appended so far is written, and synced
+  // unless the durability is WAL_BUFFERED; returns false if any of them
+  // could not be
+  bool sync();
+
+  // discards every record, e.g. once the data they describe is saved
+  // somewhere else; appends made while it runs wait for it and land in
+  // the emptied log. Returns false if the log has failed or could not be
+  // cut, which fails it
+  bool reset();
+
+  // returns true once a write, sync or reset of the log has failed
+  bool failed();
+
+  // calls apply(record) for each intact record in the log at path, in
+  // the order they were appended, and cuts off any torn tail; a record
+  // apply returns false for ends the log the same way. Returns false,
+  // leaving the log alone, if it could not be read or cut
+  template <typename Apply>
+  static bool replay(const string& path, Apply apply);
+
+private:
+  int fd;
+  WALDurability durability;
+
+  mutex lock;
+  condition_variable wakeFlusher, committed;
+  string pending;                // encoded records not yet handed to write()
+  unsigned long long appended;   // # of records appended so far
+  unsigned long long done;       // # of those written (and synced if asked)
+  bool resetting;                // appends wait while this is set
+  bool broken;                   // a write, sync or reset has failed
+  bool stopping;
+  thread flusher;
+
+  // flusher thread body
+  void flushLoop();
+};
+
+WriteAheadLog::WriteAheadLog(const string& path, WALDurability durability) {
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  assert(fd >= 0);
+
+  this->durability = durability;
+  appended = done = 0;
+  resetting = broken = stopping = false;
+  flusher = thread(&WriteAheadLog::flushLoop, this);
+}
+
+WriteAheadLog::~WriteAheadLog() {
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  wakeFlusher.notify_one();
+
+  // the flusher drains the pending records before it stops
+  flusher.join();
+  close(fd);
+}
+
+bool WriteAheadLog::append(const string& record) {
+  // replay takes an empty record for the zeroed tail of a crashed log
+  assert(!record.empty());
+
+  unique_lock<mutex> guard(lock);
+  committed.wait(guard, [&] { return !resetting; });
+  if (broken) {
+    return false;
+  }
+  putU32(pending, record.size());
+  putU32(pending, crc32(record.data(), record.size()));
+  pending += record;
+  unsigned long long mine = ++appended;
+  wakeFlusher.notify_one();
+
+  if (durability == WAL_SYNC) {
+    committed.wait(guard, [&] { return done >= mine || broken; });
+    return done >= mine;
+  }
+  return true;
+}
+
+bool WriteAheadLog::sync() {
+  unique_lock<mutex> guard(lock);
+  unsigned long long upTo = appended;
+  committed.wait(guard, [&] { return done >= upTo || broken; });
+  return done >= upTo;
+}
+
+bool WriteAheadLog::reset() {
+  unique_lock<mutex> guard(lock);
+  committed.wait(guard, [&] { return !resetting; });
+
+  // waiting for the flusher gives up the lock, so hold off new appends
+  // until the file is cut, or they could be written and then lost
+  resetting = true;
+  unsigned long long upTo = appended;
+  committed.wait(guard, [&] { return done >= upTo || broken; });
+  if (!broken && ftruncate(fd, 0) != 0) {
+    broken = true;
+  }
+  resetting = false;
+  committed.notify_all();
+  return !broken;
+}
+
+bool WriteAheadLog::failed() {
+  lock_guard<mutex> guard(lock);
+  return broken;
+}
+
+void WriteAheadLog::flushLoop() {
+  unique_lock<mutex> guard(lock);
+  while (true) {
+    wakeFlusher.wait(guard, [&] { return !pending.empty() || stopping; });
+    if (pending.empty()) {
+      // only reached when stopping with nothing left to write
+      return;
+    }
+
+    // take everything appended so far as one batch, new appends can
+    // carry on into a fresh buffer while this one is written
+    string batch;
+    batch.swap(pending);
+    unsigned long long upTo = appended;
+    guard.unlock();
+
+    // a write cut short by a signal is carried on, any other error
+    // fails the log instead of acknowledging the batch
+    bool ok = true;
+    size_t written = 0;
+    while (ok && written < batch.size()) {
+      ssize_t n = write(fd, batch.data() + written, batch.size() - written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      ok = n > 0;
+      if (ok) {
+        written += n;
+      }
+    }
+    if (ok && durability != WAL_BUFFERED) {
+      int synced;
+      do {
+        synced = fdatasync(fd);
+      } while (synced != 0 && errno == EINTR);
+      ok = synced == 0;
+    }
+
+    guard.lock();
+    if (ok) {
+      done = upTo;
+    }
+    else {
+      broken = true;
+    }
+    committed.notify_all();
+  }
+}
+
+template <typename Apply>
+bool WriteAheadLog::replay(const string& path, Apply apply) {
+  int in = open(path.c_str(), O_RDWR);
+  if (in < 0) {
+    // no log yet, nothing to replay
+    return errno == ENOENT;
+  }
+
+  struct stat info;
+  if (fstat(in, &info) != 0) {
+    close(in);
+    return false;
+  }
+  string bytes(info.st_size, '\0');
+  size_t got = 0;
+  while (got < bytes.size()) {
+    ssize_t n = pread(in, &bytes[got], bytes.size() - got, got);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      // what could not be read must not be cut off as a torn tail
+      close(in);
+      return false;
+    }
+    got += n;
+  }
+
+  // walk the records until the end or the first damaged one, an empty
+  // record can only be a zeroed header
+  size_t pos = 0;
+  while (bytes.size() - pos >= 8) {
+    const char *header = bytes.data() + pos;
+    unsigned int length = getU32(header);
+    unsigned int crc = getU32(header);
+    if (length == 0 || bytes.size() - pos - 8 < length || crc32(header, length) != crc) {
+      break;
+    }
+
+    if (!apply(string(header, length))) {
+      break;
+    }
+    pos += 8 + length;
+  }
+
+  bool cut = pos == bytes.size() || ftruncate(in, pos) == 0;
+  close(in);
+  return cut;
+}
+
+/*
+  An AVLMap<string, int> whose updates and removals are recorded in a
+  write-ahead log before they are applied, so reopening it after a crash
+  replays them. The log grows with every mutation until checkpoint() is
+  called, which writes the whole map as a fresh log.
+*/
+class LoggedAVLMap {
+public:
+  // replays the log at path (if any) and then logs to it
+  LoggedAVLMap(const string& path, WALDurability durability = WAL_PERIODIC);
+
+  // returns false, leaving the map as it was, if the update could not
+  // be logged
+  bool update(const string& key, int item);
+
+  // remove the key and its associated item, which must exist, returns
+  // false like update
+  bool remove(const string& key);
+
+  // read-only access to the map itself, mutations must go through
+  // update and remove to be logged
+  const AVLMap<string, int>& map() const;
+
+  // replaces the log with one update per entry of the map, dropping the
+  // history of overwritten and removed keys; returns false, keeping the
+  // old log, if the new one could not be written
+  bool checkpoint();
+
+  // returns true if the log could not be read back or written, from
+  // then on nothing more is logged and so every mutation is refused
+  bool failed() const;
+
+private:
+  string path;
+  WALDurability durability;
+  AVLMap<string, int> entries;
+  unique_ptr<WriteAheadLog> log;
+  bool replayed; // false if the log could not be read back
+
+  // record layout: 'U' or 'R', key length, key, and the item for 'U'
+  static string encode(char op, const string& key, int item);
+
+  // returns false for a record that is not one encode() could write
+  bool apply(const string& record);
+};
+
+LoggedAVLMap::LoggedAVLMap(const string& path, WALDurability durability) {
+  this->path = path;
+  this->durability = durability;
+  replayed = WriteAheadLog::replay(path, [&](const string& record) { return apply(record); });
+  log.reset(new WriteAheadLog(path, durability));
+}
+
+string LoggedAVLMap::encode(char op, const string& key, int item) {
+  string record(1, op);
+  putU32(record, key.size());
+  record += key;
+  if (op == 'U') {
+    putU32(record, (unsigned int) item);
+  }
+  return record;
+}
+
+bool LoggedAVLMap::apply(const string& record) {
+  if (record.size() < 5 || (record[0] != 'U' && record[0] != 'R')) {
+    return false;
+  }
+  const char *in = record.data() + 1;
+  unsigned int keyLength = getU32(in);
+  size_t itemLength = (record[0] == 'U') ? 4 : 0;
+  if (record.size() - 5 < keyLength || record.size() - 5 - keyLength != itemLength) {
+    return false;
+  }
+  string key(in, keyLength);
+  in += keyLength;
+
+  if (record[0] == 'U') {
+    entries.update(key, (int) getU32(in));
+    return true;
+  }
+  // only a key that is there can have been removed
+  if (!entries.hasKey(key)) {
+    return false;
+  }
+  entries.remove(key);
+  return true;
+}
+
+bool LoggedAVLMap::update(const string& key, int item) {
+  if (failed() || !log->append(encode('U', key, item))) {
+    return false;
+  }
+  entries.update(key, item);
+  return true;
+}
+
+bool LoggedAVLMap::remove(const string& key) {
+  assert(entries.hasKey(key));
+  if (failed() || !log->append(encode('R', key, 0))) {
+    return false;
+  }
+  entries.remove(key);
+  return true;
+}
+
+const AVLMap<string, int>& LoggedAVLMap::map() const {
+  return entries;
+}
+
+bool LoggedAVLMap::checkpoint() {
+  if (failed()) {
+    return false;
+  }
+
+  // write the snapshot to a new log and rename it over the old one, so a
+  // crash part way leaves the old log in place
+  string tmpPath = path + ".tmp";
+  unlink(tmpPath.c_str());
+  bool written;
+  {
+    WriteAheadLog snapshot(tmpPath, WAL_PERIODIC);
+    for (AVLIterator<string, int> iter = entries.begin(); iter != entries.end(); ++iter) {
+      snapshot.append(encode('U', iter.key(), iter.item()));
+    }
+    written = snapshot.sync();
+  }
+  if (!written) {
+    unlink(tmpPath.c_str());
+    return false;
+  }
+
+  log.reset();
+  bool renamed = rename(tmpPath.c_str(), path.c_str()) == 0;
+  log.reset(new WriteAheadLog(path, durability));
+  return renamed;
+}
+
+bool LoggedAVLMap::failed() const {
+  return !replayed || log->failed();
+}
+
+/*
+  Buffered output straight to a file descriptor, for dumping large
+  containers.
+
+  Text and numbers are collected in one large buffer and handed to the
+  kernel with a single write() whenever it fills up, instead of going
+  through the formatting and per-line flushing of iostream. Integers are
+  formatted with to_chars.
+
+  When writing to standard output, whatever cout still holds is flushed
+  first, so output from the two comes out in the order it was produced.
+
+  A failed open() or write() does not stop the program: the writer keeps
+  the first error, drops everything after it, and reports it from
+  flush(), close() and error(). Writes cut short by a signal are retried.
+*/
+
+// the formats containers can be exported in: one tab-separated line per
+// entry, or the raw bytes of the entries
+enum ExportFormat {
+  EXPORT_TSV,
+  EXPORT_BINARY
+};
+
+class BufferedWriter {
+public:
+  // writes to the open file descriptor fd, which stays open
+  BufferedWriter(int fd = STDOUT_FILENO, unsigned int capacity = 1 << 20);
+
+  // creates (or truncates) the file at path and writes to it
+  BufferedWriter(const string& path, unsigned int capacity = 1 << 20);
+
+  // closes the writer, ignoring errors; call close() to see them
+  ~BufferedWriter();
+
+  BufferedWriter(const BufferedWriter& copy) = delete;
+  BufferedWriter& operator=(const BufferedWriter& rhs) = delete;
+
+  BufferedWriter& operator<<(char c);
+  BufferedWriter& operator<<(const char* text);
+  BufferedWriter& operator<<(const string& text);
+
+  // any integer type, formatted in decimal
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type operator<<(Int value);
+
+  // the text or number left-aligned in a field of width characters,
+  // like cout << setw(width) << left
+  BufferedWriter& padded(const char* text, unsigned int width);
+  template <typename Int>
+  typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+  padded(Int value, unsigned int width);
+
+  // raw bytes, for binary formats
+  void write(const void* bytes, size_t length);
+
+  // hands everything buffered so far to the kernel, returns false if
+  // the file could not be opened or any write so far failed
+  bool flush();
+
+  // flushes, and closes the file if it was opened by path; returns false
+  // like flush, or if closing the file failed
+  bool close();
+
+  // the errno of the first failure, or 0 if there was none
+  int error() const;
+
+private:
+  int fd;
+  bool ownsFd;
+  char *buffer;
+  size_t capacity, used;
+  int firstError;
+
+  // makes room for length more bytes, unless length exceeds the capacity
+  void reserve(size_t length);
+
+  // write() until all the bytes are out
+  void writeAll(const char* bytes, size_t length);
+};
+
+BufferedWriter::BufferedWriter(int fd, unsigned int capacity) {
+  if (fd == STDOUT_FILENO) {
+    cout.flush();
+  }
+  assert(capacity >= 64);
+  this->fd = fd;
+  ownsFd = false;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = 0;
+}
+
+BufferedWriter::BufferedWriter(const string& path, unsigned int capacity) {
+  assert(capacity >= 64);
+  fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ownsFd = fd >= 0;
+  this->capacity = capacity;
+  buffer = new char[capacity];
+  used = 0;
+  firstError = (fd >= 0) ? 0 : errno;
+}
+
+BufferedWriter::~BufferedWriter() {
+  close();
+  delete[] buffer;
+}
+
+void BufferedWriter::writeAll(const char* bytes, size_t length) {
+  // once something is missing the rest is no use, so it is dropped
+  while (length > 0 && firstError == 0) {
+    ssize_t n = ::write(fd, bytes, length);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      firstError = (n < 0) ? errno : EIO;
+      return;
+    }
+    bytes += n;
+    length -= n;
+  }
+}
+
+bool BufferedWriter::flush() {
+  writeAll(buffer, used);
+  used = 0;
+  return firstError == 0;
+}
+
+bool BufferedWriter::close() {
+  flush();
+  if (ownsFd) {
+    if (::close(fd) != 0 && firstError == 0) {
+      firstError = errno;
+    }
+    ownsFd = false;
+    fd = -1;
+  }
+  return firstError == 0;
+}
+
+int BufferedWriter::error() const {
+  return firstError;
+}
+
+void BufferedWriter::reserve(size_t length) {
+  if (used + length > capacity) {
+    flush();
+  }
+}
+
+void BufferedWriter::write(const void* bytes, size_t length) {
+  reserve(length);
+  if (length > capacity) {
+    // too big to buffer, so it goes out directly
+    writeAll((const char*) bytes, length);
+    return;
+  }
+  memcpy(buffer + used, bytes, length);
+  used += length;
+}
+
+BufferedWriter& BufferedWriter::operator<<(char c) {
+  reserve(1);
+  buffer[used++] = c;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const char* text) {
+  write(text, strlen(text));
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::operator<<(const string& text) {
+  write(text.data(), text.size());
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::operator<<(Int value) {
+  // 20 digits and a sign cover any 64-bit integer
+  reserve(21);
+  used = to_chars(buffer + used, buffer + used + 21, value).ptr - buffer;
+  return *this;
+}
+
+BufferedWriter& BufferedWriter::padded(const char* text, unsigned int width) {
+  size_t length = strlen(text);
+  write(text, length);
+  for (; length < width; length++) {
+    *this << ' ';
+  }
+  return *this;
+}
+
+template <typename Int>
+typename enable_if<is_integral<Int>::value, BufferedWriter&>::type
+BufferedWriter::padded(Int value, unsigned int width) {
+  char digits[21];
+  *to_chars(digits, digits + 20, value).ptr = '\0';
+  return padded(digits, width);
+}
+
+void printTree(const AVLMap<string, int>& tree) {
+  BufferedWriter out;
+  for (AVLIterator<string, int> iter = tree.begin(); iter != tree.end(); ++iter) {
+    out << " - " << iter.key() << ' ' << iter.item() << '\n';
+  }
+  out << '\n';
+}
+
+// writes every entry of the tree to the file at path, in key order, either
+// as a line of key and item separated by a tab or as the key's length (4
+// bytes), the key and the item (4 bytes); returns false if the file could
+// not be written
+bool exportTree(const AVLMap<string, int>& tree, const string& path, ExportFormat format) {
+  BufferedWriter out(path);
+  for (AVLIterator<string, int> iter = tree.begin(); iter != tree.end(); ++iter) {
+    if (format == EXPORT_BINARY) {
+      unsigned int length = iter.key().size();
+      int item = iter.item();
+      out.write(&length, sizeof(length));
+      out.write(iter.key().data(), length);
+      out.write(&item, sizeof(item));
+    }
+    else {
+      out << iter.key() << '\t' << iter.item() << '\n';
+    }
+  }
+  return out.close();
+}
+
+/*
+  Asynchronous snapshots of containers.
+
+  AsyncFile keeps several reads or writes of a file in flight at once.
+  It drives them through io_uring where the kernel offers it (through
+  the raw system calls, so no library is needed) and otherwise through
+  a few threads calling pread and pwrite. Transfers interrupted by a
+  signal are resumed; any other failure is handed back with the request.
+
+  SnapshotWriter copies what it is given into page-aligned chunks of
+  SNAPSHOT_CHUNK bytes. Each chunk starts being written as soon as it is
+  full, and a chunk that finds every request slot busy is queued. The
+  chunks are the frozen copy of the container, so the container can be
+  changed again as soon as its contents are captured, while the disk
+  catches up. That copy costs memory: up to queueDepth chunks in flight
+  plus maxBacklog queued ones, after which append waits for the disk to
+  take a chunk before queueing another. maxBacklog = 0 never waits, and
+  then holds all of the snapshot the disk is behind on. finish() waits
+  for the disk.
+
+  SnapshotReader reads the next few chunks ahead of the one being
+  consumed, so building a container from a snapshot overlaps with
+  reading the rest of it.
+
+  With direct set, the file is opened with O_DIRECT to bypass the page
+  cache, falling back to buffered I/O on file systems that refuse it.
+
+  A file that cannot be opened, written or read does not stop the
+  program. SnapshotWriter keeps the first error and drops the rest of
+  the snapshot, SnapshotReader stops reading, and both report the error
+  through finish() or read() and error().
+*/
+
+const unsigned int SNAPSHOT_CHUNK = 1 << 20;
+const unsigned int SNAPSHOT_ALIGN = 4096;
+
+class AsyncFile {
+public:
+  // up to queueDepth requests on fd can be in flight at once; with
+  // useThreads, threads are used even where io_uring is available
+  AsyncFile(int fd, unsigned int queueDepth, bool useThreads = false);
+
+  // waits for the requests in flight
+  ~AsyncFile();
+
+  AsyncFile(const AsyncFile& copy) = delete;
+  AsyncFile& operator=(const AsyncFile& rhs) = delete;
+
+  // starts writing (or reading) length bytes from (or into) buffer at
+  // offset in the file, the buffer must stay untouched until complete()
+  // hands it back; there must be fewer than queueDepth requests in flight
+  void submit(bool write, char* buffer, size_t length, off_t offset);
+
+  // hands back the buffer of a finished request, setting length to the #
+  // of bytes moved and error to the errno the request failed with, or 0
+  // (length is less than asked only then, or for a read past the end of
+  // the file); returns NULL if wait is false and no request has finished
+  char* complete(size_t& length, int& error, bool wait = true);
+
+  // # of requests submitted but not yet handed back by complete()
+  unsigned int inFlight() const;
+
+  bool usingIoUring() const;
+
+private:
+  struct Request {
+    bool write;
+    char *buffer;
+    size_t length;
+    off_t offset;
+    size_t done;    // # of bytes moved so far
+    int error;      // errno of the failure, 0 if none
+  };
+
+  int fd;
+  unsigned int queueDepth;
+  Request *requests;       // one per slot
+  unsigned int *freeSlots; // stack of the slots not in flight
+  unsigned int numFree;
+  unsigned int *failed;    // stack of the slots the kernel never took
+  unsigned int numFailed;
+
+  // io_uring, ring is -1 when threads are used instead
+  int ring;
+  void *sqMap, *cqMap;
+  size_t sqMapLength, cqMapLength, sqesLength;
+  unsigned int *sqTail, *sqMask, *sqArray;
+  unsigned int *cqHead, *cqTail, *cqMask;
+  io_uring_sqe *sqes;
+  io_uring_cqe *cqes;
+  unsigned int numUnsubmitted;  // entries queued but not taken by the kernel
+
+  // sets up the ring, returns false if the kernel does not allow it
+  bool setupRing();
+
+  // queues the rest of the request in the slot and tells the kernel
+  void pushRequest(unsigned int slot);
+
+  // offers the kernel the queued entries, and with waitFor = 1 waits for
+  // a completion; entries it is too busy to take stay queued for the next
+  // call, and if it refuses them for good they fail with its errno
+  void enterRing(unsigned int waitFor);
+
+  // threads: slots are queued for the workers and finished ones for
+  // complete(), both as rings of queueDepth slots
+  mutex lock;
+  condition_variable wakeWorker, finished;
+  unsigned int *queued, queuedHead, numQueued;
+  unsigned int *done, doneHead, numDone;
+  bool stopping;
+  unsigned int numWorkers;
+  thread *workers;
+
+  // worker thread body
+  void workerLoop();
+};
+
+AsyncFile::AsyncFile(int fd, unsigned int queueDepth, bool useThreads) {
+  assert(queueDepth > 0);
+  this->fd = fd;
+  this->queueDepth = queueDepth;
+  requests = new Request[queueDepth];
+  freeSlots = new unsigned int[queueDepth];
+  for (unsigned int i = 0; i < queueDepth; i++) {
+    freeSlots[i] = i;
+  }
+  numFree = queueDepth;
+  failed = new unsigned int[queueDepth];
+  numFailed = 0;
+  numUnsubmitted = 0;
+
+  queued = done = NULL;
+  workers = NULL;
+  numWorkers = 0;
+  if (!useThreads && setupRing()) {
+    return;
+  }
+
+  ring = -1;
+  queued = new unsigned int[queueDepth];
+  done = new unsigned int[queueDepth];
+  queuedHead = numQueued = doneHead = numDone = 0;
+  stopping = false;
+  numWorkers = min(queueDepth, 4u);
+  workers = new thread[numWorkers];
+  for (unsigned int i = 0; i < numWorkers; i++) {
+    workers[i] = thread(&AsyncFile::workerLoop, this);
+  }
+}
+
+AsyncFile::~AsyncFile() {
+  size_t length;
+  int error;
+  while (inFlight() > 0) {
+    complete(length, error);
+  }
+
+  if (ring >= 0) {
+    munmap(sqes, sqesLength);
+    if (cqMap != sqMap) {
+      munmap(cqMap, cqMapLength);
+    }
+    munmap(sqMap, sqMapLength);
+    close(ring);
+  }
+  else {
+    {
+      lock_guard<mutex> guard(lock);
+      stopping = true;
+    }
+    wakeWorker.notify_all();
+    for (unsigned int i = 0; i < numWorkers; i++) {
+      workers[i].join();
+    }
+  }
+  delete[] workers;
+  delete[] queued;
+  delete[] done;
+  delete[] failed;
+  delete[] freeSlots;
+  delete[] requests;
+}
+
+bool AsyncFile::setupRing() {
+  io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  ring = syscall(__NR_io_uring_setup, queueDepth, &params);
+  if (ring < 0) {
+    return false;
+  }
+  // plain reads and writes came with 5.6, this feature flag with 5.7
+  if (!(params.features & IORING_FEAT_FAST_POLL)) {
+    close(ring);
+    return false;
+  }
+
+  // the submission and completion rings may share one mapping
+  sqMapLength = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  cqMapLength = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single) {
+    sqMapLength = cqMapLength = max(sqMapLength, cqMapLength);
+  }
+  sqMap = mmap(NULL, sqMapLength, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+               ring, IORING_OFF_SQ_RING);
+  assert(sqMap != MAP_FAILED);
+  cqMap = single ? sqMap : mmap(NULL, cqMapLength, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+  assert(cqMap != MAP_FAILED);
+  sqesLength = params.sq_entries * sizeof(io_uring_sqe);
+  sqes = (io_uring_sqe*) mmap(NULL, sqesLength, PROT_READ | PROT_WRITE,
+                              MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+  assert(sqes != MAP_FAILED);
+
+  char *sq = (char*) sqMap, *cq = (char*) cqMap;
+  sqTail = (unsigned int*) (sq + params.sq_off.tail);
+  sqMask = (unsigned int*) (sq + params.sq_off.ring_mask);
+  sqArray = (unsigned int*) (sq + params.sq_off.array);
+  cqHead = (unsigned int*) (cq + params.cq_off.head);
+  cqTail = (unsigned int*) (cq + params.cq_off.tail);
+  cqMask = (unsigned int*) (cq + params.cq_off.ring_mask);
+  cqes = (io_uring_cqe*) (cq + params.cq_off.cqes);
+  return true;
+}
+
+void AsyncFile::pushRequest(unsigned int slot) {
+  Request& request = requests[slot];
+
+  // only this thread submits, and there are never more requests in
+  // flight than entries, so the tail slot is always free
+  unsigned int tail = *sqTail;
+  unsigned int index = tail & *sqMask;
+  io_uring_sqe& sqe = sqes[index];
+  memset(&sqe, 0, sizeof(sqe));
+  sqe.opcode = request.write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe.fd = fd;
+  sqe.off = request.offset + request.done;
+  sqe.addr = (unsigned long long) (request.buffer + request.done);
+  sqe.len = request.length - request.done;
+  sqe.user_data = slot;
+  sqArray[index] = index;
+
+  // the kernel must see the entry before the new tail
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+  numUnsubmitted++;
+  enterRing(0);
+}
+
+void AsyncFile::enterRing(unsigned int waitFor) {
+  while (true) {
+    int entered = syscall(__NR_io_uring_enter, ring, numUnsubmitted, waitFor,
+                          waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    if (entered >= 0) {
+      numUnsubmitted -= entered;
+      return;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    // short of memory or of room for completions, which reaping frees
+    if (errno == EAGAIN || errno == EBUSY) {
+      return;
+    }
+
+    // the kernel took none of the entries, so they can be taken back off
+    // the tail and finished here; nothing else can fail a healthy ring
+    assert(numUnsubmitted > 0);
+    unsigned int tail = *sqTail;
+    for (unsigned int i = tail - numUnsubmitted; i != tail; i++) {
+      unsigned int slot = sqes[i & *sqMask].user_data;
+      requests[slot].error = errno;
+      failed[numFailed++] = slot;
+    }
+    __atomic_store_n(sqTail, tail - numUnsubmitted, __ATOMIC_RELEASE);
+    numUnsubmitted = 0;
+    return;
+  }
+}
+
+void AsyncFile::submit(bool write, char* buffer, size_t length, off_t offset) {
+  assert(numFree > 0);
+  unsigned int slot = freeSlots[--numFree];
+  requests[slot] = {write, buffer, length, offset, 0, 0};
+
+  if (ring >= 0) {
+    pushRequest(slot);
+    return;
+  }
+  {
+    lock_guard<mutex> guard(lock);
+    queued[(queuedHead + numQueued++) % queueDepth] = slot;
+  }
+  wakeWorker.notify_one();
+}
+
+char* AsyncFile::complete(size_t& length, int& error, bool wait) {
+  if (inFlight() == 0) {
+    return NULL;
+  }
+
+  unsigned int slot;
+  if (ring >= 0) {
+    while (true) {
+      if (numFailed > 0) {
+        slot = failed[--numFailed];
+        break;
+      }
+      unsigned int head = *cqHead;
+      if (head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+        // entries the kernel was too busy for are offered to it again
+        if (wait || numUnsubmitted > 0) {
+          enterRing(wait ? 1 : 0);
+        }
+        if (!wait && numFailed == 0 && head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+          return NULL;
+        }
+        continue;
+      }
+      io_uring_cqe& cqe = cqes[head & *cqMask];
+      slot = cqe.user_data;
+      int moved = cqe.res;
+      __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+      Request& request = requests[slot];
+      if (moved == -EINTR || moved == -EAGAIN) {
+        pushRequest(slot);
+        continue;
+      }
+      if (moved < 0) {
+        request.error = -moved;
+      }
+      else if (moved == 0 && request.write && request.done < request.length) {
+        // a write that moves nothing would never finish
+        request.error = EIO;
+      }
+      else {
+        // a short transfer is resumed where it stopped, unless a read hit
+        // the end of the file
+        request.done += moved;
+        if (request.done < request.length && moved > 0) {
+          pushRequest(slot);
+          continue;
+        }
+      }
+      break;
+    }
+  }
+  else {
+    unique_lock<mutex> guard(lock);
+    if (numDone == 0 && !wait) {
+      return NULL;
+    }
+    finished.wait(guard, [&] { return numDone > 0; });
+    slot = done[doneHead];
+    doneHead = (doneHead + 1) % queueDepth;
+    numDone--;
+  }
+
+  freeSlots[numFree++] = slot;
+  length = requests[slot].done;
+  error = requests[slot].error;
+  return requests[slot].buffer;
+}
+
+unsigned int AsyncFile::inFlight() const {
+  return queueDepth - numFree;
+}
+
+bool AsyncFile::usingIoUring() const {
+  return ring >= 0;
+}
+
+void AsyncFile::workerLoop() {
+  unique_lock<mutex> guard(lock);
+  while (true) {
+    wakeWorker.wait(guard, [&] { return numQueued > 0 || stopping; });
+    if (numQueued == 0) {
+      return;
+    }
+    unsigned int slot = queued[queuedHead];
+    queuedHead = (queuedHead + 1) % queueDepth;
+    numQueued--;
+
+    guard.unlock();
+    Request& request = requests[slot];
+    while (request.done < request.length) {
+      char *at = request.buffer + request.done;
+      size_t left = request.length - request.done;
+      off_t offset = request.offset + request.done;
+      ssize_t moved = request.write ? pwrite(fd, at, left, offset) : pread(fd, at, left, offset);
+      if (moved < 0 && errno == EINTR) {
+        continue;
+      }
+      if (moved < 0 || (moved == 0 && request.write)) {
+        request.error = (moved < 0) ? errno : EIO;
+        break;
+      }
+      if (moved == 0) {
+        break;
+      }
+      request.done += moved;
+    }
+    guard.lock();
+
+    done[(doneHead + numDone++) % queueDepth] = slot;
+    finished.notify_one();
+  }
+}
+
+
+class SnapshotWriter {
+public:
+  // creates (or empties) the file at path for the snapshot
+  SnapshotWriter(const string& path, bool direct = false, unsigned int queueDepth = 8,
+                 bool useThreads = false, unsigned int maxBacklog = 64);
+
+  // finishes the snapshot unless finish() was called
+  ~SnapshotWriter();
+
+  SnapshotWriter(const SnapshotWriter& copy) = delete;
+  SnapshotWriter& operator=(const SnapshotWriter& rhs) = delete;
+
+  // adds the bytes to the snapshot, only waiting for the disk when more
+  // than maxBacklog full chunks are already queued; does nothing once
+  // the snapshot has failed
+  void append(const void* bytes, size_t length);
+
+  // writes what is left, waits until all of it is in the file and syncs
+  // the file; returns false if the file could not be created or written
+  bool finish();
+
+  // the # of bytes appended, the size of the snapshot once finished
+  unsigned long long size() const;
+
+  // the errno of the first failure, or 0 if there was none
+  int error() const;
+
+  bool usingIoUring() const;
+
+private:
+  struct FullChunk {
+    char *buffer;
+    size_t length;
+    unsigned long long offset;
+  };
+
+  int fd;
+  bool direct;
+  bool finished;
+  bool ioUring;
+  int firstError;
+  unsigned int queueDepth;
+  unsigned int maxBacklog;
+  unique_ptr<AsyncFile> io;
+
+  char *chunk;                    // the chunk being filled
+  size_t used;                    // # of bytes of it filled
+  unsigned long long offset;      // where in the file it goes
+
+  // full chunks waiting for a free request slot, from backlog[backlogHead] on
+  vector<FullChunk> backlog;
+  unsigned int backlogHead;
+
+  // written chunks kept for reuse
+  vector<char*> spare;
+
+  // takes back the chunks that were written, waiting for one if wait is
+  // true and any are in flight, then starts queued chunks while there are
+  // free request slots (or, after a failure, drops them)
+  void reap(bool wait);
+
+  // keeps a chunk that is done with for reuse
+  void keepSpare(char* buffer);
+
+  // queues the chunk being filled, to be written as length bytes (at
+  // least used), and starts a fresh one
+  void push(size_t length);
+};
+
+// a chunk of SNAPSHOT_CHUNK bytes at an address suitable for O_DIRECT
+inline char* newSnapshotChunk(size_t size = SNAPSHOT_CHUNK) {
+  void *memory = aligned_alloc(SNAPSHOT_ALIGN, size);
+  assert(memory != NULL);
+  return (char*) memory;
+}
+
+SnapshotWriter::SnapshotWriter(const string& path, bool direct, unsigned int queueDepth,
+                               bool useThreads, unsigned int maxBacklog) {
+  fd = -1;
+  if (direct) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+  }
+  if (fd < 0) {
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    direct = false;
+  }
+
+  this->direct = direct;
+  this->queueDepth = queueDepth;
+  this->maxBacklog = maxBacklog;
+  finished = false;
+  firstError = 0;
+  ioUring = false;
+  if (fd < 0) {
+    firstError = errno;
+  }
+  else {
+    io.reset(new AsyncFile(fd, queueDepth, useThreads));
+    ioUring = io->usingIoUring();
+  }
+  chunk = newSnapshotChunk();
+  used = 0;
+  offset = 0;
+  backlogHead = 0;
+}
+
+SnapshotWriter::~SnapshotWriter() {
+  if (!finished) {
+    finish();
+  }
+}
+
+void SnapshotWriter::reap(bool wait) {
+  size_t length;
+  int error;
+  char *written;
+  while ((written = io->complete(length, error, wait)) != NULL) {
+    if (error != 0 && firstError == 0) {
+      firstError = error;
+    }
+    keepSpare(written);
+    wait = false;
+  }
+
+  while (backlogHead < backlog.size() && (firstError != 0 || io->inFlight() < queueDepth)) {
+    FullChunk& next = backlog[backlogHead++];
+    if (firstError != 0) {
+      keepSpare(next.buffer);
+    }
+    else {
+      io->submit(true, next.buffer, next.length, next.offset);
+    }
+  }
+  if (backlogHead == backlog.size()) {
+    backlog.clear();
+    backlogHead = 0;
+  }
+}
+
+void SnapshotWriter::keepSpare(char* buffer) {
+  spare.push_back(buffer);
+}
+
+void SnapshotWriter::push(size_t length) {
+  backlog.push_back({chunk, length, offset});
+  offset += used;
+  reap(false);
+
+  // every request slot is busy while chunks are queued, so each wait
+  // frees a slot for the oldest of them
+  while (maxBacklog != 0 && backlog.size() - backlogHead > maxBacklog) {
+    reap(true);
+  }
+
+  if (spare.empty()) {
+    chunk = newSnapshotChunk();
+  }
+  else {
+    chunk = spare.back();
+    spare.pop_back();
+  }
+  used = 0;
+}
+
+void SnapshotWriter::append(const void* bytes, size_t length) {
+  assert(!finished);
+  const char *from = (const char*) bytes;
+  while (length > 0 && firstError == 0) {
+    size_t part = min(length, SNAPSHOT_CHUNK - used);
+    memcpy(chunk + used, from, part);
+    used += part;
+    from += part;
+    length -= part;
+    if (used == SNAPSHOT_CHUNK) {
+      push(SNAPSHOT_CHUNK);
+    }
+  }
+}
+
+bool SnapshotWriter::finish() {
+  assert(!finished);
+  unsigned long long size = offset + used;
+
+  if (fd >= 0) {
+    // O_DIRECT writes whole blocks, the padding is cut off again below
+    if (used > 0 && firstError == 0) {
+      size_t length = used;
+      if (direct) {
+        length = (used + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+        memset(chunk + used, 0, length - used);
+      }
+      push(length);
+    }
+    while (!backlog.empty() || io->inFlight() > 0) {
+      reap(true);
+    }
+    io.reset();
+
+    if (firstError == 0 && direct && size % SNAPSHOT_ALIGN != 0 && ftruncate(fd, size) != 0) {
+      firstError = errno;
+    }
+    if (firstError == 0 && fdatasync(fd) != 0) {
+      firstError = errno;
+    }
+    close(fd);
+  }
+
+  free(chunk);
+  for (unsigned int i = 0; i < spare.size(); i++) {
+    free(spare[i]);
+  }
+  finished = true;
+  return firstError == 0;
+}
+
+unsigned long long SnapshotWriter::size() const {
+  return offset + used;
+}
+
+int SnapshotWriter::error() const {
+  return firstError;
+}
+
+bool SnapshotWriter::usingIoUring() const {
+  return ioUring;
+}
+
+
+class SnapshotReader {
+public:
+  // opens the snapshot at path and starts reading its first chunks
+  SnapshotReader(const string& path, bool direct = false, unsigned int queueDepth = 8,
+                 bool useThreads = false);
+
+  // waits for the reads in flight and closes the file
+  ~SnapshotReader();
+
+  SnapshotReader(const SnapshotReader& copy) = delete;
+  SnapshotReader& operator=(const SnapshotReader& rhs) = delete;
+
+  // copies the next length bytes of the snapshot into bytes; returns
+  // false, copying nothing, if fewer than that are left, and also if the
+  // file could not be opened or read (which no later read gets past)
+  bool read(void* bytes, size_t length);
+
+  // the size of the snapshot in bytes
+  unsigned long long size() const;
+
+  // the errno of the first failure, or 0 if there was none
+  int error() const;
+
+  bool usingIoUring() const;
+
+private:
+  int fd;
+  int firstError;
+  unsigned long long fileSize;
+  unsigned long long numChunks;
+  unsigned int queueDepth;
+  unique_ptr<AsyncFile> io;
+
+  // chunk c is read into the (c % queueDepth)-th SNAPSHOT_CHUNK bytes
+  // of buffers, ready says which of those hold their chunk
+  char *buffers;
+  bool *ready;
+
+  unsigned long long current;   // the chunk being consumed
+  size_t at;                    // # of its bytes consumed
+  unsigned long long position;  // # of bytes of the file consumed
+
+  // starts reading chunk c into its buffer
+  void startRead(unsigned long long c);
+};
+
+SnapshotReader::SnapshotReader(const string& path, bool direct, unsigned int queueDepth,
+                               bool useThreads) {
+  fd = -1;
+  if (direct) {
+    fd = open(path.c_str(), O_RDONLY | O_DIRECT);
+  }
+  if (fd < 0) {
+    fd = open(path.c_str(), O_RDONLY);
+  }
+  firstError = 0;
+  fileSize = 0;
+  if (fd < 0) {
+    firstError = errno;
+  }
+  else {
+    struct stat info;
+    fstat(fd, &info);
+    fileSize = info.st_size;
+  }
+  numChunks = (fileSize + SNAPSHOT_CHUNK - 1) / SNAPSHOT_CHUNK;
+
+  this->queueDepth = queueDepth;
+  io.reset(new AsyncFile(fd, queueDepth, useThreads));
+  buffers = newSnapshotChunk((size_t) queueDepth * SNAPSHOT_CHUNK);
+  ready = new bool[queueDepth];
+  for (unsigned int i = 0; i < queueDepth; i++) {
+    ready[i] = false;
+  }
+  current = 0;
+  at = 0;
+  position = 0;
+  for (unsigned long long c = 0; c < min(numChunks, (unsigned long long) queueDepth); c++) {
+    startRead(c);
+  }
+}
+
+SnapshotReader::~SnapshotReader() {
+  io.reset();
+  free(buffers);
+  delete[] ready;
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
+void SnapshotReader::startRead(unsigned long long c) {
+  // always a whole chunk, so O_DIRECT reads stay aligned at the end
+  io->submit(false, buffers + (c % queueDepth) * SNAPSHOT_CHUNK, SNAPSHOT_CHUNK,
+             c * SNAPSHOT_CHUNK);
+}
+
+bool SnapshotReader::read(void* bytes, size_t length) {
+  if (firstError != 0 || length > fileSize - position) {
+    return false;
+  }
+  position += length;
+
+  char *to = (char*) bytes;
+  while (length > 0) {
+    unsigned int slot = current % queueDepth;
+    size_t chunkLength = min((unsigned long long) SNAPSHOT_CHUNK,
+                             fileSize - current * SNAPSHOT_CHUNK);
+    while (!ready[slot]) {
+      size_t moved;
+      int error;
+      char *filled = io->complete(moved, error);
+      unsigned int filledSlot = (filled - buffers) / SNAPSHOT_CHUNK;
+      ready[filledSlot] = true;
+
+      // the file must not shrink while it is read
+      unsigned long long c = current + (filledSlot + queueDepth - slot) % queueDepth;
+      if (error == 0 && moved < min((unsigned long long) SNAPSHOT_CHUNK,
+                                    fileSize - c * SNAPSHOT_CHUNK)) {
+        error = EIO;
+      }
+      if (error != 0) {
+        firstError = error;
+        return false;
+      }
+    }
+
+    size_t part = min(length, chunkLength - at);
+    memcpy(to, buffers + (size_t) slot * SNAPSHOT_CHUNK + at, part);
+    to += part;
+    length -= part;
+    at += part;
+
+    // done with this chunk, its buffer moves on to the chunk queueDepth on
+    if (at == chunkLength) {
+      ready[slot] = false;
+      if (current + queueDepth < numChunks) {
+        startRead(current + queueDepth);
+      }
+      current++;
+      at = 0;
+    }
+  }
+  return true;
+}
+
+unsigned long long SnapshotReader::size() const {
+  return fileSize;
+}
+
+int SnapshotReader::error() const {
+  return firstError;
+}
+
+bool SnapshotReader::usingIoUring() const {
+  return io->usingIoUring();
+}
+
+// captures the entries of the tree into the snapshot, as their count and
+// then the length of each key, the key and the raw bytes of its item;
+// the tree can be changed again as soon as this returns, out.finish()
+// waits for the disk
+template <typename T>
+void saveSnapshot(const AVLMap<string, T>& tree, SnapshotWriter& out) {
+  static_assert(is_trivially_copyable<T>::value, "snapshots store items as raw bytes");
+  unsigned long long count = tree.size();
+  out.append(&count, sizeof(count));
+  for (AVLIterator<string, T> iter = tree.begin(); iter != tree.end(); ++iter) {
+    unsigned int length = iter.key().size();
+    out.append(&length, sizeof(length));
+    out.append(iter.key().data(), length);
+    out.append(&iter.item(), sizeof(T));
+  }
+}
+
+// replaces the contents of the tree with a snapshot written by
+// saveSnapshot, inserting each entry while the chunks after it are still
+// being read; returns false if the file could not be read or is not a
+// snapshot of T items, leaving the tree as it was unless the failure
+// came part way through, which leaves it empty
+template <typename T>
+bool loadSnapshot(SnapshotReader& in, AVLMap<string, T>& tree) {
+  static_assert(is_trivially_copyable<T>::value, "snapshots store items as raw bytes");
+  unsigned long long count;
+  // every entry takes at least its key length and item
+  if (!in.read(&count, sizeof(count)) ||
+      count > (in.size() - sizeof(count)) / (sizeof(unsigned int) + sizeof(T))) {
+    return false;
+  }
+
+  tree.clear();
+  string key;
+  for (unsigned long long i = 0; i < count; i++) {
+    unsigned int length;
+    T item;
+    bool read = in.read(&length, sizeof(length)) && length <= in.size();
+    if (read) {
+      key.resize(length);
+      read = in.read(&key[0], length) && in.read(&item, sizeof(T));
+    }
+    if (!read) {
+      tree.clear();
+      return false;
+    }
+    tree.update(key, item);
+  }
+  return true;
+}
+
+
+/*
+  A server for the commands of main (S, U, F, R, P and Q) over a Unix
+  domain socket, plus a load generator to measure it.
+
+  The entries are split between shards by a hash of the key, one
+  AVLMap with its own lock per shard. The server runs one epoll event
+  loop per thread, and a shard per thread by default. Every loop waits
+  on the listening socket (with EPOLLEXCLUSIVE, so a new client wakes
+  only one of them) and owns the connections it accepts. Nothing about
+  a connection is shared between threads, only the shards are.
+
+  Requests are one per line and may be pipelined. Each wakeup takes in
+  what a client has sent, up to RECEIVE_LIMIT bytes so that one busy
+  client cannot starve the others on its loop. Every complete line is
+  run, and the responses go back in a single send. Each request is answered with one line, the
+  one main would print, or "OK" where main prints nothing. P is the
+  exception: a line with the # of entries, then a line per entry. Blank
+  lines get no answer, and Q answers "stopping" and closes the
+  connection.
+*/
+
+class KVServer {
+public:
+  // listens on a Unix domain socket at path, replacing a socket left
+  // there (but no other kind of file), with numThreads event loops and
+  // numShards shards (0 for one per loop)
+  KVServer(const string& path, unsigned int numThreads, unsigned int numShards = 0);
+
+  // closes the socket and removes its file
+  ~KVServer();
+
+  KVServer(const KVServer& copy) = delete;
+  KVServer& operator=(const KVServer& rhs) = delete;
+
+  // serves clients until stop() is called
+  void run();
+
+  // makes run() close every connection and return, safe to call from
+  // any thread
+  void stop();
+
+  // the errno of a failure to set up the socket, or 0; after one, run()
+  // returns at once
+  int error() const;
+
+private:
+  struct Shard {
+    mutex lock;
+    AVLMap<string, int> entries;
+  };
+
+  struct Connection {
+    int fd;
+    unsigned int index;   // in the connections of its event loop
+    string in;            // received bytes not yet run
+    string out;           // responses not yet sent
+    size_t sent;          // # of bytes of out sent
+    bool closing;         // close once out is sent
+    bool waitingToSend;   // registered for EPOLLOUT
+  };
+
+  // the most bytes taken in from one client per wakeup
+  static const size_t RECEIVE_LIMIT = 256 * 1024;
+
+  string path;
+  int listener;
+  int wakeup;   // eventfd signalled by stop()
+  int setupError;
+  unsigned int numThreads, numShards;
+  unique_ptr<Shard[]> shards;
+
+  Shard& shardOf(const string& key);
+
+  // body of each event loop thread
+  void eventLoop();
+
+  // takes in what the client sent, up to RECEIVE_LIMIT bytes, and runs
+  // its complete requests; returns false if the connection failed
+  bool receive(Connection& conn);
+
+  // sends as much of the pending responses as the socket takes; returns
+  // false once the connection should be closed
+  bool send(Connection& conn);
+
+  // runs one request line, appending its response to out; returns false
+  // for Q
+  bool execute(string_view line, string& out);
+};
+
+KVServer::KVServer(const string& path, unsigned int numThreads, unsigned int numShards) {
+  assert(numThreads > 0);
+  this->path = path;
+  this->numThreads = numThreads;
+  this->numShards = (numShards > 0) ? numShards : numThreads;
+  shards.reset(new Shard[this->numShards]);
+
+  setupError = 0;
+  listener = -1;
+  wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (wakeup < 0) {
+    setupError = errno;
+    return;
+  }
+
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    setupError = ENAMETOOLONG;
+    return;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size());
+
+  // a socket there is left from an earlier server, anything else is not
+  // ours to remove and makes bind fail
+  struct stat info;
+  if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+    unlink(path.c_str());
+  }
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  bool bound = listener >= 0 && bind(listener, (sockaddr*) &address, sizeof(address)) == 0;
+  if (!bound || listen(listener, SOMAXCONN) != 0) {
+    setupError = errno;
+    if (bound) {
+      unlink(path.c_str());
+    }
+    if (listener >= 0) {
+      close(listener);
+    }
+    listener = -1;
+  }
+}
+
+KVServer::~KVServer() {
+  if (wakeup >= 0) {
+    close(wakeup);
+  }
+  if (listener >= 0) {
+    close(listener);
+    unlink(path.c_str());
+  }
+}
+
+void KVServer::run() {
+  if (setupError != 0) {
+    return;
+  }
+  vector<thread> loops;
+  for (unsigned int i = 1; i < numThreads; i++) {
+    loops.push_back(thread(&KVServer::eventLoop, this));
+  }
+  eventLoop();
+  for (unsigned int i = 0; i < loops.size(); i++) {
+    loops[i].join();
+  }
+
+  // ready to run() again
+  eventfd_t count;
+  eventfd_read(wakeup, &count);
+}
+
+void KVServer::stop() {
+  // never read until every loop is done, so every loop sees it
+  eventfd_write(wakeup, 1);
+}
+
+int KVServer::error() const {
+  return setupError;
+}
+
+KVServer::Shard& KVServer::shardOf(const string& key) {
+  return shards[hashKey(key) % numShards];
+}
+
+void KVServer::eventLoop() {
+  int epoll = epoll_create1(EPOLL_CLOEXEC);
+  assert(epoll >= 0);
+
+  // the listener and the wakeup are told apart from connections by
+  // pointing at their descriptors
+  epoll_event event;
+  event.events = EPOLLIN | EPOLLEXCLUSIVE;
+  event.data.ptr = &listener;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, listener, &event);
+  event.events = EPOLLIN;
+  event.data.ptr = &wakeup;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, wakeup, &event);
+
+  vector<Connection*> connections;
+  auto drop = [&](Connection* conn) {
+    close(conn->fd);
+    connections[conn->index] = connections.back();
+    connections[conn->index]->index = conn->index;
+    connections.pop_back();
+    delete conn;
+  };
+
+  const int MAX_EVENTS = 64;
+  epoll_event events[MAX_EVENTS];
+  bool stopping = false;
+  while (!stopping) {
+    int numEvents = epoll_wait(epoll, events, MAX_EVENTS, -1);
+    if (numEvents < 0) {
+      assert(errno == EINTR);
+      continue;
+    }
+
+    for (int e = 0; e < numEvents; e++) {
+      if (events[e].data.ptr == &wakeup) {
+        stopping = true;
+        continue;
+      }
+      if (events[e].data.ptr == &listener) {
+        int fd;
+        while ((fd = accept4(listener, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+          Connection *conn = new Connection{fd, (unsigned int) connections.size(), "", "", 0,
+                                            false, false};
+          connections.push_back(conn);
+          event.events = EPOLLIN | EPOLLRDHUP;
+          event.data.ptr = conn;
+          epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &event);
+        }
+        continue;
+      }
+
+      Connection *conn = (Connection*) events[e].data.ptr;
+      bool open = true;
+      if (events[e].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        open = receive(*conn);
+      }
+      open = open && send(*conn);
+      if (!open) {
+        drop(conn);
+        continue;
+      }
+
+      // only wait for room to send while responses are held up
+      bool waitToSend = conn->sent < conn->out.size();
+      if (waitToSend != conn->waitingToSend) {
+        conn->waitingToSend = waitToSend;
+        event.events = waitToSend ? EPOLLOUT : EPOLLIN | EPOLLRDHUP;
+        event.data.ptr = conn;
+        epoll_ctl(epoll, EPOLL_CTL_MOD, conn->fd, &event);
+      }
+    }
+  }
+
+  while (!connections.empty()) {
+    drop(connections.back());
+  }
+  close(epoll);
+}
+
+bool KVServer::receive(Connection& conn) {
+  // anything left over is still readable, so the loop comes back for it
+  // once the other clients woken with this one have had their turn
+  char buffer[64 * 1024];
+  size_t received = 0;
+  while (!conn.closing && received < RECEIVE_LIMIT) {
+    ssize_t got = recv(conn.fd, buffer, sizeof(buffer), 0);
+    if (got > 0) {
+      conn.in.append(buffer, got);
+      received += got;
+      continue;
+    }
+    if (got == 0) {
+      // the client is done sending, but still gets its answers
+      conn.closing = true;
+    }
+    else if (errno == EINTR) {
+      continue;
+    }
+    else if (errno != EAGAIN) {
+      return false;
+    }
+    break;
+  }
+
+  size_t start = 0;
+  while (true) {
+    const char *lineEnd = (const char*) memchr(conn.in.data() + start, '\n',
+                                               conn.in.size() - start);
+    if (lineEnd == NULL) {
+      break;
+    }
+    size_t length = lineEnd - (conn.in.data() + start);
+    bool more = execute(string_view(conn.in.data() + start, length), conn.out);
+    start += length + 1;
+    if (!more) {
+      conn.closing = true;
+      start = conn.in.size();
+      break;
+    }
+  }
+  conn.in.erase(0, start);
+  return true;
+}
+
+bool KVServer::send(Connection& conn) {
+  while (conn.sent < conn.out.size()) {
+    ssize_t put = ::send(conn.fd, conn.out.data() + conn.sent, conn.out.size() - conn.sent,
+                         MSG_NOSIGNAL);
+    if (put >= 0) {
+      conn.sent += put;
+    }
+    else if (errno == EAGAIN) {
+      return true;
+    }
+    else if (errno != EINTR) {
+      return false;
+    }
+  }
+  conn.out.clear();
+  conn.sent = 0;
+  return !conn.closing;
+}
+
+bool KVServer::execute(string_view line, string& out) {
+  // the command and up to two arguments, separated by blanks
+  string_view words[3];
+  unsigned int numWords = 0;
+  size_t at = 0;
+  while (numWords < 3) {
+    at = line.find_first_not_of(" \t\r", at);
+    if (at == string_view::npos) {
+      break;
+    }
+    size_t end = min(line.find_first_of(" \t\r", at), line.size());
+    words[numWords++] = line.substr(at, end - at);
+    at = end;
+  }
+  if (numWords == 0) {
+    return true;
+  }
+
+  char number[16];
+  auto appendNumber = [&](long long value) {
+    out.append(number, to_chars(number, number + sizeof(number), value).ptr - number);
+  };
+
+  char cmd = (words[0].size() == 1) ? words[0][0] : '\0';
+  int grade;
+  if (cmd == 'S') {
+    unsigned long long size = 0;
+    for (unsigned int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].lock);
+      size += shards[i].entries.size();
+    }
+    appendNumber(size);
+    out += '\n';
+  }
+  else if (cmd == 'U' && numWords == 3 &&
+           from_chars(words[2].data(), words[2].data() + words[2].size(), grade).ec == errc()) {
+    string name(words[1]);
+    Shard& shard = shardOf(name);
+    {
+      lock_guard<mutex> guard(shard.lock);
+      shard.entries.update(name, grade);
+    }
+    out += "OK\n";
+  }
+  else if (cmd == 'F' && numWords >= 2) {
+    string name(words[1]);
+    Shard& shard = shardOf(name);
+    bool found;
+    {
+      lock_guard<mutex> guard(shard.lock);
+      int *item = shard.entries.lookup(name);
+      found = (item != NULL);
+      if (found) {
+        grade = *item;
+      }
+    }
+    out += name;
+    if (found) {
+      out += " found with grade ";
+      appendNumber(grade);
+      out += '\n';
+    }
+    else {
+      out += " not found\n";
+    }
+  }
+  else if (cmd == 'R' && numWords >= 2) {
+    string name(words[1]);
+    Shard& shard = shardOf(name);
+    bool found;
+    {
+      lock_guard<mutex> guard(shard.lock);
+      found = shard.entries.hasKey(name);
+      if (found) {
+        shard.entries.remove(name);
+      }
+    }
+    out += found ? "OK\n" : name + " not found\n";
+  }
+  else if (cmd == 'P') {
+    // each shard is in key order, the union is sorted after the fact
+    vector<pair<string, int> > all;
+    for (unsigned int i = 0; i < numShards; i++) {
+      lock_guard<mutex> guard(shards[i].lock);
+      for (AVLIterator<string, int> iter = shards[i].entries.begin();
+           iter != shards[i].entries.end(); ++iter) {
+        all.push_back(make_pair(iter.key(), iter.item()));
+      }
+    }
+    sort(all.begin(), all.end());
+    appendNumber(all.size());
+    out += '\n';
+    for (unsigned int i = 0; i < all.size(); i++) {
+      out += " - ";
+      out += all[i].first;
+      out += ' ';
+      appendNumber(all[i].second);
+      out += '\n';
+    }
+  }
+  else if (cmd == 'Q') {
+    out += "stopping\n";
+    return false;
+  }
+  else {
+    out += "invalid command\n";
+  }
+  return true;
+}
+
+// connects to the Unix domain socket at path, returns the descriptor or
+// -1 if there is no server to connect to
+int connectUnix(const string& path) {
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  memcpy(address.sun_path, path.c_str(), path.size());
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect(fd, (sockaddr*) &address, sizeof(address)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+// sends all the bytes, returns false if the connection failed
+bool sendAll(int fd, const string& bytes) {
+  for (size_t sent = 0; sent < bytes.size(); ) {
+    ssize_t put = send(fd, bytes.data() + sent, bytes.size() - sent, MSG_NOSIGNAL);
+    if (put < 0 && errno != EINTR) {
+      return false;
+    }
+    sent += max(put, (ssize_t) 0);
+  }
+  return true;
+}
+
+/*
+  Measures a KVServer: after storing numKeys keys, numClients threads
+  each send requestsPerClient requests over their own connection (90%
+  F and 10% U of random keys), keeping up to depth of them in flight.
+  Prints the requests per second and percentiles of the time from
+  sending a request to reading its answer, or an error if the server
+  could not be reached or dropped a connection.
+*/
+void runLoadGenerator(const string& path, unsigned int numClients, unsigned int depth,
+                      unsigned int requestsPerClient, unsigned int numKeys = 100000) {
+  assert(numClients > 0 && depth > 0 && requestsPerClient > 0);
+
+  // store the keys, a pipelined batch at a time so neither side's socket
+  // buffer fills up while the other is not reading
+  {
+    int fd = connectUnix(path);
+    if (fd < 0) {
+      cout << "could not connect to " << path << ": " << strerror(errno) << endl;
+      return;
+    }
+    const unsigned int BATCH = 1000;
+    char buffer[64 * 1024];
+    bool connected = true;
+    for (unsigned int first = 0; first < numKeys && connected; first += BATCH) {
+      unsigned int n = min(BATCH, numKeys - first);
+      string requests;
+      for (unsigned int k = first; k < first + n; k++) {
+        requests += "U student" + to_string(k) + " " + to_string(k % 101) + "\n";
+      }
+      connected = sendAll(fd, requests);
+      for (unsigned int answered = 0; answered < n && connected; ) {
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        connected = got > 0;
+        answered += count(buffer, buffer + max(got, (ssize_t) 0), '\n');
+      }
+    }
+    close(fd);
+    if (!connected) {
+      cout << "lost the connection to " << path << endl;
+      return;
+    }
+  }
+
+  typedef chrono::steady_clock Clock;
+  vector<vector<double> > latencies(numClients);
+  vector<thread> clients;
+  Clock::time_point start = Clock::now();
+  for (unsigned int c = 0; c < numClients; c++) {
+    clients.push_back(thread([&, c] {
+      int fd = connectUnix(path);
+      if (fd < 0) {
+        return;
+      }
+      unsigned int seed = c + 1;
+      vector<Clock::time_point> sentAt(depth);   // of request i at i % depth
+      latencies[c].reserve(requestsPerClient);
+
+      unsigned int numSent = 0, numAnswered = 0;
+      string requests;
+      char buffer[64 * 1024];
+      while (numAnswered < requestsPerClient) {
+        // top up the requests in flight
+        requests.clear();
+        Clock::time_point now = Clock::now();
+        for (; numSent < requestsPerClient && numSent - numAnswered < depth; numSent++) {
+          unsigned int key = rand_r(&seed) % numKeys;
+          if (rand_r(&seed) % 10 == 0) {
+            requests += "U student" + to_string(key) + " " +
+                        to_string(rand_r(&seed) % 101) + "\n";
+          }
+          else {
+            requests += "F student" + to_string(key) + "\n";
+          }
+          sentAt[numSent % depth] = now;
+        }
+        if (!sendAll(fd, requests)) {
+          break;
+        }
+
+        // every answer is one line
+        ssize_t got = recv(fd, buffer, sizeof(buffer), 0);
+        if (got <= 0) {
+          break;
+        }
+        now = Clock::now();
+        const char *at = buffer;
+        while ((at = (const char*) memchr(at, '\n', buffer + got - at)) != NULL) {
+          chrono::duration<double, micro> latency = now - sentAt[numAnswered % depth];
+          latencies[c].push_back(latency.count());
+          numAnswered++;
+          at++;
+        }
+      }
+      close(fd);
+    }));
+  }
+  for (unsigned int c = 0; c < numClients; c++) {
+    clients[c].join();
+  }
+  double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+  vector<double> all;
+  for (unsigned int c = 0; c < numClients; c++) {
+    all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+  }
+  // a client that stopped short lost its connection
+  if (all.size() < (size_t) numClients * requestsPerClient) {
+    cout << "lost the connection to " << path << endl;
+    return;
+  }
+  sort(all.begin(), all.end());
+  auto percentile = [&](double p) { return all[min((size_t) (p * all.size()), all.size() - 1)]; };
+  cout << numClients << " clients, " << depth << " in flight each: "
+       << (unsigned long long) (all.size() / seconds) << " requests/s, latency p50 "
+       << percentile(0.5) << " us, p99 " << percentile(0.99) << " us, p99.9 "
+       << percentile(0.999) << " us" << endl;
+}
+
+
+// examples and checks of the other containers in this file
+void runDemos() {
+  cout << "Keying an AVLMap on interned names" << endl;
+  {
+    StringInterner names;
+    AVLMap<InternedString, int> grades;
+    const char* students[] = {"Zac", "Omid", "Alexa", "Siri", "Zac", ""};
+    for (unsigned int i = 0; i < 6; i++) {
+      // interning a name twice gives the same handle, so "Zac" is updated
+      grades.update(names.intern(students[i]), 50 + i);
+    }
+    assert(names.size() == 5 && grades.size() == 5);
+    assert(grades.at(names.intern("Zac")) == 54);
+    assert(names.find("Bob") == StringInterner::NOT_FOUND);
+
+    // ordered by id, i.e. by when each name was first interned
+    for (AVLIterator<InternedString, int> iter = grades.begin(); iter != grades.end(); ++iter) {
+      cout << " - \"" << names.str(iter.key()) << "\" " << iter.item() << endl;
+    }
+  }
+  cout << endl;
+
+  cout << "Counting words with an AVLMultiset" << endl;
+  {
+    AVLMultiset<string> words;
+    string text[] = {"to", "be", "or", "not", "to", "be", "that", "is", "the", "question"};
+    words.addBatch(text, 10);
+    words.add("be", 3);
+    words.add("xyz", 0);
+    assert(words.count("to") == 2 && words.count("be") == 5 && words.count("xyz") == 0);
+    assert(words.size() == 8 && words.total() == 13);
+
+    words.remove("be", 4);
+    words.remove("or");
+    assert(words.count("be") == 1 && words.count("or") == 0);
+    assert(words.size() == 7 && words.total() == 8);
+
+    // one entry per distinct word, in order, with its count as the item
+    string previous;
+    for (AVLIterator<string, unsigned int> iter = words.begin(); iter != words.end(); ++iter) {
+      assert(previous < iter.key());
+      previous = iter.key();
+      cout << " - " << iter.key() << ' ' << iter.item() << endl;
+    }
+  }
+  cout << endl;
+
+  cout << "Storing keys in an LSMStore" << endl;
+  {
+    char dir[] = "/tmp/lsm-demoXXXXXX";
+    assert(mkdtemp(dir) != NULL);
+
+    {
+      // a small memtable so the keys end up spread over several runs
+      LSMStore store(dir, 64);
+      for (int i = 0; i < 1000; i++) {
+        store.update("key" + to_string(1000 + i), i);
+      }
+      for (int i = 0; i < 1000; i += 3) {
+        store.remove("key" + to_string(1000 + i));
+      }
+      store.update("key1500", -1);
+    }
+
+    {
+      // everything has to come back from the runs named in the MANIFEST
+      LSMStore store(dir, 64);
+      int item;
+      assert(store.get("key1001", item) && item == 1);
+      assert(store.get("key1500", item) && item == -1);
+      assert(!store.hasKey("key1000") && !store.hasKey("key1999") && !store.hasKey("nope"));
+      (void) item;
+
+      unsigned int numKeys = 0;
+      string previous;
+      store.scan("key1100", "key1200", [&](const string& key, int item) {
+        assert(previous < key && key >= "key1100" && key < "key1200");
+        assert(item % 3 != 0);
+        (void) item;
+        previous = key;
+        numKeys++;
+      });
+      assert(numKeys == 67);
+      cout << " - " << numKeys << " keys in [key1100, key1200)" << endl;
+    }
+
+    // the store has let go of its runs, clear out the directory
+    DIR* entries = opendir(dir);
+    assert(entries != NULL);
+    for (dirent* entry = readdir(entries); entry != NULL; entry = readdir(entries)) {
+      if (entry->d_name[0] != '.') {
+        unlink((string(dir) + "/" + entry->d_name).c_str());
+      }
+    }
+    closedir(entries);
+    assert(rmdir(dir) == 0);
+  }
+  cout << endl;
+
+  cout << "Logging an AVLMap's mutations" << endl;
+  {
+    char path[] = "/tmp/wal-demoXXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+
+    {
+      LoggedAVLMap accounts(path, WAL_SYNC);
+      accounts.update("alice", 100);
+      accounts.update("bob", 50);
+      accounts.update("carol", 75);
+      accounts.checkpoint();
+      accounts.update("alice", 120);
+      accounts.remove("bob");
+    }
+
+    {
+      // the checkpoint plus the two records logged after it
+      LoggedAVLMap accounts(path, WAL_SYNC);
+      assert(accounts.map().size() == 2 && !accounts.map().hasKey("bob"));
+      assert(accounts.map().at("alice") == 120 && accounts.map().at("carol") == 75);
+      cout << " - alice " << accounts.map().at("alice") << ", carol "
+           << accounts.map().at("carol") << endl;
+    }
+
+    {
+      // a crash can leave the file longer than what was written, with
+      // zeros in the gap; they must read as the end of the log
+      char zeros[4096] = {};
+      ofstream(path, ios::binary | ios::app).write(zeros, sizeof(zeros));
+
+      LoggedAVLMap accounts(path, WAL_SYNC);
+      assert(!accounts.failed() && accounts.map().size() == 2);
+      assert(accounts.update("dave", 10));
+    }
+    {
+      LoggedAVLMap accounts(path, WAL_SYNC);
+      assert(accounts.map().size() == 3 && accounts.map().at("dave") == 10);
+    }
+
+    {
+      // only what is appended after a reset survives it
+      WriteAheadLog log(path, WAL_PERIODIC);
+      log.append("before");
+      log.reset();
+      log.append("after");
+    }
+    vector<string> records;
+    WriteAheadLog::replay(path, [&](const string& record) {
+      records.push_back(record);
+      return true;
+    });
+    assert(records.size() == 1 && records[0] == "after");
+
+    unlink(path);
+  }
+  cout << endl;
+
+  cout << "Churning a WAVL-balanced AVLMap" << endl;
+  {
+    // as many removals as updates, checked against a plain array of items
+    // where -1 marks a missing key
+    const unsigned int NUM_KEYS = 2000;
+    AVLMap<int, int, WAVLBalance> map;
+    vector<int> expected(NUM_KEYS, -1);
+    unsigned int seed = 1;
+    for (unsigned int i = 0; i < 100000; i++) {
+      int key = rand_r(&seed) % NUM_KEYS;
+      if (rand_r(&seed) % 2 == 0) {
+        map.update(key, i);
+        expected[key] = i;
+      }
+      else if (expected[key] != -1) {
+        map.remove(key);
+        expected[key] = -1;
+      }
+    }
+
+    unsigned int numKeys = 0;
+    for (int key = 0; key < (int) NUM_KEYS; key++) {
+      assert(map.hasKey(key) == (expected[key] != -1));
+      if (expected[key] != -1) {
+        assert(map.at(key) == expected[key]);
+        numKeys++;
+      }
+    }
+    assert(map.size() == numKeys);
+
+    int previous = -1;
+    for (AVLIterator<int, int> iter = map.begin(); iter != map.end(); ++iter) {
+      assert(previous < iter.key());
+      previous = iter.key();
+    }
+    (void) previous;
+    cout << " - " << map.size() << " keys left after 100000 operations" << endl;
+  }
+  cout << endl;
+
+  cout << "Looking up a batch of keys at once" << endl;
+  {
+    AVLMap<int, int> squares;
+    for (int i = 0; i < 10000; i += 2) {
+      squares.update(i, i * i);
+    }
+
+    // every other key is missing, and some keys repeat
+    const unsigned int NUM_KEYS = 1000;
+    vector<int> keys(NUM_KEYS);
+    unsigned int seed = 2;
+    for (unsigned int i = 0; i < NUM_KEYS; i++) {
+      keys[i] = rand_r(&seed) % 10000;
+    }
+    vector<int*> items(NUM_KEYS);
+    squares.lookupBatch(keys.data(), NUM_KEYS, items.data());
+
+    unsigned int found = 0;
+    for (unsigned int i = 0; i < NUM_KEYS; i++) {
+      assert(items[i] == squares.lookup(keys[i]));
+      assert(items[i] == NULL || *items[i] == keys[i] * keys[i]);
+      found += items[i] != NULL;
+    }
+
+    // groups that do not divide the batch, and a batch of one
+    squares.lookupBatch(keys.data(), NUM_KEYS, items.data(), 7);
+    for (unsigned int i = 0; i < NUM_KEYS; i++) {
+      assert(items[i] == squares.lookup(keys[i]));
+    }
+    squares.lookupBatch(keys.data(), 1, items.data(), 1);
+    assert(items[0] == squares.lookup(keys[0]));
+    cout << " - " << found << " of " << NUM_KEYS << " keys found" << endl;
+  }
+  cout << endl;
+
+  cout << "Finding overlapping meetings with an IntervalMap" << endl;
+  {
+    // minutes since midnight
+    IntervalMap<int, string> meetings;
+    meetings.update(540, 600, "standup");
+    meetings.update(570, 660, "design review");
+    meetings.update(720, 780, "lunch");
+    meetings.update(600, 615, "one on one");
+    assert(meetings.size() == 4 && meetings.hasKey(570));
+
+    vector<string> found;
+    meetings.overlapping(600, [&](int, int, const string& item) { found.push_back(item); });
+    assert(found.size() == 3 && found[0] == "standup" && found[1] == "design review" &&
+           found[2] == "one on one");
+
+    meetings.remove(570);
+    found.clear();
+    meetings.overlapping(620, 730, [&](int lo, int hi, const string& item) {
+      cout << " - " << lo << " to " << hi << ": " << item << endl;
+      found.push_back(item);
+    });
+    assert(found.size() == 1 && found[0] == "lunch");
+
+    // random ranges checked against testing every range in turn
+    IntervalMap<int, int> ranges;
+    vector<int> ends(1000, -1);
+    unsigned int seed = 3;
+    for (unsigned int i = 0; i < 5000; i++) {
+      int lo = rand_r(&seed) % 1000;
+      if (ends[lo] != -1 && rand_r(&seed) % 3 == 0) {
+        ranges.remove(lo);
+        ends[lo] = -1;
+      }
+      else {
+        ends[lo] = lo + rand_r(&seed) % 50;
+        ranges.update(lo, ends[lo], i);
+      }
+    }
+    for (int point = 0; point < 1050; point += 7) {
+      int previous = -1;
+      unsigned int numFound = 0;
+      ranges.overlapping(point, point + 10, [&](int lo, int hi, int) {
+        assert(previous < lo && ends[lo] == hi && lo <= point + 10 && point <= hi);
+        (void) hi;
+        previous = lo;
+        numFound++;
+      });
+
+      unsigned int numExpected = 0;
+      for (int lo = 0; lo < 1000; lo++) {
+        numExpected += ends[lo] != -1 && lo <= point + 10 && point <= ends[lo];
+      }
+      assert(numFound == numExpected);
+    }
+  }
+  cout << endl;
+
+  cout << "Caching the hot keys of a CachedAVLMap" << endl;
+  {
+    // relayout after 50000 lookups, checked against a plain array of
+    // items where -1 marks a missing key
+    const unsigned int NUM_KEYS = 1000;
+    CachedAVLMap<int, int> map(64, 50000);
+    vector<int> expected(NUM_KEYS, -1);
+    unsigned int seed = 4;
+    for (unsigned int i = 0; i < 200000; i++) {
+      // most of the traffic goes to the first 16 keys
+      int key = rand_r(&seed) % 4 != 0 ? rand_r(&seed) % 16 : rand_r(&seed) % NUM_KEYS;
+      unsigned int op = rand_r(&seed) % 10;
+      if (op < 6) {
+        assert(map.hasKey(key) == (expected[key] != -1));
+        assert(expected[key] == -1 || map.at(key) == expected[key]);
+      }
+      else if (op < 9) {
+        map.update(key, i);
+        expected[key] = i;
+      }
+      else if (expected[key] != -1) {
+        map.remove(key);
+        expected[key] = -1;
+      }
+    }
+
+    // lookups alone never move nodes, so a reference stays good until
+    // the next mutation or relayout
+    map[3] = 33;
+    const int& three = map.at(3);
+    for (unsigned int i = 0; i < 100000; i++) {
+      map.hasKey(i % 16);
+    }
+    assert(three == 33);
+    (void) three;
+    expected[3] = 33;
+
+    map.relayout();
+    unsigned int numKeys = 0;
+    for (int key = 0; key < (int) NUM_KEYS; key++) {
+      assert(map.hasKey(key) == (expected[key] != -1));
+      if (expected[key] != -1) {
+        assert(map.at(key) == expected[key]);
+        numKeys++;
+      }
+    }
+    assert(map.size() == numKeys);
+    cout << " - " << map.size() << " keys, " << map.at(3) << " at key 3" << endl;
+  }
+  cout << endl;
+}
+
+int main(int argc, char* argv[]) {
+  // demo runs the examples and checks of the other containers,
+  // serve <socket> [threads] answers the commands below over the socket,
+  // bench <socket> [clients] [in flight] [requests] measures such a server
+  if (argc >= 2 && string(argv[1]) == "demo") {
+    runDemos();
+    return 0;
+  }
+  if (argc >= 3 && string(argv[1]) == "serve") {
+    unsigned int numThreads = (argc >= 4) ? atoi(argv[3]) : max(thread::hardware_concurrency(), 1u);
+    KVServer server(argv[2], numThreads);
+    if (server.error() != 0) {
+      cout << "could not serve on " << argv[2] << ": " << strerror(server.error()) << endl;
+      return 1;
+    }
+    cout << "serving on " << argv[2] << " with " << numThreads << " threads" << endl;
+    server.run();
+    return 0;
+  }
+  if (argc >= 3 && string(argv[1]) == "bench") {
+    runLoadGenerator(argv[2], (argc >= 4) ? atoi(argv[3]) : 4, (argc >= 5) ? atoi(argv[4]) : 32,
+                     (argc >= 6) ? atoi(argv[5]) : 200000);
+    return 0;
+  }
+
+  AVLMap<string, int> tree;
+
+  while (true) {
+    char cmd;
+    string name;
+    int grade;
+
+    cin >> cmd;
+    if (cmd == 'S') {
+        cout << tree.size() << endl;
+    }
+    else if (cmd == 'U') {
+      cin >> name >> grade;
+      tree[name] = grade;
+    }
+    else if (cmd == 'F') {
+      cin >> name;
+      if (tree.hasKey(name)) {
+        cout << name << " found with grade " << tree[name] << endl;
+      }
+      else {
+        cout << name << " not found" << endl;
+      }
+    }
+    else if (cmd == 'R') {
+      cin >> name;
       if (!tree.hasKey(name)) {
         cout << name << " not found" << endl;
       }
@@ -591,6 +5337,39 @@ int main() {
       cout << "Printing" << endl;
       printTree(tree);
     }
+    else if (cmd == 'E') {
+      cin >> name;
+      if (exportTree(tree, name, EXPORT_TSV)) {
+        cout << "Exported to " << name << endl;
+      }
+      else {
+        cout << "Could not export to " << name << endl;
+      }
+    }
+    else if (cmd == 'W') {
+      cin >> name;
+      SnapshotWriter snapshot(name);
+      saveSnapshot(tree, snapshot);
+      if (snapshot.finish()) {
+        cout << "Saved " << snapshot.size() << " bytes to " << name << endl;
+      }
+      else {
+        cout << "Could not save to " << name << ": " << strerror(snapshot.error()) << endl;
+      }
+    }
+    else if (cmd == 'L') {
+      cin >> name;
+      SnapshotReader snapshot(name);
+      if (loadSnapshot(snapshot, tree)) {
+        cout << "Loaded " << tree.size() << " entries from " << name << endl;
+      }
+      else if (snapshot.error() != 0) {
+        cout << "Could not load " << name << ": " << strerror(snapshot.error()) << endl;
+      }
+      else {
+        cout << "Could not load " << name << ": not a snapshot" << endl;
+      }
+    }
     else if (cmd == 'Q') {
       cout << "stopping" << endl;
       return 0;
@@ -603,6 +5382,9 @@ int main() {
       << "F <name> - check if the name is in the tree" << endl
       << "R <name> - remove the entry with the given name" << endl
       << "P - print all entries in the tree, ordered by key" << endl
+      << "E <file> - write all entries to the file, one tab-separated line each" << endl
+      << "W <file> - save a snapshot of the tree to the file" << endl
+      << "L <file> - replace the tree with the snapshot in the file" << endl
       << "Q - stop" << endl;
 
       // eat up the rest of the line
@@ -0,0 +1,953 @@
+/*
+  An immutable vector whose versions share structure, so keeping every
+  version of some state costs little more than keeping the last one.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T> class TransientVector;
+
+/*
+  A persistent vector: a 32-way tree with the items in its leaves, plus a
+  tail leaf holding the last (up to) 32 items outside the tree.
+
+  An operation never changes a vector, it returns a new one that shares
+  every node it did not touch with the old one. set copies the O(log32 n)
+  nodes on the path to the item, pushBack usually only the tail, and
+  copying a vector (a snapshot) copies nothing but two pointers; nodes
+  count their references and are freed with the last version using them.
+
+  While every leaf but the last is full, an index picks its child with
+  5 of its bits per level. concat and slice leave partly filled leaves in
+  the middle, so the nodes they build carry a table of the sizes of their
+  children (a relaxed radix-balanced, or RRB, tree) and lookups there scan
+  on from the child the bits point to. concat joins the two trees along
+  the seam between them like B-trees, merging nodes that fit in one and
+  evening out ones that do not, in O(log n) time; slice cuts the paths
+  to its two ends, also in O(log n) time.
+
+  For batches of changes, transient() gives a TransientVector that
+  changes the nodes it copied in place instead of copying them again.
+
+  The reference counts are not atomic, so versions sharing nodes must
+  stay on one thread.
+
+  Assumes:
+    - T has a default constructor and assignment operator
+*/
+template <typename T>
+class PersistentVector {
+public:
+  // creates an empty vector
+  PersistentVector();
+  ~PersistentVector();
+
+  // snapshots, O(1)
+  PersistentVector(const PersistentVector& copy);
+  PersistentVector& operator=(const PersistentVector& rhs);
+
+  const T& operator[](unsigned int index) const;
+
+  unsigned int size() const;
+
+  // the vector with the item at the index replaced
+  PersistentVector set(unsigned int index, const T& item) const;
+
+  // the vector with the item appended
+  PersistentVector pushBack(const T& item) const;
+
+  // the items of this vector followed by those of other
+  PersistentVector concat(const PersistentVector& other) const;
+
+  // the items begin, ..., end-1
+  PersistentVector slice(unsigned int begin, unsigned int end) const;
+
+  // a vector to make a batch of changes to, this vector stays as it is
+  TransientVector<T> transient() const;
+
+private:
+  static const unsigned int BITS = 5;
+  static const unsigned int BRANCH = 1 << BITS;
+
+  struct Node {
+    unsigned int refs;
+    unsigned int edit;  // the transient that may change it in place, 0 for none
+    unsigned int count; // # of items or children used
+  };
+
+  struct Leaf : Node {
+    T items[BRANCH];
+  };
+
+  // a node at level shift has children holding up to 1 << shift items each
+  struct Branch : Node {
+    unsigned int *sizes; // items in children 0, ..., i for relaxed nodes, else NULL
+    Node *children[BRANCH];
+  };
+
+  Node *root;     // a Branch at level shift, or NULL
+  Leaf *tail;     // the items after the tree, or NULL
+  unsigned int count;
+  unsigned int shift;
+
+  static Leaf* newLeaf(unsigned int edit);
+  static Branch* newBranch(unsigned int edit);
+  static Node* acquire(Node* node);
+  static void release(Node* node, unsigned int shift);
+
+  // the node in the slot, copied first unless the edit may change it
+  static Leaf* ownLeaf(Node*& slot, unsigned int edit);
+  static Branch* ownBranch(Node*& slot, unsigned int shift, unsigned int edit);
+
+  static unsigned int treeSize(const Node* node, unsigned int shift);
+
+  // the child holding the index, with the index made relative to the child
+  static unsigned int childFor(const Branch* branch, unsigned int shift, unsigned int& index);
+
+  // gives the branch a size table, or drops it, depending on whether
+  // every child but the last is full
+  static void fixSizes(Branch* branch, unsigned int shift);
+
+  // true iff a leaf can be appended below the node
+  static bool hasRoom(const Node* node, unsigned int shift);
+
+  // a chain of single-child branches from level shift down to the leaf
+  static Node* newPath(Node* leaf, unsigned int shift, unsigned int edit);
+  static void appendLeaf(Node*& slot, unsigned int shift, Node* leaf, unsigned int edit);
+
+  // the ones below consume the references they are given
+
+  // joins two trees at the same level into one or two nodes in out
+  static unsigned int merge(Node* a, Node* b, unsigned int shift, Node* out[2]);
+  static Node* takeFront(Node* node, unsigned int shift, unsigned int n);
+  static Node* dropFront(Node* node, unsigned int shift, unsigned int n);
+
+  // makes the vector the given tree, with its root collapsed
+  void assign(Node* tree, unsigned int treeShift);
+
+  // a tree of all the items, tail included, and its level
+  Node* wholeTree(unsigned int& treeShift) const;
+
+  // the changes themselves, in place wherever the edit allows
+  void setIn(unsigned int index, const T& item, unsigned int edit);
+  void pushBackIn(const T& item, unsigned int edit);
+  void pushLeaf(Node* leaf, unsigned int edit);
+
+  friend class TransientVector<T>;
+};
+
+/*
+  A vector being changed in a batch, made by PersistentVector::transient.
+
+  It has its own edit number and marks the nodes it copies with it; later
+  changes to those nodes happen in place, so a batch of n pushBacks or
+  sets costs about what n changes to a DynamicArray do. persistent()
+  hands the result back as a PersistentVector and ends the batch.
+*/
+template <typename T>
+class TransientVector {
+public:
+  // two transients changing the same nodes in place would see each
+  // other's changes, so they cannot be copied
+  TransientVector(const TransientVector& copy) = delete;
+  TransientVector& operator=(const TransientVector& rhs) = delete;
+
+  const T& operator[](unsigned int index) const;
+
+  unsigned int size() const;
+
+  void set(unsigned int index, const T& item);
+  void pushBack(const T& item);
+
+  // the vector as it is now, the transient must not be used after this
+  PersistentVector<T> persistent();
+
+private:
+  TransientVector(const PersistentVector<T>& from);
+
+  PersistentVector<T> vector;
+  unsigned int edit; // 0 once persistent() was called
+
+  friend class PersistentVector<T>;
+};
+
+template <typename T>
+typename PersistentVector<T>::Leaf* PersistentVector<T>::newLeaf(unsigned int edit) {
+  Leaf *leaf = new Leaf();
+  leaf->refs = 1;
+  leaf->edit = edit;
+  leaf->count = 0;
+  return leaf;
+}
+
+template <typename T>
+typename PersistentVector<T>::Branch* PersistentVector<T>::newBranch(unsigned int edit) {
+  Branch *branch = new Branch();
+  branch->refs = 1;
+  branch->edit = edit;
+  branch->count = 0;
+  branch->sizes = NULL;
+  return branch;
+}
+
+template <typename T>
+typename PersistentVector<T>::Node* PersistentVector<T>::acquire(Node* node) {
+  if (node != NULL) {
+    node->refs++;
+  }
+  return node;
+}
+
+template <typename T>
+void PersistentVector<T>::release(Node* node, unsigned int shift) {
+  if (node == NULL || --node->refs > 0) {
+    return;
+  }
+  if (shift == 0) {
+    delete static_cast<Leaf*>(node);
+    return;
+  }
+  Branch *branch = static_cast<Branch*>(node);
+  for (unsigned int i = 0; i < branch->count; i++) {
+    release(branch->children[i], shift - BITS);
+  }
+  delete[] branch->sizes;
+  delete branch;
+}
+
+template <typename T>
+typename PersistentVector<T>::Leaf* PersistentVector<T>::ownLeaf(Node*& slot, unsigned int edit) {
+  Leaf *leaf = static_cast<Leaf*>(slot);
+  if (edit != 0 && leaf->edit == edit) {
+    return leaf;
+  }
+  Leaf *copy = newLeaf(edit);
+  copy->count = leaf->count;
+  for (unsigned int i = 0; i < leaf->count; i++) {
+    copy->items[i] = leaf->items[i];
+  }
+  release(leaf, 0);
+  slot = copy;
+  return copy;
+}
+
+template <typename T>
+typename PersistentVector<T>::Branch* PersistentVector<T>::ownBranch(Node*& slot, unsigned int shift,
+                                                                     unsigned int edit) {
+  Branch *branch = static_cast<Branch*>(slot);
+  if (edit != 0 && branch->edit == edit) {
+    return branch;
+  }
+
+  // the copy shares the children, so they gain a reference before the
+  // old branch (maybe) lets go of them
+  Branch *copy = newBranch(edit);
+  copy->count = branch->count;
+  for (unsigned int i = 0; i < branch->count; i++) {
+    copy->children[i] = acquire(branch->children[i]);
+  }
+  if (branch->sizes != NULL) {
+    copy->sizes = new unsigned int[BRANCH];
+    for (unsigned int i = 0; i < branch->count; i++) {
+      copy->sizes[i] = branch->sizes[i];
+    }
+  }
+  release(branch, shift);
+  slot = copy;
+  return copy;
+}
+
+template <typename T>
+unsigned int PersistentVector<T>::treeSize(const Node* node, unsigned int shift) {
+  if (node == NULL) {
+    return 0;
+  }
+  if (shift == 0) {
+    return node->count;
+  }
+  const Branch *branch = static_cast<const Branch*>(node);
+  if (branch->sizes != NULL) {
+    return branch->sizes[branch->count - 1];
+  }
+  return ((branch->count - 1) << shift) + treeSize(branch->children[branch->count - 1], shift - BITS);
+}
+
+template <typename T>
+unsigned int PersistentVector<T>::childFor(const Branch* branch, unsigned int shift, unsigned int& index) {
+  unsigned int child = index >> shift;
+  if (branch->sizes == NULL) {
+    index &= (1u << shift) - 1;
+    return child;
+  }
+
+  // no child holds more than 1 << shift items, so the one holding the
+  // index is not before the one the bits point to
+  while (branch->sizes[child] <= index) {
+    child++;
+  }
+  if (child > 0) {
+    index -= branch->sizes[child - 1];
+  }
+  return child;
+}
+
+template <typename T>
+void PersistentVector<T>::fixSizes(Branch* branch, unsigned int shift) {
+  bool regular = true;
+  for (unsigned int i = 0; i+1 < branch->count && regular; i++) {
+    regular = treeSize(branch->children[i], shift - BITS) == (1u << shift);
+  }
+
+  if (regular) {
+    delete[] branch->sizes;
+    branch->sizes = NULL;
+    return;
+  }
+  if (branch->sizes == NULL) {
+    branch->sizes = new unsigned int[BRANCH];
+  }
+  unsigned int total = 0;
+  for (unsigned int i = 0; i < branch->count; i++) {
+    total += treeSize(branch->children[i], shift - BITS);
+    branch->sizes[i] = total;
+  }
+}
+
+template <typename T>
+bool PersistentVector<T>::hasRoom(const Node* node, unsigned int shift) {
+  if (node->count < BRANCH) {
+    return true;
+  }
+  if (shift == BITS) {
+    return false;
+  }
+  const Branch *branch = static_cast<const Branch*>(node);
+  return hasRoom(branch->children[branch->count - 1], shift - BITS);
+}
+
+template <typename T>
+typename PersistentVector<T>::Node* PersistentVector<T>::newPath(Node* leaf, unsigned int shift,
+                                                                 unsigned int edit) {
+  if (shift == 0) {
+    return leaf;
+  }
+  Branch *branch = newBranch(edit);
+  branch->children[0] = newPath(leaf, shift - BITS, edit);
+  branch->count = 1;
+  return branch;
+}
+
+template <typename T>
+void PersistentVector<T>::appendLeaf(Node*& slot, unsigned int shift, Node* leaf, unsigned int edit) {
+  Branch *branch = ownBranch(slot, shift, edit);
+  unsigned int last = branch->count - 1;
+  if (shift > BITS && hasRoom(branch->children[last], shift - BITS)) {
+    appendLeaf(branch->children[last], shift - BITS, leaf, edit);
+  }
+  else {
+    branch->children[branch->count++] = newPath(leaf, shift - BITS, edit);
+  }
+
+  // a new child after one that is not full needs the size table
+  if (branch->sizes != NULL || treeSize(branch->children[last], shift - BITS) != (1u << shift)) {
+    fixSizes(branch, shift);
+  }
+}
+
+template <typename T>
+void PersistentVector<T>::pushLeaf(Node* leaf, unsigned int edit) {
+  if (root == NULL) {
+    root = newPath(leaf, BITS, edit);
+    shift = BITS;
+    return;
+  }
+  if (!hasRoom(root, shift)) {
+    // the tree is full, it becomes the first child of a new root
+    Branch *top = newBranch(edit);
+    top->children[0] = root;
+    top->children[1] = newPath(leaf, shift, edit);
+    top->count = 2;
+    shift += BITS;
+    fixSizes(top, shift);
+    root = top;
+    return;
+  }
+  appendLeaf(root, shift, leaf, edit);
+}
+
+template <typename T>
+void PersistentVector<T>::setIn(unsigned int index, const T& item, unsigned int edit) {
+  assert(index < count);
+  unsigned int tailStart = count - (tail == NULL ? 0 : tail->count);
+  if (index >= tailStart) {
+    Node *slot = tail;
+    tail = ownLeaf(slot, edit);
+    tail->items[index - tailStart] = item;
+    return;
+  }
+
+  Node **slot = &root;
+  for (unsigned int level = shift; level > 0; level -= BITS) {
+    Branch *branch = ownBranch(*slot, level, edit);
+    slot = &branch->children[childFor(branch, level, index)];
+  }
+  ownLeaf(*slot, edit)->items[index] = item;
+}
+
+template <typename T>
+void PersistentVector<T>::pushBackIn(const T& item, unsigned int edit) {
+  if (tail != NULL && tail->count == BRANCH) {
+    pushLeaf(tail, edit);
+    tail = NULL;
+  }
+  if (tail == NULL) {
+    tail = newLeaf(edit);
+  }
+  else {
+    Node *slot = tail;
+    tail = ownLeaf(slot, edit);
+  }
+  tail->items[tail->count++] = item;
+  count++;
+}
+
+template <typename T>
+unsigned int PersistentVector<T>::merge(Node* a, Node* b, unsigned int shift, Node* out[2]) {
+  if (shift == 0) {
+    Leaf *left = static_cast<Leaf*>(a), *right = static_cast<Leaf*>(b);
+    unsigned int total = left->count + right->count;
+    if (total > BRANCH && left->count >= BRANCH/2 && right->count >= BRANCH/2) {
+      // both are at least half full, keep them as they are
+      out[0] = a;
+      out[1] = b;
+      return 2;
+    }
+
+    // otherwise merge them into one leaf, or even them out over two
+    unsigned int numOut = total > BRANCH ? 2 : 1;
+    unsigned int firstCount = total / numOut + total % numOut;
+    Leaf *fresh[2] = {newLeaf(0), numOut == 2 ? newLeaf(0) : NULL};
+    for (unsigned int i = 0; i < total; i++) {
+      const T& item = i < left->count ? left->items[i] : right->items[i - left->count];
+      Leaf *to = i < firstCount ? fresh[0] : fresh[1];
+      to->items[to->count++] = item;
+    }
+    release(a, 0);
+    release(b, 0);
+    out[0] = fresh[0];
+    out[1] = fresh[1];
+    return numOut;
+  }
+
+  // merge the children on either side of the seam, then gather all the
+  // children and spread them over one or two branches
+  Branch *left = static_cast<Branch*>(a), *right = static_cast<Branch*>(b);
+  Node *seam[2];
+  unsigned int numSeam = merge(acquire(left->children[left->count - 1]),
+                               acquire(right->children[0]), shift - BITS, seam);
+
+  Node *children[2 * BRANCH];
+  unsigned int total = 0;
+  for (unsigned int i = 0; i+1 < left->count; i++) {
+    children[total++] = acquire(left->children[i]);
+  }
+  for (unsigned int i = 0; i < numSeam; i++) {
+    children[total++] = seam[i];
+  }
+  for (unsigned int i = 1; i < right->count; i++) {
+    children[total++] = acquire(right->children[i]);
+  }
+  release(a, shift);
+  release(b, shift);
+
+  unsigned int numOut = total > BRANCH ? 2 : 1;
+  unsigned int firstCount = total / numOut + total % numOut;
+  for (unsigned int o = 0, next = 0; o < numOut; o++) {
+    Branch *branch = newBranch(0);
+    unsigned int end = (o == 0) ? firstCount : total;
+    while (next < end) {
+      branch->children[branch->count++] = children[next++];
+    }
+    fixSizes(branch, shift);
+    out[o] = branch;
+  }
+  return numOut;
+}
+
+template <typename T>
+typename PersistentVector<T>::Node* PersistentVector<T>::takeFront(Node* node, unsigned int shift,
+                                                                   unsigned int n) {
+  if (n == 0) {
+    release(node, shift);
+    return NULL;
+  }
+  if (n == treeSize(node, shift)) {
+    return node;
+  }
+
+  if (shift == 0) {
+    Leaf *leaf = newLeaf(0);
+    for (unsigned int i = 0; i < n; i++) {
+      leaf->items[leaf->count++] = static_cast<Leaf*>(node)->items[i];
+    }
+    release(node, 0);
+    return leaf;
+  }
+
+  // keep the children before the one holding item n-1, and its front
+  Branch *branch = static_cast<Branch*>(node);
+  unsigned int within = n - 1;
+  unsigned int cut = childFor(branch, shift, within);
+  Branch *front = newBranch(0);
+  for (unsigned int i = 0; i < cut; i++) {
+    front->children[front->count++] = acquire(branch->children[i]);
+  }
+  front->children[front->count++] = takeFront(acquire(branch->children[cut]), shift - BITS, within + 1);
+  release(node, shift);
+  fixSizes(front, shift);
+  return front;
+}
+
+template <typename T>
+typename PersistentVector<T>::Node* PersistentVector<T>::dropFront(Node* node, unsigned int shift,
+                                                                   unsigned int n) {
+  if (n == 0) {
+    return node;
+  }
+  if (n == treeSize(node, shift)) {
+    release(node, shift);
+    return NULL;
+  }
+
+  if (shift == 0) {
+    Leaf *from = static_cast<Leaf*>(node);
+    Leaf *leaf = newLeaf(0);
+    for (unsigned int i = n; i < from->count; i++) {
+      leaf->items[leaf->count++] = from->items[i];
+    }
+    release(node, 0);
+    return leaf;
+  }
+
+  // drop the children before the one holding item n, and its front
+  Branch *branch = static_cast<Branch*>(node);
+  unsigned int within = n;
+  unsigned int cut = childFor(branch, shift, within);
+  Branch *back = newBranch(0);
+  back->children[back->count++] = dropFront(acquire(branch->children[cut]), shift - BITS, within);
+  for (unsigned int i = cut + 1; i < branch->count; i++) {
+    back->children[back->count++] = acquire(branch->children[i]);
+  }
+  release(node, shift);
+  fixSizes(back, shift);
+  return back;
+}
+
+template <typename T>
+void PersistentVector<T>::assign(Node* tree, unsigned int treeShift) {
+  release(root, shift);
+  release(tail, 0);
+  root = NULL;
+  tail = NULL;
+  shift = BITS;
+  count = treeSize(tree, treeShift);
+  if (tree == NULL) {
+    return;
+  }
+
+  // a root with a single child is replaced by the child
+  while (treeShift > 0 && tree->count == 1) {
+    Node *child = acquire(static_cast<Branch*>(tree)->children[0]);
+    release(tree, treeShift);
+    tree = child;
+    treeShift -= BITS;
+  }
+  if (treeShift == 0) {
+    tail = static_cast<Leaf*>(tree);
+  }
+  else {
+    root = tree;
+    shift = treeShift;
+  }
+}
+
+template <typename T>
+typename PersistentVector<T>::Node* PersistentVector<T>::wholeTree(unsigned int& treeShift) const {
+  if (root == NULL) {
+    treeShift = 0;
+    return acquire(tail);
+  }
+  if (tail == NULL) {
+    treeShift = shift;
+    return acquire(root);
+  }
+
+  // a copy of this vector with the tail pushed into the tree
+  PersistentVector<T> whole(*this);
+  whole.pushLeaf(acquire(whole.tail), 0);
+  treeShift = whole.shift;
+  return acquire(whole.root);
+}
+
+template <typename T>
+PersistentVector<T>::PersistentVector() {
+  root = NULL;
+  tail = NULL;
+  count = 0;
+  shift = BITS;
+}
+
+template <typename T>
+PersistentVector<T>::~PersistentVector() {
+  release(root, shift);
+  release(tail, 0);
+}
+
+template <typename T>
+PersistentVector<T>::PersistentVector(const PersistentVector& copy) {
+  root = acquire(copy.root);
+  tail = static_cast<Leaf*>(acquire(copy.tail));
+  count = copy.count;
+  shift = copy.shift;
+}
+
+template <typename T>
+PersistentVector<T>& PersistentVector<T>::operator=(const PersistentVector& rhs) {
+  // take the new references first in case rhs shares nodes with this
+  Node *newRoot = acquire(rhs.root);
+  Leaf *newTail = static_cast<Leaf*>(acquire(rhs.tail));
+  release(root, shift);
+  release(tail, 0);
+  root = newRoot;
+  tail = newTail;
+  count = rhs.count;
+  shift = rhs.shift;
+  return *this;
+}
+
+template <typename T>
+const T& PersistentVector<T>::operator[](unsigned int index) const {
+  assert(index < count);
+  unsigned int tailStart = count - (tail == NULL ? 0 : tail->count);
+  if (index >= tailStart) {
+    return tail->items[index - tailStart];
+  }
+
+  const Node *node = root;
+  for (unsigned int level = shift; level > 0; level -= BITS) {
+    const Branch *branch = static_cast<const Branch*>(node);
+    node = branch->children[childFor(branch, level, index)];
+  }
+  return static_cast<const Leaf*>(node)->items[index];
+}
+
+template <typename T>
+unsigned int PersistentVector<T>::size() const {
+  return count;
+}
+
+template <typename T>
+PersistentVector<T> PersistentVector<T>::set(unsigned int index, const T& item) const {
+  PersistentVector<T> result(*this);
+  result.setIn(index, item, 0);
+  return result;
+}
+
+template <typename T>
+PersistentVector<T> PersistentVector<T>::pushBack(const T& item) const {
+  PersistentVector<T> result(*this);
+  result.pushBackIn(item, 0);
+  return result;
+}
+
+template <typename T>
+PersistentVector<T> PersistentVector<T>::concat(const PersistentVector& other) const {
+  unsigned int shiftA, shiftB;
+  Node *a = wholeTree(shiftA), *b = other.wholeTree(shiftB);
+  PersistentVector<T> result;
+  if (a == NULL || b == NULL) {
+    result.assign(a != NULL ? a : b, a != NULL ? shiftA : shiftB);
+    return result;
+  }
+
+  // lift the shorter tree to the height of the taller one, the
+  // single-child branches this adds are merged away along the seam
+  while (shiftA < shiftB) {
+    a = newPath(a, BITS, 0);
+    shiftA += BITS;
+  }
+  while (shiftB < shiftA) {
+    b = newPath(b, BITS, 0);
+    shiftB += BITS;
+  }
+
+  Node *out[2];
+  if (merge(a, b, shiftA, out) == 1) {
+    result.assign(out[0], shiftA);
+  }
+  else {
+    Branch *top = newBranch(0);
+    top->children[0] = out[0];
+    top->children[1] = out[1];
+    top->count = 2;
+    fixSizes(top, shiftA + BITS);
+    result.assign(top, shiftA + BITS);
+  }
+  return result;
+}
+
+template <typename T>
+PersistentVector<T> PersistentVector<T>::slice(unsigned int begin, unsigned int end) const {
+  assert(begin <= end && end <= count);
+  unsigned int treeShift;
+  Node *tree = wholeTree(treeShift);
+  if (tree != NULL) {
+    tree = takeFront(tree, treeShift, end);
+  }
+  if (tree != NULL) {
+    tree = dropFront(tree, treeShift, begin);
+  }
+
+  PersistentVector<T> result;
+  result.assign(tree, treeShift);
+  return result;
+}
+
+template <typename T>
+TransientVector<T> PersistentVector<T>::transient() const {
+  return TransientVector<T>(*this);
+}
+
+template <typename T>
+TransientVector<T>::TransientVector(const PersistentVector<T>& from) : vector(from) {
+  // edit numbers only need to differ between transients
+  static unsigned int lastEdit = 0;
+  edit = ++lastEdit;
+}
+
+template <typename T>
+const T& TransientVector<T>::operator[](unsigned int index) const {
+  return vector[index];
+}
+
+template <typename T>
+unsigned int TransientVector<T>::size() const {
+  return vector.size();
+}
+
+template <typename T>
+void TransientVector<T>::set(unsigned int index, const T& item) {
+  assert(edit != 0);
+  vector.setIn(index, item, edit);
+}
+
+template <typename T>
+void TransientVector<T>::pushBack(const T& item) {
+  assert(edit != 0);
+  vector.pushBackIn(item, edit);
+}
+
+template <typename T>
+PersistentVector<T> TransientVector<T>::persistent() {
+  assert(edit != 0);
+  edit = 0;
+  return vector;
+}
+
+int main() {
+  const unsigned int N = 1000000, VERSIONS = 100;
+  srand(1);
+
+  // every change to the grades is kept as a version of its own
+  auto start = chrono::steady_clock::now();
+  DynamicArray<DynamicArray<int>*> copies(1);
+  copies[0] = new DynamicArray<int>(N);
+  for (unsigned int i = 0; i < N; i++) {
+    (*copies[0])[i] = rand() % 101;
+  }
+  for (unsigned int v = 1; v < VERSIONS; v++) {
+    copies.pushBack(new DynamicArray<int>(*copies[v-1]));
+    (*copies[v])[rand() % N] = rand() % 101;
+  }
+  double copyMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  srand(1);
+  start = chrono::steady_clock::now();
+  TransientVector<int> batch = PersistentVector<int>().transient();
+  for (unsigned int i = 0; i < N; i++) {
+    batch.pushBack(rand() % 101);
+  }
+  DynamicArray<PersistentVector<int> > versions(1);
+  versions[0] = batch.persistent();
+  for (unsigned int v = 1; v < VERSIONS; v++) {
+    unsigned int index = rand() % N;
+    versions.pushBack(versions[v-1].set(index, rand() % 101));
+  }
+  double persistentMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  for (unsigned int v = 0; v < VERSIONS; v += 11) {
+    for (unsigned int i = 0; i < N; i += 997) {
+      assert(versions[v][i] == (*copies[v])[i]);
+    }
+  }
+  cout << VERSIONS << " versions of " << N << " grades, one change each" << endl
+       << fixed << setprecision(1)
+       << "  copying DynamicArray: " << copyMs << " ms" << endl
+       << "  PersistentVector:     " << persistentMs << " ms" << endl << endl;
+
+  // the first and last 1000 grades of the last version, glued together
+  const PersistentVector<int>& last = versions[VERSIONS - 1];
+  PersistentVector<int> ends = last.slice(0, 1000).concat(last.slice(N - 1000, N));
+  assert(ends.size() == 2000 && ends[0] == last[0] && ends[1999] == last[N-1]);
+  cout << "grades at the two ends of the class: " << ends.size() << endl;
+
+  for (unsigned int v = 0; v < VERSIONS; v++) {
+    delete copies[v];
+  }
+
+  return 0;
+}
@@ -0,0 +1,857 @@
+/*
+  Priority queues: a d-ary heap, an indexed d-ary heap with decreaseKey,
+  and a radix heap for monotone integer keys, compared on Dijkstra's
+  shortest paths.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+/*
+  A min-heap where every node has D children, stored level by level in a
+  DynamicArray.
+
+  A wider node means a shallower heap (log_D n levels), so pop touches
+  fewer levels, at the cost of D-1 comparisons per level instead of 1.
+  The slots are grouped D at a time into 64-byte aligned groups and the
+  root sits in the last slot of group 0, which puts the D children of
+  every node in exactly one group: with D * sizeof(T) <= 64 (e.g. D=4
+  and 16-byte items) picking the smallest child reads a single cache line.
+
+  push and pop take O(log n) time, top takes O(1).
+
+  Assumes:
+    - Less is a strict weak order, top is the item no other is Less than
+    - T has a default constructor
+*/
+template <typename T, unsigned int D = 4, typename Less = less<T> >
+class DaryHeap {
+public:
+  // creates an empty heap
+  DaryHeap();
+
+  void push(const T& item);
+
+  // the smallest item, the heap must not be empty
+  const T& top() const;
+
+  // removes the smallest item
+  void pop();
+
+  unsigned int size() const;
+  bool empty() const;
+
+private:
+  struct alignas(64) Group {
+    T slots[D];
+  };
+
+  DynamicArray<Group> groups; // grown a group at a time, never shrunk
+  unsigned int count;
+  Less less;
+
+  // the node at index i of the level order, whose children are D*i+1 to D*i+D
+  T& at(unsigned int i);
+  const T& at(unsigned int i) const;
+
+  // move the item at index i up or down to where it belongs
+  void siftUp(unsigned int i);
+  void siftDown(unsigned int i);
+};
+
+template <typename T, unsigned int D, typename Less>
+DaryHeap<T,D,Less>::DaryHeap() {
+  count = 0;
+}
+
+template <typename T, unsigned int D, typename Less>
+T& DaryHeap<T,D,Less>::at(unsigned int i) {
+  // shift by D-1 so the children D*i+1 ... D*i+D land in group i+1
+  unsigned int slot = i + D - 1;
+  return groups[slot / D].slots[slot % D];
+}
+
+template <typename T, unsigned int D, typename Less>
+const T& DaryHeap<T,D,Less>::at(unsigned int i) const {
+  unsigned int slot = i + D - 1;
+  return groups[slot / D].slots[slot % D];
+}
+
+template <typename T, unsigned int D, typename Less>
+void DaryHeap<T,D,Less>::siftUp(unsigned int i) {
+  // carry the item up in a hole instead of swapping at every level
+  T item = at(i);
+  while (i > 0) {
+    unsigned int parent = (i - 1) / D;
+    if (!less(item, at(parent))) {
+      break;
+    }
+    at(i) = at(parent);
+    i = parent;
+  }
+  at(i) = item;
+}
+
+template <typename T, unsigned int D, typename Less>
+void DaryHeap<T,D,Less>::siftDown(unsigned int i) {
+  T item = at(i);
+  while (true) {
+    unsigned int first = D*i + 1;
+    if (first >= count) {
+      break;
+    }
+
+    unsigned int last = min(first + D, count), best = first;
+    for (unsigned int c = first + 1; c < last; c++) {
+      if (less(at(c), at(best))) {
+        best = c;
+      }
+    }
+    if (!less(at(best), item)) {
+      break;
+    }
+    at(i) = at(best);
+    i = best;
+  }
+  at(i) = item;
+}
+
+template <typename T, unsigned int D, typename Less>
+void DaryHeap<T,D,Less>::push(const T& item) {
+  if (count + D - 1 >= groups.size() * D) {
+    groups.pushBack(Group());
+  }
+  at(count) = item;
+  count++;
+  siftUp(count - 1);
+}
+
+template <typename T, unsigned int D, typename Less>
+const T& DaryHeap<T,D,Less>::top() const {
+  assert(count > 0);
+  return at(0);
+}
+
+template <typename T, unsigned int D, typename Less>
+void DaryHeap<T,D,Less>::pop() {
+  assert(count > 0);
+  count--;
+  if (count > 0) {
+    at(0) = at(count);
+    siftDown(0);
+  }
+}
+
+template <typename T, unsigned int D, typename Less>
+unsigned int DaryHeap<T,D,Less>::size() const {
+  return count;
+}
+
+template <typename T, unsigned int D, typename Less>
+bool DaryHeap<T,D,Less>::empty() const {
+  return count == 0;
+}
+
+/*
+  A d-ary min-heap of ids 0, ..., numIds-1, each with a key, that also
+  remembers where each id sits in the heap. That lets decreaseKey move an
+  id up in O(log n) time instead of pushing a second copy of it, so the
+  heap never holds more than numIds entries.
+
+  The heap entries carry their key, so comparisons do not follow the id
+  to a separate key array. Laid out in 64-byte groups like DaryHeap.
+
+  Assumes:
+    - Less is a strict weak order on K
+    - K has a default constructor
+*/
+template <typename K, unsigned int D = 4, typename Less = less<K> >
+class IndexedHeap {
+public:
+  // creates an empty heap for the ids 0, ..., numIds-1
+  IndexedHeap(unsigned int numIds);
+
+  // true iff the id is in the heap
+  bool contains(unsigned int id) const;
+
+  // adds the id, which must not be in the heap
+  void push(unsigned int id, const K& key);
+
+  // lowers the key of an id in the heap, the new key must not be larger
+  void decreaseKey(unsigned int id, const K& key);
+
+  // the key of an id in the heap
+  const K& key(unsigned int id) const;
+
+  // the id with the smallest key and that key, the heap must not be empty
+  unsigned int topId() const;
+  const K& topKey() const;
+
+  // removes the id with the smallest key
+  void pop();
+
+  unsigned int size() const;
+  bool empty() const;
+
+private:
+  static const unsigned int ABSENT = ~0u;
+
+  struct Entry {
+    K key;
+    unsigned int id;
+  };
+
+  struct alignas(64) Group {
+    Entry slots[D];
+  };
+
+  DynamicArray<Group> groups;
+  unsigned int count;
+  DynamicArray<unsigned int> position; // index in the heap of each id, or ABSENT
+  Less less;
+
+  Entry& at(unsigned int i);
+  const Entry& at(unsigned int i) const;
+
+  // puts the entry at index i and records its new position
+  void place(unsigned int i, const Entry& entry);
+
+  void siftUp(unsigned int i);
+  void siftDown(unsigned int i);
+};
+
+template <typename K, unsigned int D, typename Less>
+IndexedHeap<K,D,Less>::IndexedHeap(unsigned int numIds) : position(numIds) {
+  count = 0;
+  for (unsigned int id = 0; id < numIds; id++) {
+    position[id] = ABSENT;
+  }
+}
+
+template <typename K, unsigned int D, typename Less>
+typename IndexedHeap<K,D,Less>::Entry& IndexedHeap<K,D,Less>::at(unsigned int i) {
+  unsigned int slot = i + D - 1;
+  return groups[slot / D].slots[slot % D];
+}
+
+template <typename K, unsigned int D, typename Less>
+const typename IndexedHeap<K,D,Less>::Entry& IndexedHeap<K,D,Less>::at(unsigned int i) const {
+  unsigned int slot = i + D - 1;
+  return groups[slot / D].slots[slot % D];
+}
+
+template <typename K, unsigned int D, typename Less>
+void IndexedHeap<K,D,Less>::place(unsigned int i, const Entry& entry) {
+  at(i) = entry;
+  position[entry.id] = i;
+}
+
+template <typename K, unsigned int D, typename Less>
+void IndexedHeap<K,D,Less>::siftUp(unsigned int i) {
+  Entry entry = at(i);
+  while (i > 0) {
+    unsigned int parent = (i - 1) / D;
+    if (!less(entry.key, at(parent).key)) {
+      break;
+    }
+    place(i, at(parent));
+    i = parent;
+  }
+  place(i, entry);
+}
+
+template <typename K, unsigned int D, typename Less>
+void IndexedHeap<K,D,Less>::siftDown(unsigned int i) {
+  Entry entry = at(i);
+  while (true) {
+    unsigned int first = D*i + 1;
+    if (first >= count) {
+      break;
+    }
+
+    unsigned int last = min(first + D, count), best = first;
+    for (unsigned int c = first + 1; c < last; c++) {
+      if (less(at(c).key, at(best).key)) {
+        best = c;
+      }
+    }
+    if (!less(at(best).key, entry.key)) {
+      break;
+    }
+    place(i, at(best));
+    i = best;
+  }
+  place(i, entry);
+}
+
+template <typename K, unsigned int D, typename Less>
+bool IndexedHeap<K,D,Less>::contains(unsigned int id) const {
+  return position[id] != ABSENT;
+}
+
+template <typename K, unsigned int D, typename Less>
+void IndexedHeap<K,D,Less>::push(unsigned int id, const K& key) {
+  assert(!contains(id));
+  if (count + D - 1 >= groups.size() * D) {
+    groups.pushBack(Group());
+  }
+  Entry entry;
+  entry.key = key;
+  entry.id = id;
+  place(count, entry);
+  count++;
+  siftUp(count - 1);
+}
+
+template <typename K, unsigned int D, typename Less>
+void IndexedHeap<K,D,Less>::decreaseKey(unsigned int id, const K& key) {
+  assert(contains(id) && !less(at(position[id]).key, key));
+  at(position[id]).key = key;
+  siftUp(position[id]);
+}
+
+template <typename K, unsigned int D, typename Less>
+const K& IndexedHeap<K,D,Less>::key(unsigned int id) const {
+  assert(contains(id));
+  return at(position[id]).key;
+}
+
+template <typename K, unsigned int D, typename Less>
+unsigned int IndexedHeap<K,D,Less>::topId() const {
+  assert(count > 0);
+  return at(0).id;
+}
+
+template <typename K, unsigned int D, typename Less>
+const K& IndexedHeap<K,D,Less>::topKey() const {
+  assert(count > 0);
+  return at(0).key;
+}
+
+template <typename K, unsigned int D, typename Less>
+void IndexedHeap<K,D,Less>::pop() {
+  assert(count > 0);
+  position[at(0).id] = ABSENT;
+  count--;
+  if (count > 0) {
+    place(0, at(count));
+    siftDown(0);
+  }
+}
+
+template <typename K, unsigned int D, typename Less>
+unsigned int IndexedHeap<K,D,Less>::size() const {
+  return count;
+}
+
+template <typename K, unsigned int D, typename Less>
+bool IndexedHeap<K,D,Less>::empty() const {
+  return count == 0;
+}
+
+/*
+  A radix heap: a min-priority queue for unsigned integer keys where no
+  key pushed is smaller than the last key popped, as in Dijkstra's
+  algorithm with non-negative edge weights.
+
+  Bucket 0 holds the keys equal to the last key popped, bucket b > 0 the
+  keys whose highest bit that differs from it is bit b-1. When bucket 0
+  runs out, the first non-empty bucket is scanned for its smallest key,
+  which becomes the last key, and its entries are spread over the lower
+  buckets. An entry only ever moves to lower buckets, so each is moved at
+  most 64 times over its life, and no comparisons between entries are
+  needed beyond that scan: push is O(1) and pop amortized O(log C) for
+  keys up to C.
+
+  Assumes:
+    - T has a default constructor
+*/
+template <typename T>
+class RadixHeap {
+public:
+  // creates an empty heap, the first key pushed can be any key
+  RadixHeap();
+
+  // adds an item, the key must not be less than the last key popped
+  void push(unsigned long long key, const T& item);
+
+  // the smallest key and an item with it, the heap must not be empty
+  unsigned long long topKey();
+  const T& topItem();
+
+  // removes the item topItem() returned
+  void pop();
+
+  unsigned int size() const;
+  bool empty() const;
+
+private:
+  static const unsigned int NUM_BUCKETS = 65;
+
+  struct Entry {
+    unsigned long long key;
+    T item;
+  };
+
+  // bucket b holds fill[b] entries, its DynamicArray only grows
+  DynamicArray<Entry> buckets[NUM_BUCKETS];
+  unsigned int fill[NUM_BUCKETS];
+  unsigned long long last;
+  unsigned int count;
+
+  unsigned int bucketFor(unsigned long long key) const;
+  void add(unsigned int bucket, const Entry& entry);
+
+  // makes bucket 0 non-empty, the heap must not be empty
+  void refill();
+};
+
+template <typename T>
+RadixHeap<T>::RadixHeap() {
+  for (unsigned int b = 0; b < NUM_BUCKETS; b++) {
+    fill[b] = 0;
+  }
+  last = 0;
+  count = 0;
+}
+
+template <typename T>
+unsigned int RadixHeap<T>::bucketFor(unsigned long long key) const {
+  return key == last ? 0 : 64 - __builtin_clzll(key ^ last);
+}
+
+template <typename T>
+void RadixHeap<T>::add(unsigned int bucket, const Entry& entry) {
+  if (fill[bucket] == buckets[bucket].size()) {
+    buckets[bucket].pushBack(entry);
+  }
+  else {
+    buckets[bucket][fill[bucket]] = entry;
+  }
+  fill[bucket]++;
+}
+
+template <typename T>
+void RadixHeap<T>::push(unsigned long long key, const T& item) {
+  assert(key >= last);
+  Entry entry;
+  entry.key = key;
+  entry.item = item;
+  add(bucketFor(key), entry);
+  count++;
+}
+
+template <typename T>
+void RadixHeap<T>::refill() {
+  assert(count > 0);
+  if (fill[0] > 0) {
+    return;
+  }
+
+  unsigned int b = 1;
+  while (fill[b] == 0) {
+    b++;
+  }
+
+  // the smallest key of the bucket becomes the last key, and every entry
+  // of the bucket now differs from it in a lower bit (or not at all)
+  DynamicArray<Entry>& from = buckets[b];
+  unsigned long long smallest = from[0].key;
+  for (unsigned int i = 1; i < fill[b]; i++) {
+    smallest = min(smallest, from[i].key);
+  }
+  last = smallest;
+
+  unsigned int n = fill[b];
+  fill[b] = 0;
+  for (unsigned int i = 0; i < n; i++) {
+    add(bucketFor(from[i].key), from[i]);
+  }
+}
+
+template <typename T>
+unsigned long long RadixHeap<T>::topKey() {
+  refill();
+  return last;
+}
+
+template <typename T>
+const T& RadixHeap<T>::topItem() {
+  refill();
+  return buckets[0][fill[0] - 1].item;
+}
+
+template <typename T>
+void RadixHeap<T>::pop() {
+  refill();
+  fill[0]--;
+  count--;
+}
+
+template <typename T>
+unsigned int RadixHeap<T>::size() const {
+  return count;
+}
+
+template <typename T>
+bool RadixHeap<T>::empty() const {
+  return count == 0;
+}
+
+// a directed graph with the out-edges of vertex v in
+// target[first[v]], ..., target[first[v+1]-1]
+struct Graph {
+  unsigned int numVertices;
+  DynamicArray<unsigned int> first;
+  DynamicArray<unsigned int> target;
+  DynamicArray<unsigned int> weight;
+};
+
+Graph randomGraph(unsigned int numVertices, unsigned int degree) {
+  Graph g;
+  g.numVertices = numVertices;
+  g.first.resize(numVertices + 1);
+  g.target.resize(numVertices * degree);
+  g.weight.resize(numVertices * degree);
+  for (unsigned int v = 0; v <= numVertices; v++) {
+    g.first[v] = v * degree;
+  }
+  for (unsigned int e = 0; e < numVertices * degree; e++) {
+    g.target[e] = rand() % numVertices;
+    g.weight[e] = 1 + rand() % 1000;
+  }
+  return g;
+}
+
+const unsigned long long UNREACHED = ~0ull;
+
+// the scheduling queue we had: scan every unsettled vertex for the closest
+void dijkstraLinear(const Graph& g, DynamicArray<unsigned long long>& dist) {
+  DynamicArray<bool> settled(g.numVertices);
+  for (unsigned int v = 0; v < g.numVertices; v++) {
+    settled[v] = false;
+  }
+  while (true) {
+    unsigned int u = g.numVertices;
+    for (unsigned int v = 0; v < g.numVertices; v++) {
+      if (!settled[v] && dist[v] != UNREACHED && (u == g.numVertices || dist[v] < dist[u])) {
+        u = v;
+      }
+    }
+    if (u == g.numVertices) {
+      return;
+    }
+    settled[u] = true;
+    for (unsigned int e = g.first[u]; e < g.first[u+1]; e++) {
+      unsigned long long d = dist[u] + g.weight[e];
+      if (d < dist[g.target[e]]) {
+        dist[g.target[e]] = d;
+      }
+    }
+  }
+}
+
+// lazy deletion: a vertex is pushed again whenever its distance drops and
+// the stale copies are skipped when they come out
+template <unsigned int D>
+void dijkstraHeap(const Graph& g, DynamicArray<unsigned long long>& dist) {
+  struct Pending {
+    unsigned long long dist;
+    unsigned int vertex;
+    bool operator<(const Pending& rhs) const {
+      return dist < rhs.dist;
+    }
+  };
+
+  DaryHeap<Pending, D> heap;
+  for (unsigned int v = 0; v < g.numVertices; v++) {
+    if (dist[v] != UNREACHED) {
+      heap.push(Pending{dist[v], v});
+    }
+  }
+  while (!heap.empty()) {
+    Pending next = heap.top();
+    heap.pop();
+    if (next.dist != dist[next.vertex]) {
+      continue;
+    }
+    for (unsigned int e = g.first[next.vertex]; e < g.first[next.vertex+1]; e++) {
+      unsigned long long d = next.dist + g.weight[e];
+      if (d < dist[g.target[e]]) {
+        dist[g.target[e]] = d;
+        heap.push(Pending{d, g.target[e]});
+      }
+    }
+  }
+}
+
+void dijkstraIndexed(const Graph& g, DynamicArray<unsigned long long>& dist) {
+  IndexedHeap<unsigned long long> heap(g.numVertices);
+  for (unsigned int v = 0; v < g.numVertices; v++) {
+    if (dist[v] != UNREACHED) {
+      heap.push(v, dist[v]);
+    }
+  }
+  while (!heap.empty()) {
+    unsigned int u = heap.topId();
+    heap.pop();
+    for (unsigned int e = g.first[u]; e < g.first[u+1]; e++) {
+      unsigned int v = g.target[e];
+      unsigned long long d = dist[u] + g.weight[e];
+      if (d < dist[v]) {
+        dist[v] = d;
+        if (heap.contains(v)) {
+          heap.decreaseKey(v, d);
+        }
+        else {
+          heap.push(v, d);
+        }
+      }
+    }
+  }
+}
+
+void dijkstraRadix(const Graph& g, DynamicArray<unsigned long long>& dist) {
+  RadixHeap<unsigned int> heap;
+  for (unsigned int v = 0; v < g.numVertices; v++) {
+    if (dist[v] != UNREACHED) {
+      heap.push(dist[v], v);
+    }
+  }
+  while (!heap.empty()) {
+    unsigned long long du = heap.topKey();
+    unsigned int u = heap.topItem();
+    heap.pop();
+    if (du != dist[u]) {
+      continue;
+    }
+    for (unsigned int e = g.first[u]; e < g.first[u+1]; e++) {
+      unsigned long long d = du + g.weight[e];
+      if (d < dist[g.target[e]]) {
+        dist[g.target[e]] = d;
+        heap.push(d, g.target[e]);
+      }
+    }
+  }
+}
+
+// runs the shortest paths from vertex 0, checks them against the
+// expected distances (if given) and returns the time taken in ms
+double timeDijkstra(const Graph& g, void (*run)(const Graph&, DynamicArray<unsigned long long>&),
+                    DynamicArray<unsigned long long>& dist) {
+  dist.resize(g.numVertices);
+  for (unsigned int v = 0; v < g.numVertices; v++) {
+    dist[v] = UNREACHED;
+  }
+  dist[0] = 0;
+
+  auto start = chrono::steady_clock::now();
+  run(g, dist);
+  return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+int main() {
+  srand(1);
+
+  // a scheduling queue: jobs come out in order of their deadline
+  DaryHeap<int> jobs;
+  int deadlines[] = {42, 7, 19, 3, 88, 7, 23};
+  for (int d : deadlines) {
+    jobs.push(d);
+  }
+  cout << "Deadlines in order:";
+  while (!jobs.empty()) {
+    cout << ' ' << jobs.top();
+    jobs.pop();
+  }
+  cout << endl << endl;
+
+  struct Variant {
+    const char *name;
+    void (*run)(const Graph&, DynamicArray<unsigned long long>&);
+  };
+  Variant variants[] = {
+    {"linear scan", dijkstraLinear},
+    {"binary heap", dijkstraHeap<2>},
+    {"4-ary heap", dijkstraHeap<4>},
+    {"8-ary heap", dijkstraHeap<8>},
+    {"indexed 4-ary", dijkstraIndexed},
+    {"radix heap", dijkstraRadix}
+  };
+
+  unsigned int sizes[] = {10000, 1000000};
+  for (unsigned int numVertices : sizes) {
+    Graph g = randomGraph(numVertices, 8);
+    cout << "Dijkstra on " << numVertices << " vertices, " << 8 * numVertices << " edges" << endl;
+
+    DynamicArray<unsigned long long> expected;
+    bool haveExpected = false;
+    for (const Variant& variant : variants) {
+      // the linear scan takes quadratic time, so only on the small graph
+      if (variant.run == dijkstraLinear && numVertices > 10000) {
+        continue;
+      }
+
+      DynamicArray<unsigned long long> dist;
+      double ms = timeDijkstra(g, variant.run, dist);
+      if (haveExpected) {
+        for (unsigned int v = 0; v < numVertices; v++) {
+          assert(dist[v] == expected[v]);
+        }
+      }
+      else {
+        expected = dist;
+        haveExpected = true;
+      }
+      cout << "  " << setw(14) << left << variant.name << right << setw(10)
+           << fixed << setprecision(1) << ms << " ms" << endl;
+    }
+    cout << endl;
+  }
+
+  return 0;
+}
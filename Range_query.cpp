@@ -0,0 +1,612 @@
+/*
+  Range queries over an array with point (and range) updates: a Fenwick
+  tree for prefix and range sums, and segment trees for range sum, min or
+  max, one of which also adds a value to a whole range at once.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <limits>
+#include <chrono>
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+/*
+  A Fenwick tree (binary indexed tree) over n values.
+
+  Slot i (from 1) holds the sum of the values i-lowbit(i)+1 ... i, where
+  lowbit(i) is the lowest set bit of i, so a prefix sum adds up one slot
+  per set bit of its length and an update touches one slot per level.
+  The slots are a single array of n values, no larger than the input.
+
+  add and the sums take O(log n) time, building from an array O(n).
+
+  Assumes:
+    - T supports +, - and += and T() is 0
+*/
+template <typename T>
+class FenwickTree {
+public:
+  // n values, all 0
+  FenwickTree(unsigned int n = 0);
+
+  // the values of the array
+  FenwickTree(const DynamicArray<T>& values);
+
+  // adds delta to value i
+  void add(unsigned int i, const T& delta);
+
+  // the sum of values 0, ..., end-1
+  T prefixSum(unsigned int end) const;
+
+  // the sum of values lo, ..., hi-1
+  T rangeSum(unsigned int lo, unsigned int hi) const;
+
+  unsigned int size() const;
+
+private:
+  DynamicArray<T> tree; // tree[i-1] is slot i
+};
+
+template <typename T>
+FenwickTree<T>::FenwickTree(unsigned int n) : tree(n) {
+  for (unsigned int i = 0; i < n; i++) {
+    tree[i] = T();
+  }
+}
+
+template <typename T>
+FenwickTree<T>::FenwickTree(const DynamicArray<T>& values) : tree(values) {
+  // each slot passes its finished sum on to the one slot that covers it,
+  // which has a larger index, so one left-to-right pass builds the tree
+  unsigned int n = tree.size();
+  for (unsigned int i = 1; i <= n; i++) {
+    unsigned int parent = i + (i & -i);
+    if (parent <= n) {
+      tree[parent-1] += tree[i-1];
+    }
+  }
+}
+
+template <typename T>
+void FenwickTree<T>::add(unsigned int i, const T& delta) {
+  assert(i < tree.size());
+  for (i++; i <= tree.size(); i += i & -i) {
+    tree[i-1] += delta;
+  }
+}
+
+template <typename T>
+T FenwickTree<T>::prefixSum(unsigned int end) const {
+  assert(end <= tree.size());
+  T sum = T();
+  for (; end > 0; end -= end & -end) {
+    sum += tree[end-1];
+  }
+  return sum;
+}
+
+template <typename T>
+T FenwickTree<T>::rangeSum(unsigned int lo, unsigned int hi) const {
+  assert(lo <= hi);
+  return prefixSum(hi) - prefixSum(lo);
+}
+
+template <typename T>
+unsigned int FenwickTree<T>::size() const {
+  return tree.size();
+}
+
+// the operations a segment tree can combine ranges with: an identity that
+// does not change anything it is combined with, and for LazySegmentTree
+// the effect of adding delta to each of length values on their combination
+template <typename T>
+struct SumOp {
+  static T identity() {
+    return T();
+  }
+
+  static T combine(const T& a, const T& b) {
+    return a + b;
+  }
+
+  static T apply(const T& combined, const T& delta, unsigned int length) {
+    return combined + delta * (T) length;
+  }
+};
+
+template <typename T>
+struct MinOp {
+  static T identity() {
+    return numeric_limits<T>::max();
+  }
+
+  static T combine(const T& a, const T& b) {
+    return min(a, b);
+  }
+
+  static T apply(const T& combined, const T& delta, unsigned int) {
+    return combined + delta;
+  }
+};
+
+template <typename T>
+struct MaxOp {
+  static T identity() {
+    return numeric_limits<T>::lowest();
+  }
+
+  static T combine(const T& a, const T& b) {
+    return max(a, b);
+  }
+
+  static T apply(const T& combined, const T& delta, unsigned int) {
+    return combined + delta;
+  }
+};
+
+/*
+  A segment tree over n values, stored bottom-up in one array of 2n
+  nodes: the values are the leaves n, ..., 2n-1 and node i combines nodes
+  2i and 2i+1, so there are no child pointers and no recursion.
+
+  A query walks up from both ends of the range at once and combines the
+  nodes that fall completely inside it; an update rewrites the path from
+  the leaf to the root. Both take O(log n) time, and the upper levels,
+  which every operation touches, sit together at the front of the array.
+
+  Op must be commutative (as SumOp, MinOp and MaxOp are), since a query
+  combines the nodes from the two ends in no particular order.
+*/
+template <typename T, typename Op = SumOp<T> >
+class SegmentTree {
+public:
+  // n values, all the identity of Op
+  SegmentTree(unsigned int n = 0);
+
+  // the values of the array, built in O(n) time
+  SegmentTree(const DynamicArray<T>& values);
+
+  // sets value i
+  void set(unsigned int i, const T& value);
+
+  // value i
+  const T& get(unsigned int i) const;
+
+  // the combination of values lo, ..., hi-1, the identity if lo == hi
+  T query(unsigned int lo, unsigned int hi) const;
+
+  unsigned int size() const;
+
+private:
+  DynamicArray<T> nodes; // nodes[0] is unused
+  unsigned int n;
+};
+
+template <typename T, typename Op>
+SegmentTree<T,Op>::SegmentTree(unsigned int n) : nodes(2*n) {
+  this->n = n;
+  for (unsigned int i = 0; i < 2*n; i++) {
+    nodes[i] = Op::identity();
+  }
+}
+
+template <typename T, typename Op>
+SegmentTree<T,Op>::SegmentTree(const DynamicArray<T>& values) : nodes(2 * values.size()) {
+  n = values.size();
+  for (unsigned int i = 0; i < n; i++) {
+    nodes[n + i] = values[i];
+  }
+  for (unsigned int i = n; i-- > 1; ) {
+    nodes[i] = Op::combine(nodes[2*i], nodes[2*i+1]);
+  }
+}
+
+template <typename T, typename Op>
+void SegmentTree<T,Op>::set(unsigned int i, const T& value) {
+  assert(i < n);
+  i += n;
+  nodes[i] = value;
+  for (i /= 2; i >= 1; i /= 2) {
+    nodes[i] = Op::combine(nodes[2*i], nodes[2*i+1]);
+  }
+}
+
+template <typename T, typename Op>
+const T& SegmentTree<T,Op>::get(unsigned int i) const {
+  assert(i < n);
+  return nodes[n + i];
+}
+
+template <typename T, typename Op>
+T SegmentTree<T,Op>::query(unsigned int lo, unsigned int hi) const {
+  assert(lo <= hi && hi <= n);
+  T result = Op::identity();
+
+  // lo is the left edge and hi one past the right edge of what is left,
+  // a left edge that is a right child (or a right edge that is a left
+  // child) is the last node of its parent in the range, so it is taken
+  for (lo += n, hi += n; lo < hi; lo /= 2, hi /= 2) {
+    if (lo & 1) {
+      result = Op::combine(result, nodes[lo++]);
+    }
+    if (hi & 1) {
+      result = Op::combine(result, nodes[--hi]);
+    }
+  }
+  return result;
+}
+
+template <typename T, typename Op>
+unsigned int SegmentTree<T,Op>::size() const {
+  return n;
+}
+
+/*
+  A segment tree that can also add a value to every value of a range.
+
+  Laid out bottom-up like SegmentTree, but over a power of two number of
+  leaves, with the leaves past n empty. A range add only updates the
+  O(log n) nodes covering the range and leaves the add pending at the
+  internal ones; the pending adds on the path to a node are pushed down
+  to its children before a query reads them. addRange and query both take
+  O(log n) time.
+
+  Assumes:
+    - Op::apply describes adding to a range (as for SumOp, MinOp, MaxOp)
+    - T() is the "nothing to add" delta
+*/
+template <typename T, typename Op = SumOp<T> >
+class LazySegmentTree {
+public:
+  // the values of the array, built in O(n) time
+  LazySegmentTree(const DynamicArray<T>& values);
+
+  // sets value i
+  void set(unsigned int i, const T& value);
+
+  // adds delta to values lo, ..., hi-1
+  void addRange(unsigned int lo, unsigned int hi, const T& delta);
+
+  // the combination of values lo, ..., hi-1, the identity if lo == hi
+  T query(unsigned int lo, unsigned int hi);
+
+  unsigned int size() const;
+
+private:
+  DynamicArray<T> nodes;            // 2*leaves nodes, nodes[0] is unused
+  DynamicArray<T> pending;          // add not yet pushed to the children of internal node i
+  DynamicArray<unsigned int> length; // # of values (not empty leaves) under node i
+  unsigned int n, leaves, height;
+
+  // adds delta to all values under node i
+  void applyTo(unsigned int i, const T& delta);
+
+  // pushes the pending adds on the path from the root down to leaf i
+  void pushDown(unsigned int leaf);
+
+  // recombines the ancestors of leaf i, keeping their own pending adds
+  void rebuildUp(unsigned int leaf);
+};
+
+template <typename T, typename Op>
+LazySegmentTree<T,Op>::LazySegmentTree(const DynamicArray<T>& values) {
+  n = values.size();
+  leaves = 1;
+  height = 0;
+  while (leaves < n) {
+    leaves *= 2;
+    height++;
+  }
+
+  nodes.resize(2 * leaves);
+  pending.resize(leaves);
+  length.resize(2 * leaves);
+  for (unsigned int i = 0; i < leaves; i++) {
+    nodes[leaves + i] = (i < n) ? values[i] : Op::identity();
+    length[leaves + i] = (i < n) ? 1 : 0;
+  }
+  for (unsigned int i = leaves - 1; i >= 1; i--) {
+    nodes[i] = Op::combine(nodes[2*i], nodes[2*i+1]);
+    length[i] = length[2*i] + length[2*i+1];
+    pending[i] = T();
+  }
+}
+
+template <typename T, typename Op>
+void LazySegmentTree<T,Op>::applyTo(unsigned int i, const T& delta) {
+  // empty leaves stay the identity
+  if (length[i] > 0) {
+    nodes[i] = Op::apply(nodes[i], delta, length[i]);
+  }
+  if (i < leaves) {
+    pending[i] += delta;
+  }
+}
+
+template <typename T, typename Op>
+void LazySegmentTree<T,Op>::pushDown(unsigned int leaf) {
+  for (unsigned int level = height; level >= 1; level--) {
+    unsigned int i = leaf >> level;
+    if (pending[i] != T()) {
+      applyTo(2*i, pending[i]);
+      applyTo(2*i+1, pending[i]);
+      pending[i] = T();
+    }
+  }
+}
+
+template <typename T, typename Op>
+void LazySegmentTree<T,Op>::rebuildUp(unsigned int leaf) {
+  for (unsigned int i = leaf / 2; i >= 1; i /= 2) {
+    nodes[i] = Op::combine(nodes[2*i], nodes[2*i+1]);
+    if (length[i] > 0) {
+      nodes[i] = Op::apply(nodes[i], pending[i], length[i]);
+    }
+  }
+}
+
+template <typename T, typename Op>
+void LazySegmentTree<T,Op>::set(unsigned int i, const T& value) {
+  assert(i < n);
+  pushDown(leaves + i);
+  nodes[leaves + i] = value;
+  rebuildUp(leaves + i);
+}
+
+template <typename T, typename Op>
+void LazySegmentTree<T,Op>::addRange(unsigned int lo, unsigned int hi, const T& delta) {
+  assert(lo <= hi && hi <= n);
+  if (lo == hi) {
+    return;
+  }
+
+  // the same walk as a query, adding to the covering nodes instead
+  unsigned int first = leaves + lo, last = leaves + hi - 1;
+  for (lo += leaves, hi += leaves; lo < hi; lo /= 2, hi /= 2) {
+    if (lo & 1) {
+      applyTo(lo++, delta);
+    }
+    if (hi & 1) {
+      applyTo(--hi, delta);
+    }
+  }
+
+  // then fix up every node that is only partly in the range
+  rebuildUp(first);
+  rebuildUp(last);
+}
+
+template <typename T, typename Op>
+T LazySegmentTree<T,Op>::query(unsigned int lo, unsigned int hi) {
+  assert(lo <= hi && hi <= n);
+  T result = Op::identity();
+  if (lo == hi) {
+    return result;
+  }
+
+  // the nodes a query reads are children of nodes on the paths to its two
+  // ends, so those are the only pending adds it needs pushed
+  pushDown(leaves + lo);
+  pushDown(leaves + hi - 1);
+  for (lo += leaves, hi += leaves; lo < hi; lo /= 2, hi /= 2) {
+    if (lo & 1) {
+      result = Op::combine(result, nodes[lo++]);
+    }
+    if (hi & 1) {
+      result = Op::combine(result, nodes[--hi]);
+    }
+  }
+  return result;
+}
+
+template <typename T, typename Op>
+unsigned int LazySegmentTree<T,Op>::size() const {
+  return n;
+}
+
+int main() {
+  const unsigned int N = 1000000, QUERIES = 1000;
+  srand(1);
+
+  DynamicArray<int> grades(N);
+  for (unsigned int i = 0; i < N; i++) {
+    grades[i] = rand() % 101;
+  }
+
+  // sums in long long so a million grades cannot overflow them
+  DynamicArray<long long> wide(N);
+  for (unsigned int i = 0; i < N; i++) {
+    wide[i] = grades[i];
+  }
+  FenwickTree<long long> sums(wide);
+  SegmentTree<int, MinOp<int> > lowest(grades);
+
+  // the same random ranges for the loops and the trees
+  DynamicArray<unsigned int> lo(QUERIES), hi(QUERIES);
+  for (unsigned int q = 0; q < QUERIES; q++) {
+    lo[q] = rand() % N;
+    hi[q] = lo[q] + 1 + rand() % (N - lo[q]);
+  }
+
+  auto start = chrono::steady_clock::now();
+  long long checkLoop = 0;
+  for (unsigned int q = 0; q < QUERIES; q++) {
+    long long sum = 0;
+    int low = 100;
+    for (unsigned int i = lo[q]; i < hi[q]; i++) {
+      sum += grades[i];
+      low = min(low, grades[i]);
+    }
+    checkLoop += sum + low;
+  }
+  double loopMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+  start = chrono::steady_clock::now();
+  long long checkTree = 0;
+  for (unsigned int q = 0; q < QUERIES; q++) {
+    checkTree += sums.rangeSum(lo[q], hi[q]) + lowest.query(lo[q], hi[q]);
+  }
+  double treeMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+  assert(checkLoop == checkTree);
+
+  cout << QUERIES << " range sums and minima over " << N << " grades" << endl;
+  cout << fixed << setprecision(3)
+       << "  looping over operator[]: " << loopMs << " ms" << endl
+       << "  Fenwick + segment tree:  " << treeMs << " ms" << endl << endl;
+
+  // a student's grade is corrected, then a curve of +5 is given to a section
+  sums.add(42, 100 - grades[42]);
+  lowest.set(42, 100);
+  grades[42] = 100;
+
+  LazySegmentTree<long long, MaxOp<long long> > highest(wide);
+  highest.set(42, 100);
+  highest.addRange(1000, 2000, 5);
+  cout << "best grade in section [1000, 2000) after the curve: " << highest.query(1000, 2000) << endl;
+  cout << "best grade elsewhere: "
+       << max(highest.query(0, 1000), highest.query(2000, N)) << endl;
+  cout << "average grade: " << (double) sums.prefixSum(N) / N << endl;
+
+  return 0;
+}
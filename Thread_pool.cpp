@@ -0,0 +1,686 @@
+/*
+  A work-stealing thread pool for the parallel operations of the
+  containers (parallel sort, bulk loads, joins, rehashing, ...), with
+  fork-join parallelInvoke and parallelFor on top of it.
+*/
+
+#include <cassert>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+using namespace std;
+
+// A dynamic array that can be resized when desired.
+template <typename T>
+class DynamicArray {
+public:
+  // create a new array with the given size
+  DynamicArray(unsigned int size = 0);
+  ~DynamicArray();
+
+  // copy constructor
+  DynamicArray(const DynamicArray& copy);
+
+  // assignment operator overload
+  DynamicArray& operator=(const DynamicArray& rhs);
+
+  // add a new entry to the end of the array
+  void pushBack(const T& item);
+
+  // resize the array, keeping the items in the current array
+  // except for ones that are indexed >= size (if any)
+  void resize(unsigned int newSize);
+
+  // these behave the same, but we need both versions
+  // the compiler will call the appropriate one (depending on whether
+  // the instance is a const instance or not)
+  T& operator[](unsigned int index);
+  const T& operator[](unsigned int index) const;
+
+  // just return the # of slots allocated to the array
+  unsigned int size() const;
+
+private:
+  T *array; // the actual array allocated in the heap
+  unsigned int numItems;  // number of items in the array, for the user
+  unsigned int arraySize; // size of the underlying array in the heap
+};
+
+template <typename T>
+DynamicArray<T>::DynamicArray(unsigned int size) {
+  // just point array to NULL and let resize do the work
+  array = NULL;
+  resize(size);
+}
+
+template <typename T>
+DynamicArray<T>::~DynamicArray() {
+  delete[] array;
+}
+
+template <typename T>
+DynamicArray<T>::DynamicArray(const DynamicArray& copy) {
+  // first get an array of the appropriate size,
+  // since this is a constructor, we treat it as if the array pointer
+  // was not initialized at all
+  // FURTHER STUDY FOR THE CURIOUS: constructor delegation
+  array = NULL;
+  resize(copy.numItems);
+
+  // now the array has the proper size, so just copy the contents of the other
+  // array into this array
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = copy.array[i];
+  }
+}
+
+// different than the copy constructor, see the lecture slides for a discussion
+template <typename T>
+DynamicArray<T>& DynamicArray<T>::operator=(const DynamicArray& rhs) {
+  resize(rhs.numItems);
+
+  for (unsigned int i = 0; i < numItems; i++) {
+    array[i] = rhs.array[i];
+  }
+
+  return *this;
+}
+
+template <typename T>
+void DynamicArray<T>::resize(unsigned int newSize) {
+  // get an array from the heap with twice the new user array size
+  // (or 10, if the new size is really small)
+  unsigned int newArraySize = max(newSize*2, 10u);
+
+  // get the new array
+  T *newArray = new T[newArraySize];
+
+  // if we had an old array (i.e. this was not called from the constructor),
+  // copy the contents over to the new array and then delete this array
+  if (array != NULL) {
+    // copy the old array over until we fill the new array (according to user size)
+    // or we copied all contents from the old array
+    for (unsigned int i = 0; i < min(numItems, newSize); i++) {
+      newArray[i] = array[i];
+    }
+    delete[] array;
+  }
+
+  // update the class members for this new array and point to it now
+  numItems = newSize;
+  arraySize = newArraySize;
+  array = newArray;
+}
+
+template <typename T>
+unsigned int DynamicArray<T>::size() const {
+  return numItems;
+}
+
+template <typename T>
+void DynamicArray<T>::pushBack(const T& item) {
+  // if the dynamic array is already full, resize it
+  if (numItems == arraySize) {
+    // resize to get enough space for more items
+    resize(numItems+1);
+    // but we haven't actually put the new item in yet
+    numItems--;
+  }
+
+  // either way, we now have space to add the item
+  // to the end of the user's array
+  array[numItems] = item;
+  numItems++;
+}
+
+template <typename T>
+T& DynamicArray<T>::operator[](unsigned int index) {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+template <typename T>
+const T& DynamicArray<T>::operator[](unsigned int index) const {
+  assert(index < numItems);
+  return array[index];
+}
+
+
+// a piece of work that parallelInvoke offers to other workers
+class Job {
+public:
+  Job() : done(false) {}
+  virtual ~Job() {}
+
+  virtual void execute() = 0;
+
+  // set once execute() has returned
+  atomic<bool> done;
+};
+
+template <typename F>
+class FunctionJob : public Job {
+public:
+  FunctionJob(F& f) : f(f) {}
+
+  void execute() {
+    f();
+  }
+
+private:
+  F& f;
+};
+
+/*
+  A Chase-Lev work-stealing deque of jobs.
+
+  The worker that owns the deque pushes and pops jobs at the bottom, like
+  a stack, while other workers steal the oldest jobs from the top. Only
+  the owner writes bottom and steals race on top with a compare-and-swap,
+  so push and pop need no atomic read-modify-write unless the deque is
+  down to its last job.
+
+  The jobs live in a ring buffer whose capacity is a power of 2 and that
+  doubles when full. A thief may still be reading the old ring, so old
+  rings are only freed with the deque.
+*/
+class WorkStealingDeque {
+public:
+  WorkStealingDeque(unsigned int capacity = 64);
+  ~WorkStealingDeque();
+
+  WorkStealingDeque(const WorkStealingDeque& copy) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque& rhs) = delete;
+
+  // owner only: add a job at the bottom
+  void push(Job* job);
+
+  // owner only: take the newest job, or NULL if there is none
+  Job* pop();
+
+  // any thread: take the oldest job, or NULL if there is none or another
+  // thread got to it first
+  Job* steal();
+
+private:
+  struct Ring {
+    Ring(long long capacity) : capacity(capacity), slots(new atomic<Job*>[capacity]) {}
+    ~Ring() {
+      delete[] slots;
+    }
+
+    Job* get(long long i) const {
+      return slots[i & (capacity-1)].load(memory_order_relaxed);
+    }
+
+    void put(long long i, Job* job) {
+      slots[i & (capacity-1)].store(job, memory_order_relaxed);
+    }
+
+    long long capacity;
+    atomic<Job*> *slots;
+  };
+
+  // top and bottom only ever grow (apart from pop undoing its decrement)
+  // and are on separate cache lines so thieves and the owner do not
+  // keep stealing the line from each other
+  alignas(64) atomic<long long> top;
+  alignas(64) atomic<long long> bottom;
+  alignas(64) atomic<Ring*> ring;
+  DynamicArray<Ring*> retired;
+};
+
+WorkStealingDeque::WorkStealingDeque(unsigned int capacity) : top(0), bottom(0) {
+  // make sure the capacity is a power of 2
+  assert(capacity > 0 && (capacity & (capacity-1)) == 0);
+  ring.store(new Ring(capacity), memory_order_relaxed);
+}
+
+WorkStealingDeque::~WorkStealingDeque() {
+  delete ring.load(memory_order_relaxed);
+  for (unsigned int i = 0; i < retired.size(); i++) {
+    delete retired[i];
+  }
+}
+
+void WorkStealingDeque::push(Job* job) {
+  long long b = bottom.load(memory_order_relaxed);
+  long long t = top.load(memory_order_acquire);
+  Ring *r = ring.load(memory_order_relaxed);
+
+  if (b - t >= r->capacity) {
+    // full, copy the jobs into a ring twice the size
+    Ring *bigger = new Ring(2*r->capacity);
+    for (long long i = t; i < b; i++) {
+      bigger->put(i, r->get(i));
+    }
+    retired.pushBack(r);
+    ring.store(bigger, memory_order_release);
+    r = bigger;
+  }
+
+  // publish the job, a thief that sees the new bottom sees the job too
+  r->put(b, job);
+  bottom.store(b+1, memory_order_release);
+}
+
+Job* WorkStealingDeque::pop() {
+  // claim the bottom job before looking at top, the fence makes sure a
+  // thief either sees the claim or the owner sees the thief's steal
+  long long b = bottom.load(memory_order_relaxed) - 1;
+  Ring *r = ring.load(memory_order_relaxed);
+  bottom.store(b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long long t = top.load(memory_order_relaxed);
+
+  if (t > b) {
+    // it was empty
+    bottom.store(b+1, memory_order_relaxed);
+    return NULL;
+  }
+
+  Job *job = r->get(b);
+  if (t == b) {
+    // the last job, race the thieves for it
+    if (!top.compare_exchange_strong(t, t+1, memory_order_seq_cst,
+                                     memory_order_relaxed)) {
+      job = NULL;
+    }
+    bottom.store(b+1, memory_order_relaxed);
+  }
+  return job;
+}
+
+Job* WorkStealingDeque::steal() {
+  long long t = top.load(memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long long b = bottom.load(memory_order_acquire);
+
+  if (t >= b) {
+    return NULL;
+  }
+
+  Ring *r = ring.load(memory_order_acquire);
+  Job *job = r->get(t);
+  if (!top.compare_exchange_strong(t, t+1, memory_order_seq_cst,
+                                   memory_order_relaxed)) {
+    // another thief or the owner took it
+    return NULL;
+  }
+  return job;
+}
+
+/*
+  A pool of worker threads that run fork-join work.
+
+  Every worker has its own WorkStealingDeque. parallelInvoke(f, g) pushes
+  g onto the deque of the calling worker and runs f; if g was not stolen
+  in the meantime the worker runs it right after, otherwise it steals
+  other jobs until g is done. Nested calls therefore split work at the
+  bottom of the deques while idle workers take the biggest pieces from
+  the top, which keeps all workers busy without a shared queue.
+
+  A thread that is not a worker of the pool (e.g. main) takes the place
+  of worker 0 for the duration of its call, so a pool of n threads starts
+  n-1 of its own. Only one outside thread is let in at a time. Workers
+  sleep while no outside call is running.
+*/
+class ThreadPool {
+public:
+  // numThreads = 0 means one per hardware thread
+  ThreadPool(unsigned int numThreads = 0);
+
+  // waits for the workers to finish
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool& copy) = delete;
+  ThreadPool& operator=(const ThreadPool& rhs) = delete;
+
+  // runs f() and g(), possibly at the same time, and returns once both are done
+  template <typename F, typename G>
+  void parallelInvoke(F f, G g);
+
+  // runs body(i) for every i in [begin, end), in chunks of at least grain
+  // indices (grain = 0 picks about 8 chunks per thread)
+  template <typename Body>
+  void parallelFor(unsigned int begin, unsigned int end, Body body, unsigned int grain = 0);
+
+  // the number of threads, including the calling thread
+  unsigned int size() const;
+
+  // the index (0 to size()-1) of the worker running the caller, so
+  // callers can keep per-worker results without locking
+  unsigned int workerIndex() const;
+
+private:
+  struct Worker {
+    WorkStealingDeque deque;
+    unsigned int index;
+    ThreadPool *pool;
+    unsigned int seed; // picks steal victims
+  };
+
+  Worker *workers;
+  unsigned int numWorkers;
+  thread *threads;
+
+  mutex outsideLock;         // held by the outside thread acting as worker 0
+  mutex sleepLock;
+  condition_variable wake;
+  atomic<bool> busy;         // an outside call is running
+  atomic<bool> stopping;
+
+  // the worker of the calling thread, NULL if it is not a worker
+  static thread_local Worker *current;
+
+  // makes an outside caller worker 0 until it goes out of scope
+  class Entry {
+  public:
+    Entry(ThreadPool* pool);
+    ~Entry();
+
+  private:
+    ThreadPool *pool;
+    bool entered;
+  };
+
+  void workerLoop(Worker* self);
+
+  // steals a job from a random other worker, NULL if none was found
+  Job* stealJob(Worker* self);
+
+  // runs a job and marks it as done
+  static void runJob(Job* job);
+
+  template <typename Body>
+  void splitFor(unsigned int begin, unsigned int end, Body& body, unsigned int grain);
+};
+
+thread_local ThreadPool::Worker *ThreadPool::current = NULL;
+
+ThreadPool::ThreadPool(unsigned int numThreads) : busy(false), stopping(false) {
+  if (numThreads == 0) {
+    numThreads = max(thread::hardware_concurrency(), 1u);
+  }
+  numWorkers = numThreads;
+  workers = new Worker[numWorkers];
+  for (unsigned int i = 0; i < numWorkers; i++) {
+    workers[i].index = i;
+    workers[i].pool = this;
+    workers[i].seed = 2*i + 1;
+  }
+
+  // worker 0 is whichever outside thread is calling in
+  threads = new thread[numWorkers];
+  for (unsigned int i = 1; i < numWorkers; i++) {
+    threads[i] = thread(&ThreadPool::workerLoop, this, &workers[i]);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> guard(sleepLock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (unsigned int i = 1; i < numWorkers; i++) {
+    threads[i].join();
+  }
+  delete[] threads;
+  delete[] workers;
+}
+
+unsigned int ThreadPool::size() const {
+  return numWorkers;
+}
+
+unsigned int ThreadPool::workerIndex() const {
+  assert(current != NULL && current->pool == this);
+  return current->index;
+}
+
+ThreadPool::Entry::Entry(ThreadPool* pool) {
+  this->pool = pool;
+  entered = (current == NULL);
+  if (entered) {
+    pool->outsideLock.lock();
+    current = &pool->workers[0];
+    {
+      lock_guard<mutex> guard(pool->sleepLock);
+      pool->busy = true;
+    }
+    pool->wake.notify_all();
+  }
+  else {
+    // a worker of another pool cannot lend itself to this one
+    assert(current->pool == pool);
+  }
+}
+
+ThreadPool::Entry::~Entry() {
+  if (entered) {
+    pool->busy = false;
+    current = NULL;
+    pool->outsideLock.unlock();
+  }
+}
+
+void ThreadPool::runJob(Job* job) {
+  job->execute();
+  job->done.store(true, memory_order_release);
+}
+
+Job* ThreadPool::stealJob(Worker* self) {
+  if (numWorkers == 1) {
+    return NULL;
+  }
+
+  // xorshift to pick where to start, then try everyone once
+  self->seed ^= self->seed << 13;
+  self->seed ^= self->seed >> 17;
+  self->seed ^= self->seed << 5;
+  unsigned int start = self->seed % numWorkers;
+  for (unsigned int i = 0; i < numWorkers; i++) {
+    Worker& victim = workers[(start + i) % numWorkers];
+    if (&victim != self) {
+      Job *job = victim.deque.steal();
+      if (job != NULL) {
+        return job;
+      }
+    }
+  }
+  return NULL;
+}
+
+void ThreadPool::workerLoop(Worker* self) {
+  current = self;
+  unsigned int idle = 0;
+  while (!stopping.load(memory_order_relaxed)) {
+    Job *job = self->deque.pop();
+    if (job == NULL) {
+      job = stealJob(self);
+    }
+    if (job != NULL) {
+      runJob(job);
+      idle = 0;
+      continue;
+    }
+
+    // spin for a bit, then sleep until an outside call comes in
+    if (++idle < 64) {
+      this_thread::yield();
+    }
+    else {
+      unique_lock<mutex> guard(sleepLock);
+      wake.wait(guard, [&] { return busy || stopping; });
+      idle = 0;
+    }
+  }
+  current = NULL;
+}
+
+template <typename F, typename G>
+void ThreadPool::parallelInvoke(F f, G g) {
+  Entry entry(this);
+  Worker *self = current;
+
+  FunctionJob<G> second(g);
+  self->deque.push(&second);
+  f();
+
+  // anything f pushed has been popped again, so the bottom job is g
+  // unless a thief took it
+  Job *job = self->deque.pop();
+  if (job != NULL) {
+    assert(job == &second);
+    g();
+    return;
+  }
+
+  // g was stolen, help out with other work until it is done
+  while (!second.done.load(memory_order_acquire)) {
+    job = stealJob(self);
+    if (job != NULL) {
+      runJob(job);
+    }
+    else {
+      this_thread::yield();
+    }
+  }
+}
+
+template <typename Body>
+void ThreadPool::splitFor(unsigned int begin, unsigned int end, Body& body, unsigned int grain) {
+  if (end - begin <= grain) {
+    for (unsigned int i = begin; i < end; i++) {
+      body(i);
+    }
+    return;
+  }
+
+  unsigned int mid = begin + (end - begin)/2;
+  parallelInvoke([&] { splitFor(begin, mid, body, grain); },
+                 [&] { splitFor(mid, end, body, grain); });
+}
+
+template <typename Body>
+void ThreadPool::parallelFor(unsigned int begin, unsigned int end, Body body, unsigned int grain) {
+  if (begin >= end) {
+    return;
+  }
+  if (grain == 0) {
+    grain = max((end - begin) / (8*numWorkers), 1u);
+  }
+
+  Entry entry(this);
+  splitFor(begin, end, body, grain);
+}
+
+// sorts array[begin, end) with a parallel merge sort, using tmp (of the
+// same size as array) as scratch space
+template <typename T>
+void parallelMergeSort(ThreadPool& pool, DynamicArray<T>& array, DynamicArray<T>& tmp,
+                       unsigned int begin, unsigned int end) {
+  // small ranges are not worth splitting
+  if (end - begin <= 4096) {
+    sort(&array[0] + begin, &array[0] + end);
+    return;
+  }
+
+  unsigned int mid = begin + (end - begin)/2;
+  pool.parallelInvoke([&] { parallelMergeSort(pool, array, tmp, begin, mid); },
+                      [&] { parallelMergeSort(pool, array, tmp, mid, end); });
+
+  merge(&array[0] + begin, &array[0] + mid, &array[0] + mid, &array[0] + end,
+        &tmp[0] + begin);
+  copy(&tmp[0] + begin, &tmp[0] + end, &array[0] + begin);
+}
+
+template <typename T>
+void parallelSort(ThreadPool& pool, DynamicArray<T>& array) {
+  if (array.size() > 1) {
+    DynamicArray<T> tmp(array.size());
+    parallelMergeSort(pool, array, tmp, 0, array.size());
+  }
+}
+
+// some busywork for the benchmark, roughly the same cost for every i
+unsigned int churn(unsigned int i) {
+  for (int round = 0; round < 200; round++) {
+    i = i*1103515245u + 12345u;
+  }
+  return i;
+}
+
+int main() {
+  ThreadPool pool(4);
+
+  cout << "Squaring 10 numbers in parallel" << endl;
+  DynamicArray<unsigned int> squares(10);
+  pool.parallelFor(0, 10, [&](unsigned int i) { squares[i] = i*i; }, 1);
+  for (unsigned int i = 0; i < 10; i++) {
+    assert(squares[i] == i*i);
+    cout << squares[i] << ' ';
+  }
+  cout << endl << endl;
+
+  cout << "Summing per worker" << endl;
+  DynamicArray<unsigned long long> sums(pool.size());
+  for (unsigned int t = 0; t < pool.size(); t++) {
+    sums[t] = 0;
+  }
+  pool.parallelFor(0, 1000000, [&](unsigned int i) { sums[pool.workerIndex()] += i; });
+  unsigned long long total = 0;
+  for (unsigned int t = 0; t < pool.size(); t++) {
+    total += sums[t];
+  }
+  assert(total == 999999ull*1000000/2);
+  cout << total << endl << endl;
+
+  cout << "Sorting 1000000 numbers in parallel" << endl;
+  DynamicArray<unsigned int> numbers(1000000);
+  for (unsigned int i = 0; i < numbers.size(); i++) {
+    numbers[i] = churn(i) % 1000000;
+  }
+  parallelSort(pool, numbers);
+  for (unsigned int i = 1; i < numbers.size(); i++) {
+    assert(numbers[i-1] <= numbers[i]);
+  }
+  cout << "sorted" << endl << endl;
+
+  // scaling: the same work on 1, 2, 4, ... threads, up to 64 or the
+  // number of hardware threads
+  unsigned int maxThreads = min(max(thread::hardware_concurrency(), 1u), 64u);
+  cout << "Scaling on up to " << maxThreads << " threads" << endl;
+  cout << setw(8) << left << "threads" << setw(14) << "for (ms)"
+       << setw(14) << "sort (ms)" << endl;
+
+  const unsigned int N = 4000000;
+  DynamicArray<unsigned int> work(N), data(N);
+  for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+    ThreadPool scaled(threads);
+
+    auto start = chrono::steady_clock::now();
+    scaled.parallelFor(0, N, [&](unsigned int i) { work[i] = churn(i); });
+    double forMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    for (unsigned int i = 0; i < N; i++) {
+      data[i] = work[i];
+    }
+    start = chrono::steady_clock::now();
+    parallelSort(scaled, data);
+    double sortMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    cout << setw(8) << threads << setw(14) << forMs << setw(14) << sortMs << endl;
+  }
+
+  return 0;
+}